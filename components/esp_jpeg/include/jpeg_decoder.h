@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
@@ -30,8 +32,25 @@ typedef enum {
 typedef enum {
     JPEG_IMAGE_FORMAT_RGB888 = 0,   /*!< Format RGB888 */
     JPEG_IMAGE_FORMAT_RGB565,       /*!< Format RGB565 */
+    JPEG_IMAGE_FORMAT_GRAY8,        /*!< Format 8-bit grayscale (luma only) */
 } esp_jpeg_image_format_t;
 
+/**
+ * @brief Stream read callback
+ *
+ * Reads up to len bytes of the JPEG into buf, blocking until at least one byte is available.
+ * Returning fewer bytes than asked (e.g. whatever a socket has received) is fine.
+ * The decoder reads ahead in blocks of JD_SZBUF bytes, so if the source carries more than this image
+ * (e.g. a keep-alive HTTP connection), do not return bytes past its end (e.g. Content-Length).
+ *
+ * @param[in]  arg: cfg->stream.arg
+ * @param[out] buf: Destination
+ * @param[in]  len: Maximum number of bytes to read
+ *
+ * @return Number of bytes read, 0 at the end of the stream or on error
+ */
+typedef size_t (*esp_jpeg_read_cb_t)(void *arg, uint8_t *buf, size_t len);
+
 /**
  * @brief JPEG Configuration Type
  *
@@ -39,6 +58,7 @@ typedef enum {
 typedef struct esp_jpeg_image_cfg_s {
     uint8_t *indata;        /*!< Input JPEG image */
     uint32_t indata_size;   /*!< Size of input image  */
+
     uint8_t *outbuf;        /*!< Output buffer */
     uint32_t outbuf_size;   /*!< Output buffer size */
     esp_jpeg_image_format_t out_format; /*!< Output image format */
@@ -58,6 +78,20 @@ typedef struct esp_jpeg_image_cfg_s {
     struct {
         uint32_t read;  /*!< Internal count of read bytes */
     } priv;
+
+    struct {
+        uint16_t x;         /*!< Left edge of the region, in output (scaled) pixels */
+        uint16_t y;         /*!< Top edge of the region, in output (scaled) pixels */
+        uint16_t width;     /*!< Width of the region. If width or height is 0, the whole image is decoded */
+        uint16_t height;    /*!< Height of the region */
+    } roi;                  /*!< Region of interest. Only MCUs overlapping it are decoded, and the crop is written packed
+                                 to outbuf (width * height pixels). MCUs outside it have only their Huffman codes read */
+
+    struct {
+        esp_jpeg_read_cb_t read;    /*!< If set, the JPEG is pulled from this callback while it is decoded, and
+                                         indata/indata_size are not used. Only the working buffer holds compressed data */
+        void *arg;                  /*!< Passed to read */
+    } stream;               /*!< Streaming input, e.g. from a socket or a file */
 } esp_jpeg_image_cfg_t;
 
 /**
@@ -73,14 +107,18 @@ typedef struct esp_jpeg_image_output_s {
  * @brief Decode JPEG image
  *
  * @note This function is blocking.
+ * @note With cfg->stream.read set, the image size is only known once the headers are read:
+ *       outbuf must be large enough for the largest expected image (or region).
  *
  * @param[in]  cfg: Configuration structure
  * @param[out] img: Output image info
  *
  * @return
- *      - ESP_OK            on success
- *      - ESP_ERR_NO_MEM    if there is no memory for allocating main structure
- *      - ESP_FAIL          if there is an error in decoding JPEG
+ *      - ESP_OK                on success
+ *      - ESP_ERR_NO_MEM        if there is no memory for allocating main structure
+ *      - ESP_ERR_NOT_SUPPORTED if the output format is not supported by this build
+ *      - ESP_ERR_INVALID_ARG   if the region of interest is not inside the output image
+ *      - ESP_FAIL              if there is an error in decoding JPEG, or the stream ends early
  */
 esp_err_t esp_jpeg_decode(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img);
 
@@ -89,14 +127,16 @@ esp_err_t esp_jpeg_decode(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *im
  *
  * Use this function to get the size of the JPEG image without decoding it.
  * Allocate a buffer of size img->output_len to store the decoded image.
+ * If cfg->roi is set, the size is that of the region.
  *
  * @note cfg->outbuf and cfg->outbuf_size are not used in this function.
+ * @note Needs cfg->indata; a stream cannot be rewound after its headers are read.
  * @param[in]  cfg: Configuration structure
  * @param[out] img: Output image info
  *
  * @return
  *      - ESP_OK              on success
- *      - ESP_ERR_INVALID_ARG if cfg or img is NULL
+ *      - ESP_ERR_INVALID_ARG if cfg or img is NULL, cfg->indata is not set, or the region of interest is not inside the image
  *      - ESP_FAIL            if there is an error in decoding JPEG
  */
 esp_err_t esp_jpeg_get_image_info(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img);
@@ -0,0 +1,557 @@
+/*
+ * SPDX-FileCopyrightText: 2015-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_system.h"
+#include "esp_rom_caps.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_check.h"
+#include "jpeg_decoder.h"
+
+#if CONFIG_JD_USE_ROM
+/* When supported in ROM, use ROM functions */
+#if defined(ESP_ROM_HAS_JPEG_DECODE)
+#include "rom/tjpgd.h"
+#else
+#error Using JPEG decoder from ROM is not supported for selected target. Please select external code in menuconfig.
+#endif
+
+/* The ROM code of TJPGD is older and has different return type in decode callback */
+typedef unsigned int jpeg_decode_out_t;
+#else
+/* When Tiny JPG Decoder is not in ROM or selected external code */
+#include "tjpgd.h"
+
+/* The TJPGD outside the ROM code is newer and has different return type in decode callback */
+typedef int jpeg_decode_out_t;
+#endif
+
+static const char *TAG = "JPEG";
+
+#define LOBYTE(u16)     ((uint8_t)(((uint16_t)(u16)) & 0xff))
+#define HIBYTE(u16)     ((uint8_t)((((uint16_t)(u16))>>8) & 0xff))
+
+#if defined(JD_FASTDECODE) && (JD_FASTDECODE == 2)
+#define JPEG_WORK_BUF_SIZE  65472
+#else
+#define JPEG_WORK_BUF_SIZE  3100    /* Recommended buffer size; Independent on the size of the image */
+#endif
+
+/* If not set JD_FORMAT, it is set in ROM to RGB888, otherwise, it can be set in config */
+#ifndef JD_FORMAT
+#define JD_FORMAT 0
+#endif
+
+/* Output color bytes from tjpgd (depends on JD_FORMAT) */
+#if (JD_FORMAT==0)
+#define ESP_JPEG_COLOR_BYTES    3
+#elif  (JD_FORMAT==1)
+#define ESP_JPEG_COLOR_BYTES    2
+#elif  (JD_FORMAT==2)
+#define ESP_JPEG_COLOR_BYTES    1
+#endif
+
+/* The ROM TJPGD cannot switch to grayscale at run time; GRAY8 is then converted from its RGB output */
+#if CONFIG_JD_USE_ROM
+#define ESP_JPEG_RUNTIME_GRAY   0
+#else
+#define ESP_JPEG_RUNTIME_GRAY   1
+#endif
+
+/* TJPGD can read the entropy-coded data in place from indata, instead of copying it in JD_SZBUF chunks.
+   Not with the ROM code, nor with JD_FASTDECODE 0, which writes to its input buffer. */
+#if !CONFIG_JD_USE_ROM && (JD_FASTDECODE >= 1)
+#define ESP_JPEG_ZERO_COPY      1
+#else
+#define ESP_JPEG_ZERO_COPY      0
+#endif
+
+/* Converts one row of `pixels` TJPGD output pixels into the output format */
+typedef void (*jpeg_out_row_fn_t)(uint8_t *dst, const uint8_t *in, uint32_t pixels);
+
+/* Per-decode state, passed to TJPGD as its device pointer */
+typedef struct {
+    esp_jpeg_image_cfg_t *cfg;
+    jpeg_out_row_fn_t out_row;  /* Chosen once per decode from format and swap flag */
+    bool out_copy;              /* TJPGD output is already in the output format */
+    bool gray;                  /* TJPGD decodes luma only */
+    uint8_t in_color_bytes;     /* Bytes per pixel from TJPGD */
+    uint8_t *outbuf;
+    uint32_t out_stride;        /* Bytes per output line */
+    uint8_t out_color_bytes;
+    JRECT roi;                  /* Output region, in output pixels; outbuf holds only this */
+    bool roi_done;              /* Output stopped below the region */
+} jpeg_decode_ctx_t;
+
+/*******************************************************************************
+* Function definitions
+*******************************************************************************/
+static uint8_t jpeg_get_div_by_scale(esp_jpeg_image_scale_t scale);
+static uint8_t jpeg_get_color_bytes(esp_jpeg_image_format_t format);
+static bool jpeg_select_output(jpeg_decode_ctx_t *ctx, esp_jpeg_image_format_t format, bool swap);
+static esp_err_t jpeg_get_roi(const esp_jpeg_image_cfg_t *cfg, uint16_t width, uint16_t height, JRECT *roi);
+
+static unsigned int jpeg_decode_in_cb(JDEC *jd, uint8_t *buff, unsigned int nbyte);
+static unsigned int jpeg_decode_stream_cb(JDEC *jd, uint8_t *buff, unsigned int nbyte);
+#if ESP_JPEG_ZERO_COPY
+static size_t jpeg_decode_in_ptr_cb(JDEC *jd, uint8_t **ptr);
+#endif
+static jpeg_decode_out_t jpeg_decode_out_cb(JDEC *jd, void *bitmap, JRECT *rect);
+static inline uint16_t ldb_word(const void *ptr);
+/*******************************************************************************
+* Public API functions
+*******************************************************************************/
+
+esp_err_t esp_jpeg_decode(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img)
+{
+    esp_err_t ret = ESP_OK;
+    uint8_t *workbuf = NULL;
+    JRESULT res;
+    JDEC JDEC;
+
+    assert(cfg != NULL);
+    assert(img != NULL);
+
+    jpeg_decode_ctx_t ctx = {
+        .cfg = cfg,
+        .outbuf = cfg->outbuf,
+        .out_color_bytes = jpeg_get_color_bytes(cfg->out_format),
+    };
+    ESP_RETURN_ON_FALSE(jpeg_select_output(&ctx, cfg->out_format, cfg->flags.swap_color_bytes),
+                        ESP_ERR_NOT_SUPPORTED, TAG, "Selected output format is not supported!");
+
+    const bool allocate_buffer = (cfg->advanced.working_buffer == NULL);
+    const size_t workbuf_size = allocate_buffer ? JPEG_WORK_BUF_SIZE : cfg->advanced.working_buffer_size;
+    if (allocate_buffer) {
+        workbuf = heap_caps_malloc(JPEG_WORK_BUF_SIZE, MALLOC_CAP_DEFAULT);
+        ESP_GOTO_ON_FALSE(workbuf, ESP_ERR_NO_MEM, err, TAG, "no mem for JPEG work buffer");
+    } else {
+        workbuf = cfg->advanced.working_buffer;
+        ESP_RETURN_ON_FALSE(workbuf_size != 0, ESP_ERR_INVALID_ARG, TAG, "Working buffer size not defined!");
+    }
+
+
+    cfg->priv.read = 0;
+
+    /* Prepare image */
+    const bool stream = (cfg->stream.read != NULL);
+    res = jd_prepare(&JDEC, stream ? jpeg_decode_stream_cb : jpeg_decode_in_cb, workbuf, workbuf_size, &ctx);
+    ESP_GOTO_ON_FALSE((res == JDR_OK), ESP_FAIL, err, TAG, "Error in preparing JPEG image! %d", res);
+#if ESP_JPEG_RUNTIME_GRAY
+    JDEC.gray = ctx.gray;
+#endif
+#if ESP_JPEG_ZERO_COPY
+    if (!stream) {
+        JDEC.inptr = jpeg_decode_in_ptr_cb;
+    }
+#endif
+
+    const uint8_t scale_div       = jpeg_get_div_by_scale(cfg->out_scale);
+    const uint8_t out_color_bytes = jpeg_get_color_bytes(cfg->out_format);
+    ESP_GOTO_ON_ERROR(jpeg_get_roi(cfg, JDEC.width / scale_div, JDEC.height / scale_div, &ctx.roi), err, TAG,
+                      "Region of interest is outside the image!");
+
+    /* Size of output image (the region of interest) */
+    img->height = ctx.roi.bottom - ctx.roi.top + 1;
+    img->width = ctx.roi.right - ctx.roi.left + 1;
+    const uint32_t outsize = img->height * img->width * out_color_bytes;
+    ESP_GOTO_ON_FALSE((outsize <= cfg->outbuf_size), ESP_ERR_NO_MEM, err, TAG, "Not enough size in output buffer!");
+    img->output_len = outsize;
+    ctx.out_stride = img->width * out_color_bytes;
+
+#if !CONFIG_JD_USE_ROM
+    /* Let TJPGD skip the MCUs outside the region; the ROM code decodes them and the output callback drops them */
+    JRECT roi_in = {
+        .left = ctx.roi.left * scale_div,
+        .right = (ctx.roi.right + 1) * scale_div - 1,
+        .top = ctx.roi.top * scale_div,
+        .bottom = (ctx.roi.bottom + 1) * scale_div - 1,
+    };
+    if (cfg->roi.width && cfg->roi.height) {
+        JDEC.roi = &roi_in;
+    }
+#endif
+
+    /* Decode JPEG */
+    res = jd_decomp(&JDEC, jpeg_decode_out_cb, cfg->out_scale);
+    ESP_GOTO_ON_FALSE((res == JDR_OK || (res == JDR_INTR && ctx.roi_done)), ESP_FAIL, err, TAG,
+                      "Error in decoding JPEG image! %d", res);
+
+err:
+    if (workbuf && allocate_buffer) {
+        free(workbuf);
+    }
+
+    return ret;
+}
+
+esp_err_t esp_jpeg_get_image_info(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img)
+{
+    if (cfg == NULL || img == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    } else if (cfg->indata == NULL || cfg->indata_size < 5) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = ESP_FAIL;
+
+    if (ldb_word(cfg->indata) != 0xFFD8) {
+        return ESP_FAIL;    /* Err: SOI is not detected */
+    }
+    unsigned ofs = 2; // Start after SOI marker
+
+    while (true) {
+        /* Get a JPEG marker */
+        uint8_t *seg = cfg->indata + ofs;       /* Segment pointer */
+        unsigned short marker = ldb_word(seg);  /* Marker */
+        unsigned int len = ldb_word(seg + 2);   /* Length field */
+        if (len <= 2 || (marker >> 8) != 0xFF) {
+            return ESP_FAIL;
+        }
+        ofs += 2 + len; /* Number of bytes loaded */
+        if (ofs > cfg->indata_size) {
+            return ESP_FAIL; // No more data
+        }
+
+        if ((marker & 0xFF) == 0xC0) {  /* SOF0 (baseline JPEG) */
+            seg += 4; /* Skip marker and length field */
+
+            /* Size of output image */
+            const uint8_t scale_div       = jpeg_get_div_by_scale(cfg->out_scale);
+            const uint8_t out_color_bytes = jpeg_get_color_bytes(cfg->out_format);
+            JRECT roi;
+            if (jpeg_get_roi(cfg, ldb_word(seg + 3) / scale_div, ldb_word(seg + 1) / scale_div, &roi) != ESP_OK) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            img->height = roi.bottom - roi.top + 1;
+            img->width = roi.right - roi.left + 1;
+            img->output_len = img->height * img->width * out_color_bytes;
+            ret = ESP_OK;
+            break;
+        }
+    }
+    return ret;
+}
+
+/*******************************************************************************
+* Private API functions
+*******************************************************************************/
+
+static unsigned int jpeg_decode_in_cb(JDEC *dec, uint8_t *buff, unsigned int nbyte)
+{
+    assert(dec != NULL);
+
+    uint32_t to_read = nbyte;
+    esp_jpeg_image_cfg_t *cfg = ((jpeg_decode_ctx_t *)dec->device)->cfg;
+    assert(cfg != NULL);
+
+    if (buff) {
+        if (cfg->priv.read + to_read > cfg->indata_size) {
+            to_read = cfg->indata_size - cfg->priv.read;
+        }
+
+        /* Copy data from JPEG image */
+        memcpy(buff, &cfg->indata[cfg->priv.read], to_read);
+        cfg->priv.read += to_read;
+    } else if (buff == NULL) {
+        /* Skip data */
+        cfg->priv.read += to_read;
+    }
+
+    return to_read;
+}
+
+/* Pulls from cfg->stream.read until nbyte bytes arrive: TJPGD takes a short read of a header as an error */
+static unsigned int jpeg_decode_stream_cb(JDEC *dec, uint8_t *buff, unsigned int nbyte)
+{
+    assert(dec != NULL);
+
+    esp_jpeg_image_cfg_t *cfg = ((jpeg_decode_ctx_t *)dec->device)->cfg;
+    assert(cfg != NULL);
+
+    uint8_t skip[64];   /* Sink for skipped segments */
+    unsigned int done = 0;
+    while (done < nbyte) {
+        const size_t left = nbyte - done;
+        const size_t n = buff ? cfg->stream.read(cfg->stream.arg, buff + done, left)
+                         : cfg->stream.read(cfg->stream.arg, skip, left < sizeof(skip) ? left : sizeof(skip));
+        if (n == 0) {
+            break;  /* End of stream or error */
+        }
+        done += n;
+    }
+    cfg->priv.read += done;
+
+    return done;
+}
+
+#if ESP_JPEG_ZERO_COPY
+/* Hands TJPGD the rest of indata in place, so the compressed data is never copied */
+static size_t jpeg_decode_in_ptr_cb(JDEC *dec, uint8_t **ptr)
+{
+    assert(dec != NULL);
+
+    esp_jpeg_image_cfg_t *cfg = ((jpeg_decode_ctx_t *)dec->device)->cfg;
+    assert(cfg != NULL);
+
+    const size_t left = cfg->priv.read < cfg->indata_size ? cfg->indata_size - cfg->priv.read : 0;
+    *ptr = &cfg->indata[cfg->priv.read];
+    cfg->priv.read += left;
+    return left;
+}
+#endif
+
+/*******************************************************************************
+* Output row converters
+*******************************************************************************/
+
+/* Output format is the same as set in TJPGD */
+static void jpeg_out_row_copy(uint8_t *dst, const uint8_t *in, uint32_t pixels)
+{
+    memcpy(dst, in, pixels * ESP_JPEG_COLOR_BYTES);
+}
+
+#if ESP_JPEG_RUNTIME_GRAY
+/* TJPGD decoded luma only */
+static void jpeg_out_row_gray8(uint8_t *dst, const uint8_t *in, uint32_t pixels)
+{
+    memcpy(dst, in, pixels);
+}
+#endif
+
+#if (JD_FORMAT==0)
+static inline uint16_t jpeg_rgb888_to_rgb565(const uint8_t *in)
+{
+    return ((in[0] & 0xF8) << 8) | ((in[1] & 0xFC) << 3) | (in[2] >> 3);
+}
+
+/* RGB888 with first and last bytes swapped (BGR) */
+static void jpeg_out_row_rgb888_swap(uint8_t *dst, const uint8_t *in, uint32_t pixels)
+{
+    for (; pixels > 0; pixels--) {
+        dst[0] = in[2];
+        dst[1] = in[1];
+        dst[2] = in[0];
+        dst += 3;
+        in += 3;
+    }
+}
+
+/* RGB565 from RGB888, word stores; outbuf is 16-bit aligned */
+static void jpeg_out_row_rgb565(uint8_t *dst, const uint8_t *in, uint32_t pixels)
+{
+    uint16_t *out = (uint16_t *)dst;
+    for (; pixels > 0; pixels--) {
+        *out++ = jpeg_rgb888_to_rgb565(in);
+        in += 3;
+    }
+}
+
+static void jpeg_out_row_rgb565_swap(uint8_t *dst, const uint8_t *in, uint32_t pixels)
+{
+    uint16_t *out = (uint16_t *)dst;
+    for (; pixels > 0; pixels--) {
+        *out++ = __builtin_bswap16(jpeg_rgb888_to_rgb565(in));
+        in += 3;
+    }
+}
+
+/* Same as above for an output buffer at an odd address */
+static void jpeg_out_row_rgb565_unaligned(uint8_t *dst, const uint8_t *in, uint32_t pixels)
+{
+    for (; pixels > 0; pixels--) {
+        const uint16_t color = jpeg_rgb888_to_rgb565(in);
+        dst[0] = LOBYTE(color);
+        dst[1] = HIBYTE(color);
+        dst += 2;
+        in += 3;
+    }
+}
+
+static void jpeg_out_row_rgb565_swap_unaligned(uint8_t *dst, const uint8_t *in, uint32_t pixels)
+{
+    for (; pixels > 0; pixels--) {
+        const uint16_t color = jpeg_rgb888_to_rgb565(in);
+        dst[0] = HIBYTE(color);
+        dst[1] = LOBYTE(color);
+        dst += 2;
+        in += 3;
+    }
+}
+
+#if !ESP_JPEG_RUNTIME_GRAY
+/* Luma from RGB888 (BT.601 weights), for TJPGD that always outputs color */
+static void jpeg_out_row_rgb888_to_gray8(uint8_t *dst, const uint8_t *in, uint32_t pixels)
+{
+    for (; pixels > 0; pixels--) {
+        *dst++ = (77 * in[0] + 150 * in[1] + 29 * in[2]) >> 8;
+        in += 3;
+    }
+}
+#endif
+#elif (JD_FORMAT==1)
+/* RGB565 with its two bytes swapped */
+static void jpeg_out_row_rgb565_swap(uint8_t *dst, const uint8_t *in, uint32_t pixels)
+{
+    for (; pixels > 0; pixels--) {
+        dst[0] = in[1];
+        dst[1] = in[0];
+        dst += 2;
+        in += 2;
+    }
+}
+#endif
+
+/* Picks the row converter for the output format; false if TJPGD output cannot be converted to it */
+static bool jpeg_select_output(jpeg_decode_ctx_t *ctx, esp_jpeg_image_format_t format, bool swap)
+{
+    ctx->in_color_bytes = ESP_JPEG_COLOR_BYTES;
+    ctx->out_row = NULL;
+
+    if (format == JPEG_IMAGE_FORMAT_GRAY8) {
+#if ESP_JPEG_RUNTIME_GRAY
+        ctx->gray = true;
+        ctx->in_color_bytes = 1;
+        ctx->out_row = jpeg_out_row_gray8;
+#elif (JD_FORMAT==0)
+        ctx->out_row = jpeg_out_row_rgb888_to_gray8;
+#endif
+        ctx->out_copy = (ctx->in_color_bytes == 1);
+        return ctx->out_row != NULL;
+    }
+
+#if (JD_FORMAT==0)
+    const bool aligned = ((uintptr_t)ctx->outbuf & 1) == 0;
+    switch (format) {
+    case JPEG_IMAGE_FORMAT_RGB888:
+        ctx->out_row = swap ? jpeg_out_row_rgb888_swap : jpeg_out_row_copy;
+        break;
+    case JPEG_IMAGE_FORMAT_RGB565:
+        if (aligned) {
+            ctx->out_row = swap ? jpeg_out_row_rgb565_swap : jpeg_out_row_rgb565;
+        } else {
+            ctx->out_row = swap ? jpeg_out_row_rgb565_swap_unaligned : jpeg_out_row_rgb565_unaligned;
+        }
+        break;
+    default:
+        break;
+    }
+#elif (JD_FORMAT==1)
+    if (format == JPEG_IMAGE_FORMAT_RGB565) {
+        ctx->out_row = swap ? jpeg_out_row_rgb565_swap : jpeg_out_row_copy;
+    }
+#endif
+    ctx->out_copy = (ctx->out_row == jpeg_out_row_copy);
+    return ctx->out_row != NULL;
+}
+
+static jpeg_decode_out_t jpeg_decode_out_cb(JDEC *dec, void *bitmap, JRECT *rect)
+{
+    assert(dec != NULL);
+    assert(bitmap != NULL);
+    assert(rect != NULL);
+
+    jpeg_decode_ctx_t *ctx = (jpeg_decode_ctx_t *)dec->device;
+    const JRECT *roi = &ctx->roi;
+
+    if (rect->top > roi->bottom) {
+        /* Below the region: stop decoding, TJPGD returns JDR_INTR */
+        ctx->roi_done = true;
+        return 0;
+    }
+    if (rect->bottom < roi->top || rect->right < roi->left || rect->left > roi->right) {
+        return 1;
+    }
+
+    /* Part of the rectangle inside the region */
+    const uint16_t left = rect->left > roi->left ? rect->left : roi->left;
+    const uint16_t right = rect->right < roi->right ? rect->right : roi->right;
+    const uint16_t top = rect->top > roi->top ? rect->top : roi->top;
+    const uint16_t bottom = rect->bottom < roi->bottom ? rect->bottom : roi->bottom;
+
+    const uint32_t pixels = right - left + 1;
+    const uint32_t in_stride = (rect->right - rect->left + 1) * ctx->in_color_bytes;
+    const uint8_t *in = (const uint8_t *)bitmap + (top - rect->top) * in_stride + (left - rect->left) * ctx->in_color_bytes;
+    uint8_t *dst = ctx->outbuf + (top - roi->top) * ctx->out_stride + (left - roi->left) * ctx->out_color_bytes;
+    int rows = bottom - top + 1;
+
+    /* Same format, rectangle not clipped and as wide as the output: one copy for the whole block */
+    if (ctx->out_copy && pixels * ctx->in_color_bytes == in_stride && in_stride == ctx->out_stride) {
+        memcpy(dst, in, in_stride * rows);
+        return 1;
+    }
+    for (; rows > 0; rows--) {
+        ctx->out_row(dst, in, pixels);
+        in += in_stride;
+        dst += ctx->out_stride;
+    }
+
+    return 1;
+}
+
+/* Region of interest in output pixels, the whole image if cfg->roi is not set */
+static esp_err_t jpeg_get_roi(const esp_jpeg_image_cfg_t *cfg, uint16_t width, uint16_t height, JRECT *roi)
+{
+    if (!cfg->roi.width || !cfg->roi.height) {
+        roi->left = 0;
+        roi->top = 0;
+        roi->right = width - 1;
+        roi->bottom = height - 1;
+        return ESP_OK;
+    }
+    if ((uint32_t)cfg->roi.x + cfg->roi.width > width || (uint32_t)cfg->roi.y + cfg->roi.height > height) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    roi->left = cfg->roi.x;
+    roi->top = cfg->roi.y;
+    roi->right = cfg->roi.x + cfg->roi.width - 1;
+    roi->bottom = cfg->roi.y + cfg->roi.height - 1;
+    return ESP_OK;
+}
+
+static uint8_t jpeg_get_div_by_scale(esp_jpeg_image_scale_t scale)
+{
+    switch (scale) {
+    /* Not scaled */
+    case JPEG_IMAGE_SCALE_0:
+        return 1;
+    /* Scaled 1:2 */
+    case JPEG_IMAGE_SCALE_1_2:
+        return 2;
+    /* Scaled 1:4 */
+    case JPEG_IMAGE_SCALE_1_4:
+        return 4;
+    /* Scaled 1:8 */
+    case JPEG_IMAGE_SCALE_1_8:
+        return 8;
+    }
+
+    return 1;
+}
+
+static uint8_t jpeg_get_color_bytes(esp_jpeg_image_format_t format)
+{
+    switch (format) {
+    /* RGB888 (24-bit/pix) */
+    case JPEG_IMAGE_FORMAT_RGB888:
+        return 3;
+    /* RGB565 (16-bit/pix) */
+    case JPEG_IMAGE_FORMAT_RGB565:
+        return 2;
+    /* Grayscale (8-bit/pix) */
+    case JPEG_IMAGE_FORMAT_GRAY8:
+        return 1;
+    }
+
+    return 1;
+}
+
+static inline uint16_t ldb_word(const void *ptr)
+{
+    const uint8_t *p = (const uint8_t *)ptr;
+    return ((uint16_t)p[0] << 8) | p[1];
+}
@@ -0,0 +1,899 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "sdkconfig.h"
+#include "unity.h"
+
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/stream_buffer.h"
+#include "esp_timer.h"
+#include "jpeg_decoder.h"
+#include "test_logo_jpg.h"
+#include "test_logo_rgb888.h"
+#include "test_usb_camera_2_jpg.h"
+#include "test_usb_camera_2_rgb888.h"
+
+#define TESTW 46
+#define TESTH 46
+
+void esp_jpeg_print_ascii(unsigned char *rgb888, esp_jpeg_image_output_t *outimg)
+{
+    char aapix[] = " .:;+=xX$$";
+    unsigned char *p = rgb888 + 2;
+
+    for (int y = 0; y < outimg->width; y++) {
+        for (int x = 0; x < outimg->height; x++) {
+            int v = ((*p) * (sizeof(aapix) - 2) * 2) / 256;
+            printf("%c%c", aapix[v / 2], aapix[(v + 1) / 2]);
+            p += 3;
+        }
+        printf("%c%c", ' ', '\n');
+    }
+}
+
+TEST_CASE("Test JPEG decompression library", "[esp_jpeg]")
+{
+    unsigned char *decoded, *p;
+    const unsigned char *o;
+    int decoded_outsize = TESTW * TESTH * 3;
+
+    decoded = malloc(decoded_outsize);
+    for (int x = 0; x < decoded_outsize; x += 2) {
+        decoded[x] = 0;
+        decoded[x + 1] = 0xff;
+    }
+
+    /* JPEG decode */
+    esp_jpeg_image_cfg_t jpeg_cfg = {
+        .indata = (uint8_t *)logo_jpg,
+        .indata_size = logo_jpg_len,
+        .outbuf = decoded,
+        .outbuf_size = decoded_outsize,
+        .out_format = JPEG_IMAGE_FORMAT_RGB888,
+        .out_scale = JPEG_IMAGE_SCALE_0,
+        .flags = {
+            .swap_color_bytes = 0,
+        }
+    };
+    esp_jpeg_image_output_t outimg;
+    esp_err_t err = esp_jpeg_decode(&jpeg_cfg, &outimg);
+    TEST_ASSERT_EQUAL(err, ESP_OK);
+
+    /* Decoded image size */
+    TEST_ASSERT_EQUAL(outimg.width, TESTW);
+    TEST_ASSERT_EQUAL(outimg.height, TESTH);
+
+    p = decoded;
+    o = logo_rgb888;
+    for (int x = 0; x < outimg.width * outimg.height; x++) {
+        /* The color can be +- 2 */
+        TEST_ASSERT_UINT8_WITHIN(2, o[0], p[0]);
+        TEST_ASSERT_UINT8_WITHIN(2, o[1], p[1]);
+        TEST_ASSERT_UINT8_WITHIN(2, o[2], p[2]);
+
+        p += 3;
+        o += 3;
+    }
+
+    esp_jpeg_print_ascii(decoded, &outimg);
+
+    free(decoded);
+}
+
+/**
+ * @brief JPEG unknown size test
+ *
+ * This test case verifies the functionality of the JPEG decompression library
+ * when decoding an image with unknown size. The image is decoded from a
+ * JPEG file, and the output size is determined dynamically. The test checks
+ * that the decoded image dimensions match the expected values and that the
+ * pixel data is within an acceptable tolerance range.
+ */
+TEST_CASE("Test JPEG unknown size", "[esp_jpeg]")
+{
+    unsigned char *decoded, *p;
+    const unsigned char *o;
+
+    /* JPEG decode */
+    esp_jpeg_image_cfg_t jpeg_cfg = {
+        .indata = (uint8_t *)logo_jpg,
+        .indata_size = logo_jpg_len,
+        .out_format = JPEG_IMAGE_FORMAT_RGB888,
+    };
+
+    // 1. Get required output size
+    esp_jpeg_image_output_t outimg;
+    esp_err_t err = esp_jpeg_get_image_info(&jpeg_cfg, &outimg);
+    TEST_ASSERT_EQUAL(err, ESP_OK);
+    TEST_ASSERT_EQUAL(TESTW * TESTH * 3, outimg.output_len);
+    TEST_ASSERT_EQUAL(outimg.width, TESTW);
+    TEST_ASSERT_EQUAL(outimg.height, TESTH);
+
+    // 2. Allocate output buffer and assign it to the config
+    decoded = malloc(outimg.output_len);
+    TEST_ASSERT_NOT_NULL(decoded);
+    jpeg_cfg.outbuf = decoded;
+    jpeg_cfg.outbuf_size = outimg.output_len;
+
+    // 3. Decode the image
+    err = esp_jpeg_decode(&jpeg_cfg, &outimg);
+    TEST_ASSERT_EQUAL(err, ESP_OK);
+
+    /* Decoded image size */
+    TEST_ASSERT_EQUAL(TESTW * TESTH * 3, outimg.output_len);
+    TEST_ASSERT_EQUAL(outimg.width, TESTW);
+    TEST_ASSERT_EQUAL(outimg.height, TESTH);
+
+    p = decoded;
+    o = logo_rgb888;
+    for (int x = 0; x < outimg.width * outimg.height; x++) {
+        /* The color can be +- 2 */
+        TEST_ASSERT_UINT8_WITHIN(2, o[0], p[0]);
+        TEST_ASSERT_UINT8_WITHIN(2, o[1], p[1]);
+        TEST_ASSERT_UINT8_WITHIN(2, o[2], p[2]);
+
+        p += 3;
+        o += 3;
+    }
+    free(decoded);
+}
+
+#define WORKING_BUFFER_SIZE 4096
+TEST_CASE("Test JPEG decompression library: User defined working buffer", "[esp_jpeg]")
+{
+    unsigned char *decoded, *p;
+    const unsigned char *o;
+    int decoded_outsize = TESTW * TESTH * 3;
+
+    decoded = malloc(decoded_outsize);
+    uint8_t *working_buf = malloc(WORKING_BUFFER_SIZE);
+    assert(decoded);
+    assert(working_buf);
+
+    for (int x = 0; x < decoded_outsize; x += 2) {
+        decoded[x] = 0;
+        decoded[x + 1] = 0xff;
+    }
+
+    /* JPEG decode */
+    esp_jpeg_image_cfg_t jpeg_cfg = {
+        .indata = (uint8_t *)logo_jpg,
+        .indata_size = logo_jpg_len,
+        .outbuf = decoded,
+        .outbuf_size = decoded_outsize,
+        .out_format = JPEG_IMAGE_FORMAT_RGB888,
+        .out_scale = JPEG_IMAGE_SCALE_0,
+        .flags = {
+            .swap_color_bytes = 0,
+        },
+        .advanced = {
+            .working_buffer = working_buf,
+            .working_buffer_size = WORKING_BUFFER_SIZE,
+        },
+    };
+    esp_jpeg_image_output_t outimg;
+    esp_err_t err = esp_jpeg_decode(&jpeg_cfg, &outimg);
+    TEST_ASSERT_EQUAL(err, ESP_OK);
+
+    /* Decoded image size */
+    TEST_ASSERT_EQUAL(outimg.width, TESTW);
+    TEST_ASSERT_EQUAL(outimg.height, TESTH);
+
+    p = decoded;
+    o = logo_rgb888;
+    for (int x = 0; x < outimg.width * outimg.height; x++) {
+        /* The color can be +- 2 */
+        TEST_ASSERT_UINT8_WITHIN(2, o[0], p[0]);
+        TEST_ASSERT_UINT8_WITHIN(2, o[1], p[1]);
+        TEST_ASSERT_UINT8_WITHIN(2, o[2], p[2]);
+
+        p += 3;
+        o += 3;
+    }
+    free(working_buf);
+    free(decoded);
+}
+
+#if CONFIG_JD_DEFAULT_HUFFMAN
+#include "test_usb_camera_jpg.h"
+#include "test_usb_camera_rgb888.h"
+
+/**
+ * @brief Test for JPEG decompression without Huffman tables
+ *
+ * This test case verifies the functionality of the JPEG decompression library
+ * when decoding an image that lacks Huffman tables, such as a USB frame
+ * from a Logitech C270 USB camera. The image was reconstructed from raw USB data
+ * (using `hex_to_jpg.py`) and then converted into an RGB888 C-style array
+ * (using `jpg_to_rgb888_hex.py`).
+ *
+ * Due to the unique structure of the JPEG data (double block size, 16x8 pixels)
+ * and absence of Huffman tables, this test assesses whether the decompression
+ * library correctly decodes the image and outputs RGB888 pixel data within
+ * an acceptable tolerance range.
+ *
+ * The test performs the following steps:
+ * - Allocates a buffer for the decoded image.
+ * - Configures and runs the JPEG decoder with the RGB888 output format.
+ * - Checks that the decoded image dimensions match expected values.
+ * - Compares the decompressed image data against the reference RGB888 data,
+ *   allowing a tolerance of ±16 in each color component due to potential
+ *   differences in Huffman tables or decompression accuracy.
+ *
+ * @note This test allows a margin of error in pixel values due to potential
+ *       differences in how color data is interpreted across different decoders.
+ *
+ * @param None
+ *
+ * @return None
+ *
+ * @test Requirements:
+ * - JPEG decompression library support for images without Huffman tables.
+ * - JPEG decompression accuracy within acceptable error margins.
+ */
+TEST_CASE("Test JPEG decompression library: No Huffman tables", "[esp_jpeg]")
+{
+    unsigned char *decoded, *p;
+    const unsigned int *o;
+    int decoded_outsize = 160 * 120 * 3;
+
+    decoded = malloc(decoded_outsize);
+
+    /* JPEG decode */
+    esp_jpeg_image_cfg_t jpeg_cfg = {
+        .indata = (uint8_t *)jpeg_no_huffman,
+        .indata_size = jpeg_no_huffman_len,
+        .outbuf = decoded,
+        .outbuf_size = decoded_outsize,
+        .out_format = JPEG_IMAGE_FORMAT_RGB888,
+        .out_scale = JPEG_IMAGE_SCALE_0,
+        .flags = {
+            .swap_color_bytes = 0,
+        }
+    };
+    esp_jpeg_image_output_t outimg;
+    esp_err_t err = esp_jpeg_decode(&jpeg_cfg, &outimg);
+    TEST_ASSERT_EQUAL(err, ESP_OK);
+
+    /* Decoded image size */
+    TEST_ASSERT_EQUAL(outimg.width, 160);
+    TEST_ASSERT_EQUAL(outimg.height, 120);
+
+    p = decoded;
+    o = jpeg_no_huffman_rgb888;
+    for (int x = 0; x < outimg.width * outimg.height; x++) {
+        /* The color can be +- 16 */
+        // Here we allow bigger decoding error
+        // It might be that the Windows decoder used slightly different Huffman tables
+        TEST_ASSERT_UINT8_WITHIN(16, (*o) & 0xff, p[0]);
+        TEST_ASSERT_UINT8_WITHIN(16, (*o >> 8) & 0xff, p[1]);
+        TEST_ASSERT_UINT8_WITHIN(16, (*o >> 16) & 0xff, p[2]);
+
+        p += 3; // this is uint8_t
+        o ++;   // this is unt32_t
+    }
+
+    free(decoded);
+}
+
+#endif
+
+/**
+ * @brief Invalid JPEG marker test
+ *
+ * This test case verifies the behavior of the JPEG decompression library
+ * when encountering an invalid marker (0xFFFF) in the JPEG data stream.
+ * The test uses a known JPEG image (camera_2_jpg) that contains this invalid
+ * marker. The test checks whether the library can handle the invalid marker
+ * gracefully and still decode the image correctly.
+ */
+TEST_CASE("Test JPEG invalid marker 0xFFFF", "[esp_jpeg]")
+{
+    unsigned char *decoded;
+    int decoded_outsize = 160 * 120 * 3;
+
+    decoded = malloc(decoded_outsize);
+    assert(decoded);
+    for (int x = 0; x < decoded_outsize; x += 2) {
+        decoded[x] = 0;
+        decoded[x + 1] = 0xff;
+    }
+
+    /* JPEG decode */
+    esp_jpeg_image_cfg_t jpeg_cfg = {
+        .indata = (uint8_t *)camera_2_jpg,
+        .indata_size = camera_2_jpg_len,
+        .outbuf = decoded,
+        .outbuf_size = decoded_outsize,
+        .out_format = JPEG_IMAGE_FORMAT_RGB888,
+        .out_scale = JPEG_IMAGE_SCALE_0,
+        .flags = {
+            .swap_color_bytes = 0,
+        }
+    };
+    esp_jpeg_image_output_t outimg;
+    esp_err_t err = esp_jpeg_decode(&jpeg_cfg, &outimg);
+    TEST_ASSERT_EQUAL(ESP_OK, err);
+
+    /* Decoded image size */
+    TEST_ASSERT_EQUAL(160, outimg.width);
+    TEST_ASSERT_EQUAL(120, outimg.height);
+
+    free(decoded);
+}
+
+
+/**
+ * @brief Grayscale output test
+ *
+ * Decodes camera_2_jpg as RGB888 and as GRAY8 at every scale. The gray image
+ * must match the luma of the RGB one within rounding, and its decode time is
+ * printed next to the RGB decode time.
+ */
+TEST_CASE("Test JPEG decompression library: Grayscale output", "[esp_jpeg]")
+{
+    const int w = 160, h = 120, runs = 10;
+    uint8_t *rgb = malloc(w * h * 3);
+    uint8_t *gray = malloc(w * h);
+    TEST_ASSERT_NOT_NULL(rgb);
+    TEST_ASSERT_NOT_NULL(gray);
+
+    for (int scale = JPEG_IMAGE_SCALE_0; scale <= JPEG_IMAGE_SCALE_1_8; scale++) {
+        esp_jpeg_image_cfg_t jpeg_cfg = {
+            .indata = (uint8_t *)camera_2_jpg,
+            .indata_size = camera_2_jpg_len,
+            .outbuf = rgb,
+            .outbuf_size = w * h * 3,
+            .out_format = JPEG_IMAGE_FORMAT_RGB888,
+            .out_scale = scale,
+        };
+        esp_jpeg_image_output_t rgb_img, gray_img;
+        int64_t start = esp_timer_get_time();
+        for (int i = 0; i < runs; i++) {
+            TEST_ASSERT_EQUAL(ESP_OK, esp_jpeg_decode(&jpeg_cfg, &rgb_img));
+        }
+        const int64_t rgb_us = (esp_timer_get_time() - start) / runs;
+
+        jpeg_cfg.outbuf = gray;
+        jpeg_cfg.outbuf_size = w * h;
+        jpeg_cfg.out_format = JPEG_IMAGE_FORMAT_GRAY8;
+        TEST_ASSERT_EQUAL(ESP_OK, esp_jpeg_get_image_info(&jpeg_cfg, &gray_img));
+        TEST_ASSERT_EQUAL((w >> scale) * (h >> scale), gray_img.output_len);
+        start = esp_timer_get_time();
+        for (int i = 0; i < runs; i++) {
+            TEST_ASSERT_EQUAL(ESP_OK, esp_jpeg_decode(&jpeg_cfg, &gray_img));
+        }
+        const int64_t gray_us = (esp_timer_get_time() - start) / runs;
+
+        TEST_ASSERT_EQUAL(rgb_img.width, gray_img.width);
+        TEST_ASSERT_EQUAL(rgb_img.height, gray_img.height);
+        TEST_ASSERT_EQUAL(gray_img.width * gray_img.height, gray_img.output_len);
+        /* Luma of a color clipped in RGB conversion is lower than Y, so allow a few outliers */
+        int off = 0;
+        for (int i = 0; i < gray_img.width * gray_img.height; i++) {
+            const uint8_t *p = rgb + i * 3;
+            const int diff = ((77 * p[0] + 150 * p[1] + 29 * p[2]) >> 8) - gray[i];
+            if (diff < -2 || diff > 2) {
+                off++;
+            }
+        }
+        TEST_ASSERT_LESS_THAN(gray_img.output_len / 100, off);
+        printf("1/%d: RGB888 %lld us, GRAY8 %lld us\n", 1 << scale, (long long)rgb_us, (long long)gray_us);
+    }
+
+    free(gray);
+    free(rgb);
+}
+
+/**
+ * @brief Region of interest test
+ *
+ * Decodes an 80x60 region (25% of the image, not MCU aligned) of camera_2_jpg
+ * in each output format and checks it is the same as the crop of a full
+ * decode. The decode times of both are printed. A region outside the image
+ * must be rejected.
+ */
+TEST_CASE("Test JPEG decompression library: Region of interest", "[esp_jpeg]")
+{
+    const int w = 160, h = 120, runs = 10;
+    const int rx = 37, ry = 29, rw = 80, rh = 60;
+    uint8_t *full = malloc(w * h * 3);
+    uint8_t *crop = malloc(rw * rh * 3);
+    TEST_ASSERT_NOT_NULL(full);
+    TEST_ASSERT_NOT_NULL(crop);
+
+    const esp_jpeg_image_format_t formats[] = {
+        JPEG_IMAGE_FORMAT_RGB888, JPEG_IMAGE_FORMAT_RGB565, JPEG_IMAGE_FORMAT_GRAY8
+    };
+    const int bytes[] = { 3, 2, 1 };
+    for (int f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        esp_jpeg_image_cfg_t jpeg_cfg = {
+            .indata = (uint8_t *)camera_2_jpg,
+            .indata_size = camera_2_jpg_len,
+            .outbuf = full,
+            .outbuf_size = w * h * 3,
+            .out_format = formats[f],
+            .out_scale = JPEG_IMAGE_SCALE_0,
+        };
+        esp_jpeg_image_output_t outimg;
+        int64_t start = esp_timer_get_time();
+        for (int i = 0; i < runs; i++) {
+            TEST_ASSERT_EQUAL(ESP_OK, esp_jpeg_decode(&jpeg_cfg, &outimg));
+        }
+        const int64_t full_us = (esp_timer_get_time() - start) / runs;
+
+        jpeg_cfg.outbuf = crop;
+        jpeg_cfg.outbuf_size = rw * rh * bytes[f];
+        jpeg_cfg.roi.x = rx;
+        jpeg_cfg.roi.y = ry;
+        jpeg_cfg.roi.width = rw;
+        jpeg_cfg.roi.height = rh;
+        TEST_ASSERT_EQUAL(ESP_OK, esp_jpeg_get_image_info(&jpeg_cfg, &outimg));
+        TEST_ASSERT_EQUAL(rw * rh * bytes[f], outimg.output_len);
+        start = esp_timer_get_time();
+        for (int i = 0; i < runs; i++) {
+            TEST_ASSERT_EQUAL(ESP_OK, esp_jpeg_decode(&jpeg_cfg, &outimg));
+        }
+        const int64_t roi_us = (esp_timer_get_time() - start) / runs;
+
+        TEST_ASSERT_EQUAL(rw, outimg.width);
+        TEST_ASSERT_EQUAL(rh, outimg.height);
+        TEST_ASSERT_EQUAL(rw * rh * bytes[f], outimg.output_len);
+        for (int y = 0; y < rh; y++) {
+            TEST_ASSERT_EQUAL_HEX8_ARRAY(full + ((ry + y) * w + rx) * bytes[f], crop + y * rw * bytes[f], rw * bytes[f]);
+        }
+        printf("format %d: full %lld us, 25%% region %lld us\n", formats[f], (long long)full_us, (long long)roi_us);
+
+        jpeg_cfg.roi.x = w - rw + 1;
+        TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_jpeg_decode(&jpeg_cfg, &outimg));
+    }
+
+    free(crop);
+    free(full);
+}
+
+/**
+ * @brief Region of interest one MCU wide
+ *
+ * camera_2_jpg has 16x8 MCUs. A 16 pixel wide region at x = 4 has the width
+ * of an MCU but cuts each one it touches. Decodes it in each output format
+ * into a buffer of exactly the region size and checks it is the same as the
+ * crop of a full decode.
+ */
+TEST_CASE("Test JPEG decompression library: Region of interest one MCU wide", "[esp_jpeg]")
+{
+    const int w = 160, h = 120;
+    const int rx = 4, rw = 16;
+    uint8_t *full = malloc(w * h * 3);
+    TEST_ASSERT_NOT_NULL(full);
+
+    const esp_jpeg_image_format_t formats[] = {
+        JPEG_IMAGE_FORMAT_RGB888, JPEG_IMAGE_FORMAT_RGB565, JPEG_IMAGE_FORMAT_GRAY8
+    };
+    const int bytes[] = { 3, 2, 1 };
+    for (int f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        esp_jpeg_image_cfg_t jpeg_cfg = {
+            .indata = (uint8_t *)camera_2_jpg,
+            .indata_size = camera_2_jpg_len,
+            .outbuf = full,
+            .outbuf_size = w * h * 3,
+            .out_format = formats[f],
+            .out_scale = JPEG_IMAGE_SCALE_0,
+        };
+        esp_jpeg_image_output_t outimg;
+        TEST_ASSERT_EQUAL(ESP_OK, esp_jpeg_decode(&jpeg_cfg, &outimg));
+
+        uint8_t *crop = malloc(rw * h * bytes[f]);
+        TEST_ASSERT_NOT_NULL(crop);
+        jpeg_cfg.outbuf = crop;
+        jpeg_cfg.outbuf_size = rw * h * bytes[f];
+        jpeg_cfg.roi.x = rx;
+        jpeg_cfg.roi.y = 0;
+        jpeg_cfg.roi.width = rw;
+        jpeg_cfg.roi.height = h;
+        TEST_ASSERT_EQUAL(ESP_OK, esp_jpeg_decode(&jpeg_cfg, &outimg));
+        TEST_ASSERT_EQUAL(rw, outimg.width);
+        TEST_ASSERT_EQUAL(h, outimg.height);
+        for (int y = 0; y < h; y++) {
+            TEST_ASSERT_EQUAL_HEX8_ARRAY(full + (y * w + rx) * bytes[f], crop + y * rw * bytes[f], rw * bytes[f]);
+        }
+        free(crop);
+    }
+
+    free(full);
+}
+
+/* Throttled pipe: a writer task feeds the JPEG into a stream buffer, a chunk per tick */
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    size_t chunk;
+    StreamBufferHandle_t pipe;
+    volatile bool closed;   /* The writer has sent everything */
+} stream_test_pipe_t;
+
+static void stream_test_writer(void *arg)
+{
+    stream_test_pipe_t *p = arg;
+    for (size_t pos = 0; pos < p->len;) {
+        const size_t n = p->len - pos < p->chunk ? p->len - pos : p->chunk;
+        pos += xStreamBufferSend(p->pipe, p->data + pos, n, portMAX_DELAY);
+        vTaskDelay(1);
+    }
+    p->closed = true;
+    vTaskDelete(NULL);
+}
+
+static size_t stream_test_read(void *arg, uint8_t *buf, size_t len)
+{
+    stream_test_pipe_t *p = arg;
+    while (true) {
+        const size_t n = xStreamBufferReceive(p->pipe, buf, len, pdMS_TO_TICKS(10));
+        if (n > 0) {
+            return n;
+        }
+        if (p->closed && xStreamBufferIsEmpty(p->pipe)) {
+            return 0;
+        }
+    }
+}
+
+/* Decodes jpeg_cfg from the pipe, or only drains it if jpeg_cfg is NULL. Returns the time taken */
+static int64_t stream_test_run(stream_test_pipe_t *p, esp_jpeg_image_cfg_t *jpeg_cfg, esp_jpeg_image_output_t *outimg,
+                               esp_err_t *ret)
+{
+    uint8_t sink[64];
+    p->pipe = xStreamBufferCreate(2 * p->chunk, 1);
+    TEST_ASSERT_NOT_NULL(p->pipe);
+    p->closed = false;
+
+    const int64_t start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(stream_test_writer, "jpeg_writer", 2048, p, uxTaskPriorityGet(NULL), NULL));
+    if (jpeg_cfg) {
+        jpeg_cfg->stream.read = stream_test_read;
+        jpeg_cfg->stream.arg = p;
+        *ret = esp_jpeg_decode(jpeg_cfg, outimg);
+    }
+    /* Whatever the decoder left after EOI, or everything when only draining */
+    while (stream_test_read(p, sink, sizeof(sink)) > 0) {
+    }
+    const int64_t us = esp_timer_get_time() - start;
+
+    vTaskDelay(pdMS_TO_TICKS(10));  /* Let the idle task free the writer */
+    vStreamBufferDelete(p->pipe);
+    return us;
+}
+
+/**
+ * @brief Streaming input
+ *
+ * Decodes each fixture from a throttled pipe (128 bytes per tick) through
+ * cfg->stream and checks the output is byte-identical to a decode from
+ * indata. Prints the time to only transfer the file, to decode it from
+ * memory and to stream-decode it: as decoding overlaps the transfer, the
+ * last should be well under the sum of the first two. A stream cut in half
+ * must fail.
+ */
+TEST_CASE("Test JPEG decompression library: Streaming input", "[esp_jpeg]")
+{
+    const struct {
+        const uint8_t *data;
+        size_t len;
+        const char *name;
+    } fixtures[] = {
+        { logo_jpg, logo_jpg_len, "logo.jpg" },
+        { camera_2_jpg, camera_2_jpg_len, "usb_camera_2.jpg" },
+    };
+
+    for (int f = 0; f < sizeof(fixtures) / sizeof(fixtures[0]); f++) {
+        esp_jpeg_image_cfg_t jpeg_cfg = {
+            .indata = (uint8_t *)fixtures[f].data,
+            .indata_size = fixtures[f].len,
+            .out_format = JPEG_IMAGE_FORMAT_RGB888,
+        };
+        esp_jpeg_image_output_t outimg;
+        TEST_ASSERT_EQUAL(ESP_OK, esp_jpeg_get_image_info(&jpeg_cfg, &outimg));
+        const size_t out_len = outimg.output_len;
+        uint8_t *expected = malloc(out_len);
+        uint8_t *decoded = malloc(out_len);
+        TEST_ASSERT_NOT_NULL(expected);
+        TEST_ASSERT_NOT_NULL(decoded);
+
+        jpeg_cfg.outbuf = expected;
+        jpeg_cfg.outbuf_size = out_len;
+        int64_t start = esp_timer_get_time();
+        TEST_ASSERT_EQUAL(ESP_OK, esp_jpeg_decode(&jpeg_cfg, &outimg));
+        const int64_t decode_us = esp_timer_get_time() - start;
+
+        stream_test_pipe_t pipe = {
+            .data = fixtures[f].data,
+            .len = fixtures[f].len,
+            .chunk = 128,
+        };
+        const int64_t transfer_us = stream_test_run(&pipe, NULL, NULL, NULL);
+
+        /* indata is ignored once stream.read is set */
+        esp_err_t ret;
+        jpeg_cfg.indata = NULL;
+        jpeg_cfg.indata_size = 0;
+        jpeg_cfg.outbuf = decoded;
+        const int64_t stream_us = stream_test_run(&pipe, &jpeg_cfg, &outimg, &ret);
+        TEST_ASSERT_EQUAL(ESP_OK, ret);
+        TEST_ASSERT_EQUAL(out_len, outimg.output_len);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, decoded, out_len);
+        printf("%s (%u bytes): transfer %lld us, decode %lld us, streamed decode %lld us\n", fixtures[f].name,
+               (unsigned)fixtures[f].len, (long long)transfer_us, (long long)decode_us, (long long)stream_us);
+
+        pipe.len = fixtures[f].len / 2;
+        stream_test_run(&pipe, &jpeg_cfg, &outimg, &ret);
+        TEST_ASSERT_EQUAL(ESP_FAIL, ret);
+
+        free(decoded);
+        free(expected);
+    }
+}
+
+#if !CONFIG_JD_USE_ROM
+#include "tjpgd.h"
+
+#define OUTPUT_BENCH_RUNS 20
+
+/* Stand-alone TJPGD decode, so the output stage can be swapped out */
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+    uint8_t *out;
+    esp_jpeg_image_format_t format;
+    bool swap;
+} output_bench_io_t;
+
+static size_t output_bench_in(JDEC *jd, uint8_t *buf, size_t n)
+{
+    output_bench_io_t *io = jd->device;
+    if (n > io->len - io->pos) {
+        n = io->len - io->pos;
+    }
+    if (buf) {
+        memcpy(buf, io->data + io->pos, n);
+    }
+    io->pos += n;
+    return n;
+}
+
+/* The rest of the stream in place, as esp_jpeg_decode reads indata */
+static size_t output_bench_in_ptr(JDEC *jd, uint8_t **ptr)
+{
+    output_bench_io_t *io = jd->device;
+    size_t n = io->len - io->pos;
+    *ptr = (uint8_t *)io->data + io->pos;
+    io->pos = io->len;
+    return n;
+}
+
+/* Decode only, output discarded */
+static int output_bench_out_none(JDEC *jd, void *bitmap, JRECT *rect)
+{
+    return 1;
+}
+
+/* The per-pixel output callback esp_jpeg_decode used to have, for reference */
+static int output_bench_out_per_pixel(JDEC *jd, void *bitmap, JRECT *rect)
+{
+    output_bench_io_t *io = jd->device;
+    uint8_t out_color_bytes = (io->format == JPEG_IMAGE_FORMAT_RGB888) ? 3 : 2;
+    uint8_t *in = bitmap;
+    uint32_t line = jd->width;
+    uint8_t *dst = io->out;
+    uint16_t color;
+    for (int y = rect->top; y <= rect->bottom; y++) {
+        for (int x = rect->left; x <= rect->right; x++) {
+            if (io->format == JPEG_IMAGE_FORMAT_RGB888) {
+                for (int b = 0; b < 3; b++) {
+                    if (io->swap) {
+                        dst[(y * line * out_color_bytes) + x * out_color_bytes + b] = in[out_color_bytes - b - 1];
+                    } else {
+                        dst[(y * line * out_color_bytes) + x * out_color_bytes + b] = in[b];
+                    }
+                }
+            } else {
+                color = ((in[0] & 0xF8) << 8);
+                color |= ((in[1] & 0xFC) << 3);
+                color |= (in[2] >> 3);
+                if (io->swap) {
+                    dst[(y * line * out_color_bytes) + (x * out_color_bytes)] = color >> 8;
+                    dst[(y * line * out_color_bytes) + (x * out_color_bytes) + 1] = color & 0xff;
+                } else {
+                    dst[(y * line * out_color_bytes) + (x * out_color_bytes) + 1] = color >> 8;
+                    dst[(y * line * out_color_bytes) + (x * out_color_bytes)] = color & 0xff;
+                }
+            }
+            in += 3;
+        }
+    }
+    return 1;
+}
+
+static int64_t output_bench_tjpgd(output_bench_io_t *io, uint8_t *workbuf, size_t workbuf_size,
+                                  int (*out)(JDEC *, void *, JRECT *), bool in_place)
+{
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < OUTPUT_BENCH_RUNS; i++) {
+        JDEC jd;
+        io->pos = 0;
+        TEST_ASSERT_EQUAL(JDR_OK, jd_prepare(&jd, output_bench_in, workbuf, workbuf_size, io));
+        if (in_place) {
+            jd.inptr = output_bench_in_ptr;
+        }
+        TEST_ASSERT_EQUAL(JDR_OK, jd_decomp(&jd, out, 0));
+    }
+    return (esp_timer_get_time() - start) / OUTPUT_BENCH_RUNS;
+}
+
+#if CONFIG_JD_DEFAULT_HUFFMAN
+/**
+ * @brief Output stage: equivalence and cost
+ *
+ * Decodes the USB camera frame in every (format, swap) combination through
+ * esp_jpeg_decode and through the old per-pixel callback, checks the outputs
+ * are byte-identical (RGB565 also into an odd address), and prints the share
+ * of decode time spent in the output stage with each.
+ */
+TEST_CASE("Test JPEG output stage: row converters", "[esp_jpeg]")
+{
+    const int w = 160, h = 120;
+    const size_t outsize = w * h * 3;
+    uint8_t *expected = malloc(outsize);
+    uint8_t *decoded = malloc(outsize + 1);
+    uint8_t *workbuf = malloc(WORKING_BUFFER_SIZE);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(decoded);
+    TEST_ASSERT_NOT_NULL(workbuf);
+
+    const struct {
+        esp_jpeg_image_format_t format;
+        bool swap;
+        const char *name;
+    } modes[] = {
+        { JPEG_IMAGE_FORMAT_RGB888, false, "RGB888" },
+        { JPEG_IMAGE_FORMAT_RGB888, true, "RGB888 swap" },
+        { JPEG_IMAGE_FORMAT_RGB565, false, "RGB565" },
+        { JPEG_IMAGE_FORMAT_RGB565, true, "RGB565 swap" },
+    };
+
+    output_bench_io_t io = {
+        .data = jpeg_no_huffman,
+        .len = jpeg_no_huffman_len,
+        .out = expected,
+    };
+    const int64_t none_us = output_bench_tjpgd(&io, workbuf, WORKING_BUFFER_SIZE, output_bench_out_none, false);
+    printf("usb_camera.jpg %dx%d, decode without output: %lld us\n", w, h, (long long)none_us);
+    printf("%-12s %12s %6s %12s %6s\n", "output", "per-pixel", "share", "row", "share");
+
+    for (int m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        io.format = modes[m].format;
+        io.swap = modes[m].swap;
+        const int64_t old_us = output_bench_tjpgd(&io, workbuf, WORKING_BUFFER_SIZE, output_bench_out_per_pixel, false);
+
+        esp_jpeg_image_cfg_t jpeg_cfg = {
+            .indata = (uint8_t *)jpeg_no_huffman,
+            .indata_size = jpeg_no_huffman_len,
+            .outbuf = decoded,
+            .outbuf_size = outsize,
+            .out_format = modes[m].format,
+            .out_scale = JPEG_IMAGE_SCALE_0,
+            .flags = {
+                .swap_color_bytes = modes[m].swap,
+            },
+            .advanced = {
+                .working_buffer = workbuf,
+                .working_buffer_size = WORKING_BUFFER_SIZE,
+            },
+        };
+        esp_jpeg_image_output_t outimg;
+        int64_t start = esp_timer_get_time();
+        for (int i = 0; i < OUTPUT_BENCH_RUNS; i++) {
+            TEST_ASSERT_EQUAL(ESP_OK, esp_jpeg_decode(&jpeg_cfg, &outimg));
+        }
+        const int64_t new_us = (esp_timer_get_time() - start) / OUTPUT_BENCH_RUNS;
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, decoded, outimg.output_len);
+
+        if (modes[m].format == JPEG_IMAGE_FORMAT_RGB565) {
+            /* Byte stores instead of word stores */
+            jpeg_cfg.outbuf = decoded + 1;
+            TEST_ASSERT_EQUAL(ESP_OK, esp_jpeg_decode(&jpeg_cfg, &outimg));
+            TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, decoded + 1, outimg.output_len);
+        }
+
+        printf("%-12s %9lld us %5lld%% %9lld us %5lld%%\n", modes[m].name,
+               (long long)old_us, (long long)((old_us - none_us) * 100 / old_us),
+               (long long)new_us, (long long)((new_us - none_us) * 100 / new_us));
+    }
+
+    free(workbuf);
+    free(decoded);
+    free(expected);
+}
+#endif
+
+/**
+ * @brief Zero-copy input
+ *
+ * esp_jpeg_decode reads the entropy-coded data in place from indata. Decodes
+ * each fixture from a RAM copy and checks the output is byte-identical to a
+ * plain TJPGD decode that copies its input, and that indata is left as it was.
+ * Also prints the decode time with copied and with in-place input.
+ */
+TEST_CASE("Test JPEG zero-copy input", "[esp_jpeg]")
+{
+    const struct {
+        const uint8_t *data;
+        size_t len;
+        const char *name;
+    } fixtures[] = {
+        { logo_jpg, logo_jpg_len, "logo.jpg" },
+        { camera_2_jpg, camera_2_jpg_len, "usb_camera_2.jpg" },
+#if CONFIG_JD_DEFAULT_HUFFMAN
+        { jpeg_no_huffman, jpeg_no_huffman_len, "usb_camera.jpg" },
+#endif
+    };
+    uint8_t *workbuf = malloc(WORKING_BUFFER_SIZE);
+    TEST_ASSERT_NOT_NULL(workbuf);
+
+    for (int f = 0; f < sizeof(fixtures) / sizeof(fixtures[0]); f++) {
+        uint8_t *jpg = malloc(fixtures[f].len);
+        TEST_ASSERT_NOT_NULL(jpg);
+        memcpy(jpg, fixtures[f].data, fixtures[f].len);
+
+        esp_jpeg_image_cfg_t jpeg_cfg = {
+            .indata = jpg,
+            .indata_size = fixtures[f].len,
+            .out_format = JPEG_IMAGE_FORMAT_RGB888,
+            .advanced = {
+                .working_buffer = workbuf,
+                .working_buffer_size = WORKING_BUFFER_SIZE,
+            },
+        };
+        esp_jpeg_image_output_t outimg;
+        TEST_ASSERT_EQUAL(ESP_OK, esp_jpeg_get_image_info(&jpeg_cfg, &outimg));
+        uint8_t *expected = malloc(outimg.output_len);
+        uint8_t *decoded = malloc(outimg.output_len);
+        TEST_ASSERT_NOT_NULL(expected);
+        TEST_ASSERT_NOT_NULL(decoded);
+
+        output_bench_io_t io = {
+            .data = jpg,
+            .len = fixtures[f].len,
+            .out = expected,
+            .format = JPEG_IMAGE_FORMAT_RGB888,
+        };
+        output_bench_tjpgd(&io, workbuf, WORKING_BUFFER_SIZE, output_bench_out_per_pixel, false);
+
+        jpeg_cfg.outbuf = decoded;
+        jpeg_cfg.outbuf_size = outimg.output_len;
+        TEST_ASSERT_EQUAL(ESP_OK, esp_jpeg_decode(&jpeg_cfg, &outimg));
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, decoded, outimg.output_len);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(fixtures[f].data, jpg, fixtures[f].len);
+
+#if JD_FASTDECODE >= 1
+        const int64_t copy_us = output_bench_tjpgd(&io, workbuf, WORKING_BUFFER_SIZE, output_bench_out_none, false);
+        const int64_t in_place_us = output_bench_tjpgd(&io, workbuf, WORKING_BUFFER_SIZE, output_bench_out_none, true);
+        printf("%s (%u bytes): copied input %lld us, in place %lld us\n", fixtures[f].name, (unsigned)fixtures[f].len,
+               (long long)copy_us, (long long)in_place_us);
+#endif
+        free(decoded);
+        free(expected);
+        free(jpg);
+    }
+    free(workbuf);
+}
+#endif
@@ -33,6 +33,8 @@
 #define HUFF_MASK   (HUFF_LEN - 1)
 #endif
 
+#define JD_GRAYOUT(jd)  (JD_FORMAT == 2 || (jd)->gray)  /* Output Y component only */
+
 
 /*-----------------------------------------------*/
 /* Zigzag-order to raster-order conversion table */
@@ -374,6 +376,25 @@ static JRESULT create_huffman_tbl ( /* 0:OK, !0:Failed */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Re-fill input buffer                                                  */
+/*-----------------------------------------------------------------------*/
+
+static size_t fill_input (  /* Number of bytes available at *dp, 0: end of stream or error */
+    JDEC *jd,           /* Pointer to the decompressor object */
+    uint8_t **dp        /* Returns the top of the available bytes */
+)
+{
+    if (jd->inptr) {    /* Use the stream bytes in place (JD_FASTDECODE >= 1 never writes to them) */
+        return jd->inptr(jd, dp);
+    }
+    *dp = jd->inbuf;    /* Top of input buffer */
+    return jd->infunc(jd, *dp, JD_SZBUF);
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Extract a huffman decoded data from input stream                      */
 /*-----------------------------------------------------------------------*/
@@ -400,8 +421,7 @@ static int huffext (    /* >=0: decoded data, <0: error code */
     do {
         if (!bm) {      /* Next byte? */
             if (!dc) {  /* No input data is available, re-fill input buffer */
-                dp = jd->inbuf; /* Top of input buffer */
-                dc = jd->infunc(jd, dp, JD_SZBUF);
+                dc = fill_input(jd, &dp);      /* Re-fill input buffer */
                 if (!dc) {
                     return 0 - (int)JDR_INP;    /* Err: read error or wrong stream termination */
                 }
@@ -450,8 +470,7 @@ static int huffext (    /* >=0: decoded data, <0: error code */
             d = 0xFF;   /* Input stream has stalled for a marker. Generate stuff bits */
         } else {
             if (!dc) {  /* Buffer empty, re-fill input buffer */
-                dp = jd->inbuf;                     /* Top of input buffer */
-                dc = jd->infunc(jd, dp, JD_SZBUF);
+                dc = fill_input(jd, &dp);      /* Re-fill input buffer */
                 if (!dc) {
                     return 0 - (int)JDR_INP;    /* Err: read error or wrong stream termination */
                 }
@@ -545,8 +564,7 @@ static int bitext ( /* >=0: extracted data, <0: error code */
     do {
         if (!mbit) {            /* Next byte? */
             if (!dc) {          /* No input data is available, re-fill input buffer */
-                dp = jd->inbuf; /* Top of input buffer */
-                dc = jd->infunc(jd, dp, JD_SZBUF);
+                dc = fill_input(jd, &dp);      /* Re-fill input buffer */
                 if (!dc) {
                     return 0 - (int)JDR_INP;    /* Err: read error or wrong stream termination */
                 }
@@ -588,8 +606,7 @@ static int bitext ( /* >=0: extracted data, <0: error code */
             d = 0xFF;   /* Input stream stalled, generate stuff bits */
         } else {
             if (!dc) {  /* Buffer empty, re-fill input buffer */
-                dp = jd->inbuf; /* Top of input buffer */
-                dc = jd->infunc(jd, dp, JD_SZBUF);
+                dc = fill_input(jd, &dp);      /* Re-fill input buffer */
                 if (!dc) {
                     return 0 - (int)JDR_INP;    /* Err: read error or wrong stream termination */
                 }
@@ -639,8 +656,7 @@ static JRESULT restart (
     /* Get two bytes from the input stream */
     for (i = 0; i < 2; i++) {
         if (!dc) {  /* No input data is available, re-fill input buffer */
-            dp = jd->inbuf;
-            dc = jd->infunc(jd, dp, JD_SZBUF);
+            dc = fill_input(jd, &dp);      /* Re-fill input buffer */
             if (!dc) {
                 return JDR_INP;
             }
@@ -668,8 +684,7 @@ static JRESULT restart (
         marker = 0;
         for (i = 0; i < 2; i++) {   /* Get a restart marker */
             if (!dc) {      /* No input data is available, re-fill input buffer */
-                dp = jd->inbuf;
-                dc = jd->infunc(jd, dp, JD_SZBUF);
+                dc = fill_input(jd, &dp);      /* Re-fill input buffer */
                 if (!dc) {
                     return JDR_INP;
                 }
@@ -823,7 +838,8 @@ static void block_idct (
 /*-----------------------------------------------------------------------*/
 
 static JRESULT mcu_load (
-    JDEC *jd        /* Pointer to the decompressor object */
+    JDEC *jd,       /* Pointer to the decompressor object */
+    int skip        /* Only walk the huffman codes, the MCU is not output */
 )
 {
     int32_t *tmp = (int32_t *)jd->workbuf;  /* Block working buffer for de-quantize and IDCT */
@@ -840,7 +856,9 @@ static JRESULT mcu_load (
         cmp = (blk < nby) ? 0 : blk - nby + 1;  /* Component number 0:Y, 1:Cb, 2:Cr */
 
         if (cmp && jd->ncomp != 3) {        /* Clear C blocks if not exist (monochrome image) */
-            for (i = 0; i < 64; bp[i++] = 128) ;
+            if (!skip) {
+                for (i = 0; i < 64; bp[i++] = 128) ;
+            }
 
         } else {                            /* Load Y/C blocks from input stream */
             id = cmp ? 1 : 0;                       /* Huffman table ID of this component */
@@ -865,10 +883,12 @@ static JRESULT mcu_load (
                 jd->dcv[cmp] = (int16_t)d;          /* Save current DC value for next block */
             }
             dqf = jd->qttbl[jd->qtid[cmp]];         /* De-quantizer table ID for this component */
-            tmp[0] = d * dqf[0] >> 8;               /* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
+            if (!skip) {
+                tmp[0] = d * dqf[0] >> 8;           /* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
+                memset(&tmp[1], 0, 63 * sizeof (int32_t));  /* Initialize all AC elements */
+            }
 
             /* Extract following 63 AC elements from input stream */
-            memset(&tmp[1], 0, 63 * sizeof (int32_t));  /* Initialize all AC elements */
             z = 1;      /* Top of the AC elements (in zigzag-order) */
             do {
                 d = huffext(jd, id, 1);             /* Extract a huffman coded value (zero runs and bit length) */
@@ -892,12 +912,14 @@ static JRESULT mcu_load (
                     if (!(d & bc)) {
                         d -= (bc << 1) - 1;    /* Restore negative value if needed */
                     }
-                    i = Zig[z];                     /* Get raster-order index */
-                    tmp[i] = d * dqf[i] >> 8;       /* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
+                    if (!skip) {
+                        i = Zig[z];                 /* Get raster-order index */
+                        tmp[i] = d * dqf[i] >> 8;   /* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
+                    }
                 }
             } while (++z < 64);     /* Next AC element */
 
-            if (JD_FORMAT != 2 || !cmp) {   /* C components may not be processed if in grayscale output */
+            if (!skip && (!JD_GRAYOUT(jd) || !cmp)) {   /* C components may not be processed if in grayscale output */
                 if (z == 1 || (JD_USE_SCALE && jd->scale == 3)) {   /* If no AC element or scale ratio is 1/8, IDCT can be ommited and the block is filled with DC value */
                     d = (jd_yuv_t)((*tmp / 256) + 128);
                     if (JD_FASTDECODE >= 1) {
@@ -956,7 +978,7 @@ static JRESULT mcu_output (
     if (!JD_USE_SCALE || jd->scale != 3) {  /* Not for 1/8 scaling */
         pix = (uint8_t *)jd->workbuf;
 
-        if (JD_FORMAT != 2) {   /* RGB output (build an RGB MCU from Y/C component) */
+        if (!JD_GRAYOUT(jd)) {  /* RGB output (build an RGB MCU from Y/C component) */
             for (iy = 0; iy < my; iy++) {
                 pc = py = jd->mcubuf;
                 if (my == 16) {     /* Double block height? */
@@ -1002,7 +1024,7 @@ static JRESULT mcu_output (
                             py += 64 - 8;    /* Jump to next block if double block height */
                         }
                     }
-                    *pix++ = (uint8_t) * py++;          /* Get and store a Y value as grayscale */
+                    *pix++ = BYTECLIP(*py++);       /* Get and store a Y value as grayscale (a DC-only block is not clipped yet) */
                 }
             }
         }
@@ -1010,21 +1032,22 @@ static JRESULT mcu_output (
         /* Descale the MCU rectangular if needed */
         if (JD_USE_SCALE && jd->scale) {
             unsigned int x, y, r, g, b, s, w, a;
+            const int rgb = !JD_GRAYOUT(jd);
             uint8_t *op;
 
             /* Get averaged RGB value of each square correcponds to a pixel */
             s = jd->scale * 2;  /* Number of shifts for averaging */
             w = 1 << jd->scale; /* Width of square */
-            a = (mx - w) * (JD_FORMAT != 2 ? 3 : 1);    /* Bytes to skip for next line in the square */
+            a = (mx - w) * (rgb ? 3 : 1);   /* Bytes to skip for next line in the square */
             op = (uint8_t *)jd->workbuf;
             for (iy = 0; iy < my; iy += w) {
                 for (ix = 0; ix < mx; ix += w) {
-                    pix = (uint8_t *)jd->workbuf + (iy * mx + ix) * (JD_FORMAT != 2 ? 3 : 1);
+                    pix = (uint8_t *)jd->workbuf + (iy * mx + ix) * (rgb ? 3 : 1);
                     r = g = b = 0;
                     for (y = 0; y < w; y++) {   /* Accumulate RGB value in the square */
                         for (x = 0; x < w; x++) {
                             r += *pix++;    /* Accumulate R or Y (monochrome output) */
-                            if (JD_FORMAT != 2) {   /* RGB output? */
+                            if (rgb) {  /* RGB output? */
                                 g += *pix++;    /* Accumulate G */
                                 b += *pix++;    /* Accumulate B */
                             }
@@ -1032,7 +1055,7 @@ static JRESULT mcu_output (
                         pix += a;
                     }                           /* Put the averaged pixel value */
                     *op++ = (uint8_t)(r >> s);  /* Put R or Y (monochrome output) */
-                    if (JD_FORMAT != 2) {   /* RGB output? */
+                    if (rgb) {  /* RGB output? */
                         *op++ = (uint8_t)(g >> s);  /* Put G */
                         *op++ = (uint8_t)(b >> s);  /* Put B */
                     }
@@ -1055,12 +1078,12 @@ static JRESULT mcu_output (
             for (ix = 0; ix < mx; ix += 8) {
                 yy = *py;   /* Get Y component */
                 py += 64;
-                if (JD_FORMAT != 2) {
+                if (!JD_GRAYOUT(jd)) {
                     *pix++ = /*R*/ BYTECLIP(yy + ((int)(1.402 * CVACC) * cr / CVACC));
                     *pix++ = /*G*/ BYTECLIP(yy - ((int)(0.344 * CVACC) * cb + (int)(0.714 * CVACC) * cr) / CVACC);
                     *pix++ = /*B*/ BYTECLIP(yy + ((int)(1.772 * CVACC) * cb / CVACC));
                 } else {
-                    *pix++ = yy;
+                    *pix++ = BYTECLIP(yy);
                 }
             }
         }
@@ -1071,22 +1094,23 @@ static JRESULT mcu_output (
     if (rx < mx) {  /* Is the MCU spans rigit edge? */
         uint8_t *s, *d;
         unsigned int x, y;
+        const int rgb = !JD_GRAYOUT(jd);
 
         s = d = (uint8_t *)jd->workbuf;
         for (y = 0; y < ry; y++) {
             for (x = 0; x < rx; x++) {  /* Copy effective pixels */
                 *d++ = *s++;
-                if (JD_FORMAT != 2) {
+                if (rgb) {
                     *d++ = *s++;
                     *d++ = *s++;
                 }
             }
-            s += (mx - rx) * (JD_FORMAT != 2 ? 3 : 1);  /* Skip truncated pixels */
+            s += (mx - rx) * (rgb ? 3 : 1); /* Skip truncated pixels */
         }
     }
 
     /* Convert RGB888 to RGB565 if needed */
-    if (JD_FORMAT == 1) {
+    if (JD_FORMAT == 1 && !jd->gray) {
         uint8_t *s = (uint8_t *)jd->workbuf;
         uint16_t w, *d = (uint16_t *)s;
         unsigned int n = rx * ry;
@@ -1355,6 +1379,7 @@ JRESULT jd_decomp (
     unsigned int x, y, mx, my;
     uint16_t rst, rsc;
     JRESULT rc;
+    int skip;
 
 
     if (scale > (JD_USE_SCALE ? 3 : 0)) {
@@ -1369,6 +1394,9 @@ JRESULT jd_decomp (
 
     rc = JDR_OK;
     for (y = 0; y < jd->height; y += my) {      /* Vertical loop of MCUs */
+        if (jd->roi && y > jd->roi->bottom) {
+            break;    /* Nothing below the region of interest is needed */
+        }
         for (x = 0; x < jd->width; x += mx) {   /* Horizontal loop of MCUs */
             if (jd->nrst && rst++ == jd->nrst) {    /* Process restart interval if enabled */
                 rc = restart(jd, rsc++);
@@ -1377,10 +1405,14 @@ JRESULT jd_decomp (
                 }
                 rst = 1;
             }
-            rc = mcu_load(jd);                  /* Load an MCU (decompress huffman coded stream, dequantize and apply IDCT) */
+            skip = jd->roi && (x > jd->roi->right || x + mx <= jd->roi->left || y + my <= jd->roi->top);
+            rc = mcu_load(jd, skip);            /* Load an MCU (decompress huffman coded stream, dequantize and apply IDCT) */
             if (rc != JDR_OK) {
                 return rc;
             }
+            if (skip) {
+                continue;    /* Outside the region of interest: the huffman codes are consumed, nothing else */
+            }
             rc = mcu_output(jd, outfunc, x, y); /* Output the MCU (YCbCr to RGB, scaling and output) */
             if (rc != JDR_OK) {
                 return rc;
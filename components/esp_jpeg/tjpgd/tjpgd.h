@@ -64,6 +64,8 @@ struct JDEC {
     uint8_t msx, msy;           /* MCU size in unit of block (width, height) */
     uint8_t qtid[3];            /* Quantization table ID of each component, Y, Cb, Cr */
     uint8_t ncomp;              /* Number of color components 1:grayscale, 3:color */
+    uint8_t gray;               /* Grayscale output regardless of JD_FORMAT (set between jd_prepare and jd_decomp) */
+    const JRECT *roi;           /* Decode only MCUs overlapping this rectangle of the input image (NULL: all; set like gray) */
     int16_t dcv[3];             /* Previous DC element of each component */
     uint16_t nrst;              /* Restart inverval */
     uint16_t width, height;     /* Size of the input image (pixel) */
@@ -85,6 +87,7 @@ struct JDEC {
     void *pool;                 /* Pointer to available memory pool */
     size_t sz_pool;             /* Size of momory pool (bytes available) */
     size_t (*infunc)(JDEC *, uint8_t *, size_t); /* Pointer to jpeg stream input function */
+    size_t (*inptr)(JDEC *, uint8_t **);        /* Zero-copy input: points at the next stream bytes in place, returns their count (NULL: infunc; set like gray, JD_FASTDECODE >= 1 only) */
     void *device;               /* Pointer to I/O device identifiler for the session */
 };
 
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "boot_timeline.h"
+#include "json_util.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "BOOT";
+
+// /debug/boot buffer: 64-bit times at their widest, a 24-character stage
+// name and a full task name come to about 140 bytes per stage
+#define BOOT_JSON_HEAD      96
+#define BOOT_JSON_PER_STAGE 160
+
+typedef struct {
+    const char *stage;
+    int64_t t_us;
+    char task[configMAX_TASK_NAME_LEN];     // copied: boot tasks delete themselves
+    int core;
+} boot_mark_t;
+
+static boot_mark_t s_marks[BOOT_TIMELINE_MAX_STAGES];
+static int s_count = 0;
+static int s_overflow = 0;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void boot_mark(const char *stage) {
+    boot_mark_t m = {
+        .stage = stage,
+        .t_us = esp_timer_get_time(),
+        .core = xPortGetCoreID(),
+    };
+    snprintf(m.task, sizeof(m.task), "%s", pcTaskGetName(NULL));
+    taskENTER_CRITICAL(&s_lock);
+    if (s_count < BOOT_TIMELINE_MAX_STAGES) {
+        s_marks[s_count++] = m;
+    } else {
+        s_overflow++;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    ESP_LOGI(TAG, "%-24s %7lld ms  (%s, core %d)", stage, m.t_us / 1000, m.task, m.core);
+}
+
+// Copies the table so callers never format while holding the spinlock
+static int snapshot(boot_mark_t *out) {
+    taskENTER_CRITICAL(&s_lock);
+    int n = s_count;
+    for (int i = 0; i < n; i++) out[i] = s_marks[i];
+    taskEXIT_CRITICAL(&s_lock);
+    return n;
+}
+
+void boot_timeline_dump(void) {
+    boot_mark_t marks[BOOT_TIMELINE_MAX_STAGES];
+    int n = snapshot(marks);
+    ESP_LOGI(TAG, "---- boot timeline, %d stages ----", n);
+    for (int i = 0; i < n; i++) {
+        int64_t delta = marks[i].t_us - (i ? marks[i - 1].t_us : 0);
+        ESP_LOGI(TAG, "%7lld ms  +%6lld ms  %-24s %s/%d", marks[i].t_us / 1000, delta / 1000,
+                 marks[i].stage, marks[i].task, marks[i].core);
+    }
+    if (s_overflow) ESP_LOGW(TAG, "%d marks did not fit", s_overflow);
+}
+
+esp_err_t boot_timeline_handler(httpd_req_t *req) {
+    boot_mark_t marks[BOOT_TIMELINE_MAX_STAGES];
+    int n = snapshot(marks);
+    const size_t cap = BOOT_JSON_HEAD + n * BOOT_JSON_PER_STAGE;
+    char *json = malloc(cap);
+    if (!json) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    size_t off = 0;
+    bool ok = json_append(json, cap, &off, "{\"now_us\":%lld,\"dropped\":%d,\"stages\":[",
+                          esp_timer_get_time(), s_overflow);
+    for (int i = 0; i < n && ok; i++) {
+        int64_t delta = marks[i].t_us - (i ? marks[i - 1].t_us : 0);
+        ok = json_append(json, cap, &off,
+                         "%s{\"stage\":\"%s\",\"t_us\":%lld,\"delta_us\":%lld,\"task\":\"%s\",\"core\":%d}",
+                         i ? "," : "", marks[i].stage, marks[i].t_us, delta, marks[i].task, marks[i].core);
+    }
+    ok = ok && json_append(json, cap, &off, "]}");
+    if (!ok) {
+        ESP_LOGE(TAG, "/debug/boot does not fit in %u bytes", (unsigned)cap);
+        free(json);
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t res = httpd_resp_sendstr(req, json);
+    free(json);
+    return res;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+// ==== Boot timeline ====
+// A fixed table of named, timestamped startup stages. Marks are cheap (a
+// spinlock and a few stores), can come from any task, and keep working
+// after boot, so late stages such as the first frame sent still land in it.
+// Times are esp_timer microseconds, so the first mark also shows what ran
+// before app_main (ROM and second-stage bootloader excluded), which
+// includes the PSRAM memtest when CONFIG_SPIRAM_MEMTEST is on.
+
+#define BOOT_TIMELINE_MAX_STAGES 32
+
+// Records `stage` (a string literal; only the pointer is kept) now.
+void boot_mark(const char *stage);
+
+// Logs the timeline with per-stage deltas.
+void boot_timeline_dump(void);
+
+// GET /debug/boot: the timeline as JSON.
+esp_err_t boot_timeline_handler(httpd_req_t *req);
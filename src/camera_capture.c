@@ -0,0 +1,427 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include "camera_capture.h"
+#include "esp_camera.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "driver/ledc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "CAMERA";
+
+// ==== Freenove ESP32-S3 WROOM Camera Pins ====
+#define CAM_PIN_SIOD  4
+#define CAM_PIN_SIOC  5
+#define CAM_PIN_VSYNC 6
+#define CAM_PIN_HREF  7
+#define CAM_PIN_PCLK  13
+#define CAM_PIN_XCLK  15
+#define CAM_PIN_D7    16
+#define CAM_PIN_D6    17
+#define CAM_PIN_D5    18
+#define CAM_PIN_D4    12
+#define CAM_PIN_D3    10
+#define CAM_PIN_D2    8
+#define CAM_PIN_D1    9
+#define CAM_PIN_D0    11
+
+// ==== Camera Config ====
+static camera_config_t camera_config = {
+    .pin_pwdn  = -1,
+    .pin_reset = -1,
+    .pin_xclk = CAM_PIN_XCLK,
+    .pin_sccb_sda = CAM_PIN_SIOD,
+    .pin_sccb_scl = CAM_PIN_SIOC,
+    .pin_d7 = CAM_PIN_D7,
+    .pin_d6 = CAM_PIN_D6,
+    .pin_d5 = CAM_PIN_D5,
+    .pin_d4 = CAM_PIN_D4,
+    .pin_d3 = CAM_PIN_D3,
+    .pin_d2 = CAM_PIN_D2,
+    .pin_d1 = CAM_PIN_D1,
+    .pin_d0 = CAM_PIN_D0,
+    .pin_vsync = CAM_PIN_VSYNC,
+    .pin_href  = CAM_PIN_HREF,
+    .pin_pclk  = CAM_PIN_PCLK,
+    .xclk_freq_hz = 20000000,
+    .ledc_timer   = LEDC_TIMER_0,
+    .ledc_channel = LEDC_CHANNEL_0,
+    .pixel_format = PIXFORMAT_JPEG,
+    .frame_size   = FRAMESIZE_QVGA,
+    .jpeg_quality = 12,
+    .fb_count     = 1,
+    .fb_location  = CAMERA_FB_IN_DRAM,
+    .grab_mode    = CAMERA_GRAB_WHEN_EMPTY,
+};
+
+static int s_fb_count = 0;
+
+// Runtime adaptation; s_adapt_lock guards both controllers and their
+// switches. A controller that is switched off sees no frames, and its state
+// holds the value pinned through /control, which is what the sensor uses.
+static quality_ctrl_t s_quality;
+static framesize_ctrl_t s_framesize;
+static SemaphoreHandle_t s_adapt_lock = NULL;
+static bool s_auto_quality = true;
+static bool s_auto_size = true;
+
+// Resolution levels for the frame size manager, smallest first
+static const struct {
+    framesize_t size;
+    const char *name;
+} s_levels[] = {
+    { FRAMESIZE_QQVGA, "QQVGA" },
+    { FRAMESIZE_QVGA,  "QVGA" },
+    { FRAMESIZE_VGA,   "VGA" },
+};
+#define LEVEL_COUNT (sizeof(s_levels) / sizeof(s_levels[0]))
+#define LEVEL_START 1   // QVGA
+
+static int level_of(framesize_t size) {
+    int level = 0;
+    for (int i = 0; i < (int)LEVEL_COUNT; i++) {
+        if (s_levels[i].size <= size) level = i;
+    }
+    return level;
+}
+
+// ==== Camera init helpers ====
+// frame_size sizes the driver's buffers and is the largest the frame size
+// manager may switch to later; streaming starts at QVGA or below.
+static esp_err_t try_camera_init(framesize_t frame_size, int fb_count, camera_fb_location_t location) {
+    camera_config.frame_size  = frame_size;
+    camera_config.fb_count    = fb_count;
+    camera_config.fb_location = location;
+    // GRAB_LATEST needs a spare buffer for the driver to keep filling
+    camera_config.grab_mode   = fb_count > 1 ? CAMERA_GRAB_LATEST : CAMERA_GRAB_WHEN_EMPTY;
+    ESP_LOGI(TAG, "Init camera, frame_size=%d, fb_count=%d in %s", frame_size, fb_count,
+             location == CAMERA_FB_IN_PSRAM ? "PSRAM" : "DRAM");
+    esp_err_t err = esp_camera_init(&camera_config);
+    if (err == ESP_OK) {
+        int max_level = level_of(frame_size);
+        int level = LEVEL_START < max_level ? LEVEL_START : max_level;
+        sensor_t *s = esp_camera_sensor_get();
+        if (s) {
+            ESP_LOGI(TAG, "Camera detected, PID=0x%04x", s->id.PID);
+            s->set_vflip(s, 1);
+            s->set_hmirror(s, 0);
+            if (s_levels[level].size != frame_size) s->set_framesize(s, s_levels[level].size);
+        }
+        s_fb_count = fb_count;
+        framesize_ctrl_init(&s_framesize, level, max_level);
+        quality_ctrl_config_t qcfg = {
+            .target_kbps = QUALITY_TARGET_KBPS,
+            .min_quality = CAMERA_QUALITY_MIN,
+            .max_quality = CAMERA_QUALITY_MAX,
+            .initial_quality = camera_config.jpeg_quality,
+        };
+        quality_ctrl_init(&s_quality, &qcfg);
+        if (!s_adapt_lock) s_adapt_lock = xSemaphoreCreateMutex();
+        return ESP_OK;
+    }
+    ESP_LOGE(TAG, "Camera init failed: 0x%x", err);
+    return err;
+}
+
+esp_err_t camera_init_safe(void) {
+    int ring = CAMERA_FB_COUNT;
+    if (ring < CAMERA_FB_COUNT_MIN) ring = CAMERA_FB_COUNT_MIN;
+    if (ring > CAMERA_FB_COUNT_MAX) ring = CAMERA_FB_COUNT_MAX;
+
+    if (heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0 &&
+        try_camera_init(FRAMESIZE_VGA, ring, CAMERA_FB_IN_PSRAM) == ESP_OK) return ESP_OK;
+    if (try_camera_init(FRAMESIZE_QVGA, 1, CAMERA_FB_IN_DRAM) == ESP_OK) return ESP_OK;
+    if (try_camera_init(FRAMESIZE_QQVGA, 1, CAMERA_FB_IN_DRAM) == ESP_OK) return ESP_OK;
+    ESP_LOGE(TAG, "All camera init attempts failed!");
+    return ESP_FAIL;
+}
+
+void camera_warm_up(int frames) {
+    for (int i = 0; i < frames; i++) {
+        camera_fb_t *fb = esp_camera_fb_get();
+        if (!fb) {
+            ESP_LOGW(TAG, "No frame during warm-up");
+            return;
+        }
+        esp_camera_fb_return(fb);
+    }
+}
+
+int camera_fb_count(void) {
+    return s_fb_count;
+}
+
+// ==== Camera frame source for the broadcaster ====
+static camera_fb_t *camera_source_get(void *ctx) {
+    return esp_camera_fb_get();
+}
+
+static void camera_source_put(void *ctx, camera_fb_t *fb) {
+    esp_camera_fb_return(fb);
+}
+
+// ==== Idle suspend ====
+// OV2640 COM2 (sensor bank, hence 0x100) bit 4: standby. Registers and
+// auto exposure state survive it, so capture picks up where it stopped.
+#define OV2640_REG_COM2     0x109
+#define OV2640_COM2_STDBY   0x10
+#define CAMERA_STANDBY_EXIT_MS 2    // sensor settle time after clearing standby
+
+static esp_err_t camera_source_suspend(void *ctx) {
+    sensor_t *s = esp_camera_sensor_get();
+    // Standby goes over SCCB, which wants the clock running
+    if (s && s->id.PID == OV2640_PID) s->set_reg(s, OV2640_REG_COM2, OV2640_COM2_STDBY, OV2640_COM2_STDBY);
+    // No XCLK, no pixel clock: the sensor stops and the DMA has nothing to move
+    return ledc_timer_pause(LEDC_LOW_SPEED_MODE, camera_config.ledc_timer);
+}
+
+static esp_err_t camera_source_resume(void *ctx) {
+    esp_err_t err = ledc_timer_resume(LEDC_LOW_SPEED_MODE, camera_config.ledc_timer);
+    if (err != ESP_OK) return err;
+    sensor_t *s = esp_camera_sensor_get();
+    if (s && s->id.PID == OV2640_PID) {
+        s->set_reg(s, OV2640_REG_COM2, OV2640_COM2_STDBY, 0);
+        vTaskDelay(pdMS_TO_TICKS(CAMERA_STANDBY_EXIT_MS));
+    }
+    return ESP_OK;
+}
+
+void camera_frame_source(frame_source_t *out) {
+    out->get = camera_source_get;
+    out->put = camera_source_put;
+    out->suspend = camera_source_suspend;
+    out->resume = camera_source_resume;
+    out->ctx = NULL;
+}
+
+void camera_broadcaster_config(broadcaster_config_t *out) {
+    out->core = CAPTURE_TASK_CORE;
+    // A single buffer cannot trade an old frame for a newer one, so skipping
+    // would only cut the frame rate
+    out->max_age_ms = s_fb_count > 1 ? CAPTURE_MAX_AGE_MS : 0;
+    out->idle_suspend_ms = CAMERA_IDLE_SUSPEND_S * 1000;
+}
+
+// ==== Runtime adaptation ====
+static bool apply_quality(int quality, const quality_ctrl_stats_t *st) {
+    sensor_t *s = esp_camera_sensor_get();
+    if (s && s->set_quality(s, quality) == 0) {
+        ESP_LOGI(TAG, "JPEG quality %d: sent %" PRIu32 " kbit/s, budget %" PRIu32 " kbit/s, %" PRIu32 " B/frame",
+                 quality, st->sent_kbps, st->effective_kbps, st->avg_frame_bytes);
+        return true;
+    }
+    ESP_LOGW(TAG, "Failed to set JPEG quality %d", quality);
+    return false;
+}
+
+// ==== Live sensor changes ====
+// Reads the frame size from the JPEG's SOF header rather than fb->width, so
+// the check does not depend on when the driver updates its descriptor.
+static bool jpeg_dimensions(const uint8_t *buf, size_t len, int *width, int *height) {
+    size_t i = 2;
+    while (i + 9 < len && buf[i] == 0xFF) {
+        uint8_t marker = buf[i + 1];
+        size_t seg = (buf[i + 2] << 8) | buf[i + 3];
+        if (marker == 0xC0 || marker == 0xC1 || marker == 0xC2) {
+            *height = (buf[i + 5] << 8) | buf[i + 6];
+            *width  = (buf[i + 7] << 8) | buf[i + 8];
+            return true;
+        }
+        i += 2 + seg;
+    }
+    return false;
+}
+
+typedef struct {
+    camera_control_id_t id;
+    int value;
+} sensor_change_t;
+
+// Runs on the capture task, between two frames
+static esp_err_t sensor_apply(void *arg) {
+    const sensor_change_t *c = (const sensor_change_t *)arg;
+    sensor_t *s = esp_camera_sensor_get();
+    if (!s) return ESP_ERR_INVALID_STATE;
+    int res;
+    switch (c->id) {
+        case CAMERA_CTRL_FRAMESIZE:  res = s->set_framesize(s, s_levels[c->value].size); break;
+        case CAMERA_CTRL_QUALITY:    res = s->set_quality(s, c->value); break;
+        case CAMERA_CTRL_VFLIP:      res = s->set_vflip(s, c->value); break;
+        case CAMERA_CTRL_HMIRROR:    res = s->set_hmirror(s, c->value); break;
+        case CAMERA_CTRL_BRIGHTNESS: res = s->set_brightness(s, c->value); break;
+        case CAMERA_CTRL_CONTRAST:   res = s->set_contrast(s, c->value); break;
+        case CAMERA_CTRL_SATURATION: res = s->set_saturation(s, c->value); break;
+        default: return ESP_ERR_NOT_SUPPORTED;
+    }
+    return res == 0 ? ESP_OK : ESP_FAIL;
+}
+
+// After a size change the ring can still hold frames of the old size
+static bool frame_matches_size(const camera_fb_t *fb, void *arg) {
+    const sensor_change_t *c = (const sensor_change_t *)arg;
+    if (c->id != CAMERA_CTRL_FRAMESIZE) return true;
+    int w, h;
+    framesize_t size = s_levels[c->value].size;
+    if (!jpeg_dimensions(fb->buf, fb->len, &w, &h)) return true;
+    return w == resolution[size].width && h == resolution[size].height;
+}
+
+static esp_err_t sensor_change(camera_control_id_t id, int value, reconfig_result_t *out) {
+    sensor_change_t c = { .id = id, .value = value };
+    return broadcaster_reconfigure(sensor_apply, frame_matches_size, &c, out);
+}
+
+// The buffers were sized for the largest level at init, so switching is a
+// sensor register change, not an esp_camera_deinit()/init cycle.
+static bool apply_level(int level, float late_ratio) {
+    reconfig_result_t r;
+    if (sensor_change(CAMERA_CTRL_FRAMESIZE, level, &r) == ESP_OK) {
+        ESP_LOGI(TAG, "Frame size %s, %.0f%% of frames late, stalled %" PRIu32 " ms",
+                 s_levels[level].name, late_ratio * 100, r.stall_us / 1000);
+        return true;
+    }
+    ESP_LOGW(TAG, "Failed to set frame size %s", s_levels[level].name);
+    return false;
+}
+
+void camera_report_frame(size_t jpeg_bytes, int64_t send_us, bool late) {
+    if (!s_adapt_lock) return;
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(s_adapt_lock, portMAX_DELAY);
+    int old_quality = s_quality.quality;
+    int old_level = s_framesize.level;
+    bool quality_changed = false;
+    bool level_changed = false;
+    if (s_auto_quality) {
+        quality_ctrl_add_frame(&s_quality, jpeg_bytes, send_us, now);
+        quality_changed = quality_ctrl_update(&s_quality, now);
+    }
+    quality_ctrl_stats_t st;
+    quality_ctrl_get_stats(&s_quality, &st);
+    if (s_auto_size) {
+        framesize_ctrl_add_frame(&s_framesize, late, now);
+        level_changed = framesize_ctrl_update(&s_framesize, &st, CAMERA_QUALITY_MAX, now);
+    }
+    int level = s_framesize.level;
+    float late_ratio = s_framesize.late_ratio;
+#if CAMERA_TRACE_FRAMES
+    // Under the lock, so the lines come out in the order the frames went in
+    ESP_LOGI(TAG, "trace,%" PRId64 ",%u,%" PRId64 ",%d,%d,%d",
+             now, (unsigned)jpeg_bytes, send_us, late, st.quality, level);
+#endif
+    xSemaphoreGive(s_adapt_lock);
+
+    // If the sensor refused, keep reporting what it actually uses
+    bool quality_failed = quality_changed && !apply_quality(st.quality, &st);
+    bool level_failed = level_changed && !apply_level(level, late_ratio);
+    if (quality_failed || level_failed) {
+        xSemaphoreTake(s_adapt_lock, portMAX_DELAY);
+        if (quality_failed && s_quality.quality == st.quality) s_quality.quality = old_quality;
+        if (level_failed && s_framesize.level == level) s_framesize.level = old_level;
+        xSemaphoreGive(s_adapt_lock);
+    }
+}
+
+void camera_quality_get_stats(quality_ctrl_stats_t *out) {
+    if (!s_adapt_lock) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(s_adapt_lock, portMAX_DELAY);
+    quality_ctrl_get_stats(&s_quality, out);
+    xSemaphoreGive(s_adapt_lock);
+}
+
+void camera_framesize_get_stats(camera_framesize_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+    out->name = s_levels[0].name;
+    if (!s_adapt_lock) return;
+    xSemaphoreTake(s_adapt_lock, portMAX_DELAY);
+    out->name = s_levels[s_framesize.level].name;
+    out->max_name = s_levels[s_framesize.max_level].name;
+    out->late_ratio = s_framesize.late_ratio;
+    out->changes = s_framesize.changes;
+    xSemaphoreGive(s_adapt_lock);
+}
+
+// ==== /control ====
+static const struct {
+    const char *var;
+    camera_control_id_t id;
+    int min, max;
+} s_controls[] = {
+    { "framesize",   CAMERA_CTRL_FRAMESIZE,   0, 0 },     // by name, see s_levels
+    { "quality",     CAMERA_CTRL_QUALITY,     CAMERA_QUALITY_MIN, 63 },
+    { "vflip",       CAMERA_CTRL_VFLIP,       0, 1 },
+    { "hmirror",     CAMERA_CTRL_HMIRROR,     0, 1 },
+    { "brightness",  CAMERA_CTRL_BRIGHTNESS, -2, 2 },
+    { "contrast",    CAMERA_CTRL_CONTRAST,   -2, 2 },
+    { "saturation",  CAMERA_CTRL_SATURATION, -2, 2 },
+    { "autoquality", CAMERA_CTRL_AUTOQUALITY, 0, 1 },
+    { "autosize",    CAMERA_CTRL_AUTOSIZE,    0, 1 },
+};
+#define CONTROL_COUNT (sizeof(s_controls) / sizeof(s_controls[0]))
+
+esp_err_t camera_control(const char *var, const char *val, camera_control_result_t *out) {
+    memset(out, 0, sizeof(*out));
+    if (!s_adapt_lock) return ESP_ERR_INVALID_STATE;
+    int c = -1;
+    for (int i = 0; i < (int)CONTROL_COUNT; i++) {
+        if (strcmp(var, s_controls[i].var) == 0) c = i;
+    }
+    if (c < 0) return ESP_ERR_NOT_FOUND;
+    camera_control_id_t id = s_controls[c].id;
+
+    int value = -1;
+    if (id == CAMERA_CTRL_FRAMESIZE) {
+        xSemaphoreTake(s_adapt_lock, portMAX_DELAY);
+        int max_level = s_framesize.max_level;
+        xSemaphoreGive(s_adapt_lock);
+        for (int i = 0; i <= max_level; i++) {
+            if (strcasecmp(val, s_levels[i].name) == 0) value = i;
+        }
+        if (value < 0) return ESP_ERR_INVALID_ARG;
+    } else {
+        char *end;
+        long v = strtol(val, &end, 10);
+        if (end == val || *end || v < s_controls[c].min || v > s_controls[c].max) return ESP_ERR_INVALID_ARG;
+        value = (int)v;
+    }
+    out->var = s_controls[c].var;
+    out->value = value;
+    if (id == CAMERA_CTRL_FRAMESIZE) out->level_name = s_levels[value].name;
+
+    if (id == CAMERA_CTRL_AUTOQUALITY || id == CAMERA_CTRL_AUTOSIZE) {
+        // Switching back on resumes from the pinned value, with a fresh window
+        xSemaphoreTake(s_adapt_lock, portMAX_DELAY);
+        if (id == CAMERA_CTRL_AUTOQUALITY) {
+            if (value && !s_auto_quality) quality_ctrl_set_quality(&s_quality, s_quality.quality);
+            s_auto_quality = value;
+        } else {
+            if (value && !s_auto_size) framesize_ctrl_set_level(&s_framesize, s_framesize.level);
+            s_auto_size = value;
+        }
+        xSemaphoreGive(s_adapt_lock);
+        return ESP_OK;
+    }
+
+    esp_err_t err = sensor_change(id, value, &out->reconfig);
+    if (err != ESP_OK) return err;
+    // A manual size or quality would be undone by its controller a few
+    // seconds later; pin it until autosize=1 / autoquality=1
+    xSemaphoreTake(s_adapt_lock, portMAX_DELAY);
+    if (id == CAMERA_CTRL_FRAMESIZE) {
+        framesize_ctrl_set_level(&s_framesize, value);
+        s_auto_size = false;
+    } else if (id == CAMERA_CTRL_QUALITY) {
+        quality_ctrl_set_quality(&s_quality, value);
+        s_auto_quality = false;
+    }
+    xSemaphoreGive(s_adapt_lock);
+    return ESP_OK;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "esp_err.h"
+#include "frame_broadcaster.h"
+#include "quality_ctrl.h"
+#include "framesize_ctrl.h"
+
+// ==== Frame ring ====
+// Number of driver buffers when PSRAM is present. The driver keeps filling
+// the ring and, with CAMERA_GRAB_LATEST, esp_camera_fb_get() hands back the
+// newest complete frame instead of the oldest queued one. Override with
+// -DCAMERA_FB_COUNT=N in build_flags; clamped to [3, 6].
+#ifndef CAMERA_FB_COUNT
+#define CAMERA_FB_COUNT 4
+#endif
+#define CAMERA_FB_COUNT_MIN 3
+#define CAMERA_FB_COUNT_MAX 6
+
+// Core the capture task is pinned to. Wi-Fi and lwIP run on core 0.
+#ifndef CAPTURE_TASK_CORE
+#define CAPTURE_TASK_CORE 1
+#endif
+
+// Frames older than this when a viewer picks them up are skipped in favour
+// of the next capture (see broadcaster_wait_frame()).
+#ifndef CAPTURE_MAX_AGE_MS
+#define CAPTURE_MAX_AGE_MS 100
+#endif
+
+// Seconds without any subscriber before capture is suspended: XCLK is
+// paused, which stops the sensor and the camera DMA, and an OV2640 is put
+// in standby. The next viewer resumes it in place, no re-init. 0 = never.
+// Motion detection does not count, and only wakes the sensor for single
+// frames when MOTION_IDLE_PERIOD_MS is set.
+#ifndef CAMERA_IDLE_SUSPEND_S
+#define CAMERA_IDLE_SUSPEND_S 30
+#endif
+
+// Uplink budget for all viewers together. The JPEG quality is adjusted at
+// runtime to hold it, within [CAMERA_QUALITY_MIN, CAMERA_QUALITY_MAX];
+// below 10 the driver's auto-sized JPEG buffers can overflow.
+#ifndef QUALITY_TARGET_KBPS
+#define QUALITY_TARGET_KBPS 4000
+#endif
+#define CAMERA_QUALITY_MIN 10
+#define CAMERA_QUALITY_MAX 40
+
+// -DCAMERA_TRACE_FRAMES=1 logs every frame fed to the controllers, and what
+// they decided, as a "trace,t_us,bytes,send_us,late,quality,level" line.
+// Those lines, from boot, are a trace tools/ctrl_replay_test.c can replay.
+// Logging at frame rate slows the stream workers; leave it off otherwise.
+#ifndef CAMERA_TRACE_FRAMES
+#define CAMERA_TRACE_FRAMES 0
+#endif
+
+// Tries the PSRAM ring first (buffers sized for VGA, streaming at QVGA), then
+// a single DRAM buffer at QVGA and QQVGA. The frame size manager can move
+// between QQVGA and the size the buffers were allocated for.
+esp_err_t camera_init_safe(void);
+
+// Frames grabbed and dropped after init so auto exposure and white balance
+// settle before anything is served.
+#define CAMERA_WARMUP_FRAMES 5
+
+void camera_warm_up(int frames);
+
+// Frame source wrapping esp_camera_fb_get()/esp_camera_fb_return().
+void camera_frame_source(frame_source_t *out);
+
+// Capture task settings matching the ring that camera_init_safe() set up.
+void camera_broadcaster_config(broadcaster_config_t *out);
+
+// Buffers in the driver ring, 0 before a successful init.
+int camera_fb_count(void);
+
+typedef enum {
+    CAMERA_CTRL_FRAMESIZE,
+    CAMERA_CTRL_QUALITY,
+    CAMERA_CTRL_VFLIP,
+    CAMERA_CTRL_HMIRROR,
+    CAMERA_CTRL_BRIGHTNESS,
+    CAMERA_CTRL_CONTRAST,
+    CAMERA_CTRL_SATURATION,
+    CAMERA_CTRL_AUTOQUALITY,
+    CAMERA_CTRL_AUTOSIZE,
+} camera_control_id_t;
+
+typedef struct {
+    const char *name;           // current frame size, e.g. "QVGA"
+    const char *max_name;
+    float late_ratio;           // last window
+    uint32_t changes;
+} camera_framesize_stats_t;
+
+// Feeds one sent frame to the quality controller and the frame size
+// manager, which may retune the sensor. `late` is what pacer_wait()
+// returned for it. Safe to call from any stream worker.
+void camera_report_frame(size_t jpeg_bytes, int64_t send_us, bool late);
+
+void camera_quality_get_stats(quality_ctrl_stats_t *out);
+void camera_framesize_get_stats(camera_framesize_stats_t *out);
+
+// What camera_control() applied
+typedef struct {
+    const char *var;            // canonical name of the setting
+    int value;                  // parsed value; the level for framesize
+    const char *level_name;     // framesize only, e.g. "QVGA"; NULL otherwise
+    reconfig_result_t reconfig; // stall; zero for autoquality/autosize
+} camera_control_result_t;
+
+// Applies one setting live, between two captured frames (see
+// broadcaster_reconfigure()). `var` is one of framesize (QQVGA|QVGA|VGA, up
+// to the size the buffers allow), quality, vflip, hmirror, brightness,
+// contrast, saturation, autoquality, autosize. Setting framesize or quality
+// by hand switches its controller off; autoquality=1 / autosize=1 resumes
+// it from the pinned value. Returns ESP_ERR_NOT_FOUND for an unknown var and
+// ESP_ERR_INVALID_ARG for a bad value.
+esp_err_t camera_control(const char *var, const char *val, camera_control_result_t *out);
@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include "control.h"
+#include "camera_capture.h"
+#include "esp_log.h"
+
+static const char *TAG = "CONTROL";
+
+esp_err_t control_handler(httpd_req_t *req) {
+    char query[96];
+    char var[24];
+    char val[16];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "var", var, sizeof(var)) != ESP_OK ||
+        httpd_query_key_value(query, "val", val, sizeof(val)) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected ?var=&val=");
+        return ESP_FAIL;
+    }
+
+    camera_control_result_t r;
+    esp_err_t err = camera_control(var, val, &r);
+    if (err == ESP_ERR_NOT_FOUND) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown var");
+        return ESP_FAIL;
+    }
+    if (err == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad val");
+        return ESP_FAIL;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "%s=%s failed: %s", var, val, esp_err_to_name(err));
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    // Reply with the parsed setting, never the raw query text
+    char val_json[24];
+    if (r.level_name) {
+        snprintf(val_json, sizeof(val_json), "\"%s\"", r.level_name);
+    } else {
+        snprintf(val_json, sizeof(val_json), "%d", r.value);
+    }
+    if (r.reconfig.stall_us > CONTROL_STALL_TARGET_MS * 1000) {
+        ESP_LOGW(TAG, "%s=%s stalled the stream %" PRIu32 " ms, %" PRIu32 " frames discarded",
+                 r.var, val_json, r.reconfig.stall_us / 1000, r.reconfig.discarded);
+    } else {
+        ESP_LOGI(TAG, "%s=%s applied, stall %" PRIu32 " us", r.var, val_json, r.reconfig.stall_us);
+    }
+    char json[128];
+    snprintf(json, sizeof(json), "{\"var\":\"%s\",\"val\":%s,\"stall_us\":%" PRIu32 ",\"discarded\":%" PRIu32 "}",
+             r.var, val_json, r.reconfig.stall_us, r.reconfig.discarded);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, json);
+}
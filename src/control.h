@@ -0,0 +1,12 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+// A reconfiguration that holds the stream longer than this is logged
+#define CONTROL_STALL_TARGET_MS 200
+
+// GET /control?var=<name>&val=<value>: applies one camera setting live and
+// answers with how long the stream stalled, as JSON. See camera_control()
+// for the variables.
+esp_err_t control_handler(httpd_req_t *req);
@@ -0,0 +1,541 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "frame_broadcaster.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "BROADCASTER";
+
+#define CAPTURE_TASK_STACK 4096
+#define CAPTURE_TASK_PRIO  5
+
+struct subscriber {
+    SemaphoreHandle_t wake;     // given whenever the slot is filled
+    frame_t *pending;           // send slot, depth one
+    int64_t pending_since_us;
+    bool pending_primed;        // pending is the retained frame handed over at subscribe
+    bool passive;               // gets frames but does not keep capture running
+    uint32_t delivered;
+    uint32_t dropped;
+    uint64_t residency_total_us;
+    uint32_t residency_max_us;
+    uint32_t stale;
+    uint32_t primed;
+    uint64_t age_total_us;
+    uint32_t age_max_us;
+    subscriber_t *next;
+};
+
+static frame_source_t s_source;
+static SemaphoreHandle_t s_lock;        // guards everything below and frame_t::refs
+static subscriber_t *s_subs = NULL;
+static int s_sub_count = 0;              // active subscribers only
+static frame_t *s_latest = NULL;        // newest frame, one reference held by us
+static uint32_t s_seq = 0;
+static TaskHandle_t s_capture_task = NULL;
+static broadcaster_config_t s_config;
+static uint64_t s_driver_age_total_us = 0;
+static uint32_t s_driver_age_max_us = 0;
+
+// ==== Idle suspend ====
+#define RESUME_TARGET_US (300 * 1000)   // first subscriber to first frame, logged above this
+
+static bool s_suspended = false;        // written by the capture task only, under s_lock
+static uint32_t s_suspends = 0;
+static int64_t s_wake_us = 0;           // when a subscriber arrived to a suspended source
+static uint32_t s_resume_last_us = 0;
+static uint32_t s_resume_max_us = 0;
+static int64_t s_resumed_us = 0;        // capture task only: frames older than this predate the resume
+static int64_t s_idle_since_us = 0;     // when the last active subscriber left
+static int64_t s_sample_us = 0;         // broadcaster_request_frame() pending since, 0 if none
+static uint32_t s_samples = 0;
+
+// ==== Reconfiguration ====
+#define RECONFIG_MAX_DISCARD 8      // ring of up to 6, plus a frame in progress
+
+typedef struct {
+    reconfig_fn_t apply;
+    frame_accept_fn_t accept;
+    void *arg;
+    esp_err_t err;
+    reconfig_result_t result;
+    SemaphoreHandle_t done;
+} reconfig_req_t;
+
+static SemaphoreHandle_t s_reconfig_lock;   // one reconfiguration at a time
+static reconfig_req_t *volatile s_reconfig = NULL;
+
+// ==== Frame references ====
+// Caller holds s_lock
+static void frame_unref_locked(frame_t *frame) {
+    if (frame && --frame->refs == 0) {
+        heap_caps_free(frame);
+    }
+}
+
+frame_t *frame_ref(frame_t *frame) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    frame->refs++;
+    xSemaphoreGive(s_lock);
+    return frame;
+}
+
+void frame_release(frame_t *frame) {
+    if (!frame) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    frame_unref_locked(frame);
+    xSemaphoreGive(s_lock);
+}
+
+// Copies the driver buffer into a frame of our own, PSRAM first.
+static frame_t *frame_from_fb(const camera_fb_t *fb) {
+    size_t size = sizeof(frame_t) + fb->len;
+    frame_t *frame = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (!frame) frame = heap_caps_malloc(size, MALLOC_CAP_DEFAULT);
+    if (!frame) return NULL;
+    frame->fb = *fb;
+    frame->fb.buf = (uint8_t *)(frame + 1);
+    memcpy(frame->fb.buf, fb->buf, fb->len);
+    frame->refs = 1;
+    return frame;
+}
+
+// Replace the retained frame and put the new one in every send slot,
+// dropping whatever a subscriber has not picked up yet.
+static void publish(frame_t *frame) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    frame_t *old = s_latest;
+    s_latest = frame;
+    if (frame) {
+        s_sample_us = 0;
+        int64_t now = esp_timer_get_time();
+        for (subscriber_t *sub = s_subs; sub; sub = sub->next) {
+            if (sub->pending) {
+                // A retained frame overtaken by a live one was never due
+                if (!sub->pending_primed) sub->dropped++;
+                frame_unref_locked(sub->pending);
+            }
+            frame->refs++;
+            sub->pending = frame;
+            sub->pending_since_us = now;
+            sub->pending_primed = false;
+            xSemaphoreGive(sub->wake);
+        }
+    }
+    frame_unref_locked(old);
+    xSemaphoreGive(s_lock);
+}
+
+// ==== Capture task ====
+// The driver stamps frames on the esp_timer clock; a mock source may not
+static int64_t fb_captured_us(const camera_fb_t *fb, int64_t now) {
+    int64_t captured = (int64_t)fb->timestamp.tv_sec * 1000000LL + fb->timestamp.tv_usec;
+    return (captured <= 0 || captured > now) ? now : captured;
+}
+
+// Copies the driver buffer, hands it back and publishes the copy.
+static bool publish_fb(camera_fb_t *fb) {
+    int64_t now = esp_timer_get_time();
+    int64_t captured = fb_captured_us(fb, now);
+    size_t len = fb->len;
+    frame_t *frame = frame_from_fb(fb);
+    s_source.put(s_source.ctx, fb);
+    if (!frame) {
+        ESP_LOGW(TAG, "No memory for a %u byte frame", (unsigned)len);
+        return false;
+    }
+    frame->captured_us = captured;
+    uint32_t driver_age = (uint32_t)(now - captured);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    frame->seq = ++s_seq;
+    s_driver_age_total_us += driver_age;
+    if (driver_age > s_driver_age_max_us) s_driver_age_max_us = driver_age;
+    xSemaphoreGive(s_lock);
+    publish(frame);
+    return true;
+}
+
+// Runs a reconfiguration between two frames. Nothing captured under the old
+// settings reaches a viewer afterwards: send slots and the retained frame are
+// emptied first, then frames still in the driver ring are discarded until
+// one taken after the change (and passing the caller's check) comes out.
+static void run_reconfig(reconfig_req_t *req) {
+    int64_t start = esp_timer_get_time();
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (subscriber_t *sub = s_subs; sub; sub = sub->next) {
+        frame_unref_locked(sub->pending);
+        sub->pending = NULL;
+    }
+    frame_unref_locked(s_latest);
+    s_latest = NULL;
+    xSemaphoreGive(s_lock);
+
+    req->err = req->apply(req->arg);
+    int64_t applied = esp_timer_get_time();
+    req->result.discarded = 0;
+    if (req->err == ESP_OK) {
+        for (int i = 0; i < RECONFIG_MAX_DISCARD; i++) {
+            camera_fb_t *fb = s_source.get(s_source.ctx);
+            if (!fb) break;
+            int64_t captured = fb_captured_us(fb, esp_timer_get_time());
+            if (captured < applied || (req->accept && !req->accept(fb, req->arg))) {
+                s_source.put(s_source.ctx, fb);
+                req->result.discarded++;
+                continue;
+            }
+            publish_fb(fb);
+            break;
+        }
+    }
+    req->result.stall_us = (uint32_t)(esp_timer_get_time() - start);
+}
+
+static bool source_suspend(void) {
+    esp_err_t err = s_source.suspend(s_source.ctx);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Suspend failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_suspended = true;
+    xSemaphoreGive(s_lock);
+    return true;
+}
+
+// Nobody is watching: keep the last frame for snapshots and sleep until
+// someone subscribes. After idle_suspend_ms of that, stop the source too.
+// The idle time runs from the last active subscriber leaving, so sample
+// requests in between do not push the suspend back.
+static void idle_wait(void) {
+    if (s_suspended || !s_source.suspend || !s_config.idle_suspend_ms) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int64_t idle_ms = (esp_timer_get_time() - s_idle_since_us) / 1000;
+    xSemaphoreGive(s_lock);
+    if (idle_ms < (int64_t)s_config.idle_suspend_ms &&
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(s_config.idle_suspend_ms - idle_ms)) != 0) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool wanted = s_sub_count > 0 || s_sample_us;
+    xSemaphoreGive(s_lock);
+    if (wanted || s_reconfig) return;
+
+    if (!source_suspend()) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_suspends++;
+    xSemaphoreGive(s_lock);
+    ESP_LOGI(TAG, "No subscribers for %" PRIu32 " ms, capture suspended", s_config.idle_suspend_ms);
+}
+
+// Restarts a suspended source. Frames it still holds from before are
+// dropped by the caller, using s_resumed_us.
+static void source_resume(void) {
+    if (!s_suspended) return;
+    int64_t now = esp_timer_get_time();
+    esp_err_t err = s_source.resume(s_source.ctx);
+    if (err != ESP_OK) {
+        // Carry on: get() keeps failing and says so if the sensor is gone
+        ESP_LOGE(TAG, "Resume failed: %s", esp_err_to_name(err));
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_suspended = false;
+    if (!s_wake_us) s_wake_us = now;
+    xSemaphoreGive(s_lock);
+    s_resumed_us = now;
+}
+
+static void resume_done(void) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t took = (uint32_t)(esp_timer_get_time() - s_wake_us);
+    s_resume_last_us = took;
+    if (took > s_resume_max_us) s_resume_max_us = took;
+    s_wake_us = 0;
+    xSemaphoreGive(s_lock);
+    s_resumed_us = 0;
+    if (took > RESUME_TARGET_US) {
+        ESP_LOGW(TAG, "Capture resumed, first frame after %" PRIu32 " ms", took / 1000);
+    } else {
+        ESP_LOGI(TAG, "Capture resumed, first frame after %" PRIu32 " ms", took / 1000);
+    }
+}
+
+// One frame for passive subscribers while nobody is watching, taken after
+// the request, then the source goes back to how it was found. Resume
+// statistics are left to real viewers.
+static void take_sample(int64_t requested_us) {
+    bool was_suspended = s_suspended;
+    source_resume();
+    int64_t since = s_resumed_us > requested_us ? s_resumed_us : requested_us;
+    for (int i = 0; i < RECONFIG_MAX_DISCARD; i++) {
+        camera_fb_t *fb = s_source.get(s_source.ctx);
+        if (!fb) {
+            ESP_LOGE(TAG, "Camera capture failed");
+            break;
+        }
+        if (fb_captured_us(fb, esp_timer_get_time()) < since) {
+            s_source.put(s_source.ctx, fb);
+            continue;
+        }
+        publish_fb(fb);
+        break;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_sample_us = 0;    // also when the capture failed, the requester asks again
+    s_samples++;
+    bool watched = s_sub_count > 0;
+    if (!watched) s_wake_us = 0;
+    xSemaphoreGive(s_lock);
+    if (watched) return;    // a viewer arrived meanwhile, the main loop takes over
+    s_resumed_us = 0;
+    if (was_suspended && !s_reconfig) source_suspend();
+}
+
+static void capture_task(void *arg) {
+    while (true) {
+        reconfig_req_t *req = s_reconfig;
+        if (req) {
+            source_resume();
+            run_reconfig(req);
+            if (s_resumed_us) resume_done();
+            s_reconfig = NULL;
+            xSemaphoreGive(req->done);
+            continue;
+        }
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        int subs = s_sub_count;
+        int64_t sample_us = s_sample_us;
+        xSemaphoreGive(s_lock);
+        if (subs == 0) {
+            if (sample_us) {
+                take_sample(sample_us);
+            } else {
+                idle_wait();
+            }
+            continue;
+        }
+        source_resume();
+
+        camera_fb_t *fb = s_source.get(s_source.ctx);
+        if (!fb) {
+            ESP_LOGE(TAG, "Camera capture failed");
+            vTaskDelay(200 / portTICK_PERIOD_MS);
+            continue;
+        }
+        if (s_resumed_us && fb_captured_us(fb, esp_timer_get_time()) < s_resumed_us) {
+            // Left in the driver ring from before the suspend
+            s_source.put(s_source.ctx, fb);
+            continue;
+        }
+        if (!publish_fb(fb)) {
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+        } else if (s_resumed_us) {
+            resume_done();
+        }
+    }
+}
+
+esp_err_t broadcaster_start(const frame_source_t *source, const broadcaster_config_t *config) {
+    if (s_capture_task) return ESP_ERR_INVALID_STATE;
+    s_source = *source;
+    s_config = *config;
+    s_lock = xSemaphoreCreateMutex();
+    s_reconfig_lock = xSemaphoreCreateMutex();
+    if (!s_lock || !s_reconfig_lock) return ESP_ERR_NO_MEM;
+    if (xTaskCreatePinnedToCore(capture_task, "capture", CAPTURE_TASK_STACK, NULL,
+                                CAPTURE_TASK_PRIO, &s_capture_task, s_config.core) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Capture task started on core %d, max frame age %" PRIu32 " ms, idle suspend %s",
+             s_config.core, s_config.max_age_ms,
+             s_source.suspend && s_config.idle_suspend_ms ? "on" : "off");
+    return ESP_OK;
+}
+
+esp_err_t broadcaster_reconfigure(reconfig_fn_t apply, frame_accept_fn_t accept, void *arg,
+                                  reconfig_result_t *out) {
+    if (!s_capture_task) return ESP_ERR_INVALID_STATE;
+    reconfig_req_t req = {
+        .apply = apply,
+        .accept = accept,
+        .arg = arg,
+        .done = xSemaphoreCreateBinary(),
+    };
+    if (!req.done) return ESP_ERR_NO_MEM;
+    xSemaphoreTake(s_reconfig_lock, portMAX_DELAY);
+    s_reconfig = &req;
+    xTaskNotifyGive(s_capture_task);
+    xSemaphoreTake(req.done, portMAX_DELAY);
+    xSemaphoreGive(s_reconfig_lock);
+    vSemaphoreDelete(req.done);
+    if (out) *out = req.result;
+    return req.err;
+}
+
+void broadcaster_get_capture_stats(capture_stats_t *out) {
+    if (!s_lock) {
+        // Camera never came up; /stats still answers
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    out->frames = s_seq;
+    out->driver_age_avg_us = s_seq ? (uint32_t)(s_driver_age_total_us / s_seq) : 0;
+    out->driver_age_max_us = s_driver_age_max_us;
+    out->suspended = s_suspended;
+    out->suspends = s_suspends;
+    out->resume_last_us = s_resume_last_us;
+    out->resume_max_us = s_resume_max_us;
+    out->samples = s_samples;
+    xSemaphoreGive(s_lock);
+}
+
+// ==== Subscribers ====
+static subscriber_t *subscribe(bool primed, bool passive) {
+    if (!s_capture_task) return NULL;
+    subscriber_t *sub = calloc(1, sizeof(subscriber_t));
+    if (!sub) return NULL;
+    sub->wake = xSemaphoreCreateBinary();
+    if (!sub->wake) {
+        free(sub);
+        return NULL;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    sub->passive = passive;
+    sub->next = s_subs;
+    s_subs = sub;
+    if (!passive) s_sub_count++;
+    if (primed && s_latest) {
+        s_latest->refs++;
+        sub->pending = s_latest;
+        sub->pending_since_us = esp_timer_get_time();
+        sub->pending_primed = true;
+        xSemaphoreGive(sub->wake);
+    }
+    if (passive) {
+        xSemaphoreGive(s_lock);
+        return sub;
+    }
+    if (s_suspended && !s_wake_us) s_wake_us = esp_timer_get_time();
+    xSemaphoreGive(s_lock);
+    xTaskNotifyGive(s_capture_task);
+    return sub;
+}
+
+subscriber_t *broadcaster_subscribe(void) {
+    return subscribe(false, false);
+}
+
+subscriber_t *broadcaster_subscribe_primed(void) {
+    return subscribe(true, false);
+}
+
+subscriber_t *broadcaster_subscribe_passive(void) {
+    return subscribe(false, true);
+}
+
+void broadcaster_request_frame(void) {
+    if (!s_capture_task) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (!s_sample_us) s_sample_us = esp_timer_get_time();
+    xSemaphoreGive(s_lock);
+    xTaskNotifyGive(s_capture_task);
+}
+
+void broadcaster_unsubscribe(subscriber_t *sub) {
+    if (!sub) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (subscriber_t **p = &s_subs; *p; p = &(*p)->next) {
+        if (*p == sub) {
+            *p = sub->next;
+            if (!sub->passive && --s_sub_count == 0) s_idle_since_us = esp_timer_get_time();
+            break;
+        }
+    }
+    frame_unref_locked(sub->pending);
+    xSemaphoreGive(s_lock);
+    vSemaphoreDelete(sub->wake);
+    free(sub);
+}
+
+frame_t *broadcaster_latest(void) {
+    if (!s_lock) return NULL;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    frame_t *frame = s_latest;
+    if (frame) frame->refs++;
+    xSemaphoreGive(s_lock);
+    return frame;
+}
+
+int broadcaster_subscriber_count(void) {
+    if (!s_lock) return 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int count = s_sub_count;
+    xSemaphoreGive(s_lock);
+    return count;
+}
+
+frame_t *broadcaster_wait_frame(subscriber_t *sub, TickType_t timeout) {
+    TickType_t start = xTaskGetTickCount();
+    bool skipped = false;
+    while (true) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        frame_t *frame = sub->pending;
+        if (frame && sub->pending_primed) {
+            // Old by design: it is there to put a picture up right away,
+            // so it bypasses the stale check and the age statistics
+            sub->pending = NULL;
+            sub->pending_primed = false;
+            sub->primed++;
+        } else if (frame) {
+            sub->pending = NULL;
+            int64_t now = esp_timer_get_time();
+            uint32_t age = (uint32_t)(now - frame->captured_us);
+            if (!skipped && s_config.max_age_ms && age > s_config.max_age_ms * 1000) {
+                // Only once per call: if the capture itself runs late we still
+                // deliver rather than starve the viewer
+                sub->stale++;
+                frame_unref_locked(frame);
+                frame = NULL;
+                skipped = true;
+            } else {
+                uint32_t residency = (uint32_t)(now - sub->pending_since_us);
+                sub->delivered++;
+                sub->residency_total_us += residency;
+                if (residency > sub->residency_max_us) sub->residency_max_us = residency;
+                sub->age_total_us += age;
+                if (age > sub->age_max_us) sub->age_max_us = age;
+            }
+        }
+        xSemaphoreGive(s_lock);
+        if (frame) return frame;
+
+        TickType_t wait = timeout;
+        if (timeout != portMAX_DELAY) {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if (elapsed >= timeout) return NULL;
+            wait = timeout - elapsed;
+        }
+        if (xSemaphoreTake(sub->wake, wait) != pdTRUE) return NULL;
+    }
+}
+
+void broadcaster_get_stats(subscriber_t *sub, subscriber_stats_t *out) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    out->delivered = sub->delivered;
+    out->dropped = sub->dropped;
+    out->primed = sub->primed;
+    out->residency_avg_us = sub->delivered ? (uint32_t)(sub->residency_total_us / sub->delivered) : 0;
+    out->residency_max_us = sub->residency_max_us;
+    out->stale = sub->stale;
+    out->age_avg_us = sub->delivered ? (uint32_t)(sub->age_total_us / sub->delivered) : 0;
+    out->age_max_us = sub->age_max_us;
+    xSemaphoreGive(s_lock);
+}
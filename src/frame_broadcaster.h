@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_camera.h"
+#include "freertos/FreeRTOS.h"
+
+// ==== Frame source ====
+// Where the capture task gets its frames from. On the device this wraps
+// esp_camera_fb_get()/esp_camera_fb_return(); a host build can plug in a
+// mock that replays JPEG files instead. suspend/resume are optional: they
+// stop and restart capture without tearing the driver down, see
+// broadcaster_config_t::idle_suspend_ms.
+typedef struct {
+    camera_fb_t *(*get)(void *ctx);
+    void (*put)(void *ctx, camera_fb_t *fb);
+    esp_err_t (*suspend)(void *ctx);
+    esp_err_t (*resume)(void *ctx);
+    void *ctx;
+} frame_source_t;
+
+// ==== Shared frame ====
+// One captured frame, shared by every subscriber. The JPEG is copied out of
+// the driver buffer at capture time, so a viewer on a slow link never keeps
+// a camera buffer away from the driver.
+typedef struct frame {
+    camera_fb_t fb;         // driver descriptor; buf points at our own copy
+    uint32_t seq;           // 1, 2, 3 ... in capture order
+    int64_t captured_us;    // esp_timer clock at frame start (the driver stamps VSYNC)
+    uint32_t refs;          // guarded by the broadcaster lock
+} frame_t;
+
+typedef struct subscriber subscriber_t;
+
+typedef struct {
+    int core;                   // capture task affinity, tskNO_AFFINITY for none
+    uint32_t max_age_ms;        // 0 keeps every frame, see broadcaster_wait_frame()
+    uint32_t idle_suspend_ms;   // suspend the source this long after the last subscriber left, 0 = never
+} broadcaster_config_t;
+
+typedef struct {
+    uint32_t frames;            // frames published
+    uint32_t driver_age_avg_us; // frame start to esp_camera_fb_get() returning it, readout included
+    uint32_t driver_age_max_us;
+    bool suspended;             // source is idle-suspended right now
+    uint32_t suspends;
+    uint32_t resume_last_us;    // first subscriber to first frame published, last resume
+    uint32_t resume_max_us;
+    uint32_t samples;           // single frames taken for broadcaster_request_frame()
+} capture_stats_t;
+
+typedef struct {
+    uint32_t delivered;         // frames taken by the sender
+    uint32_t dropped;           // replaced before the sender took them (slow link or lower fps)
+    uint32_t residency_avg_us;  // time a frame waited in the send slot
+    uint32_t residency_max_us;
+    uint32_t stale;             // skipped for being older than max_age_ms
+    uint32_t age_avg_us;        // capture to pickup, frames actually delivered
+    uint32_t age_max_us;
+    uint32_t primed;            // retained frames handed over by broadcaster_subscribe_primed()
+} subscriber_stats_t;
+
+// Starts the capture task. The task only pulls frames while at least one
+// active subscriber is attached; the last frame stays retained after that.
+// With idle_suspend_ms set and a source that can suspend, capture is
+// stopped once nobody has subscribed for that long, and restarted by the
+// next subscribe() or reconfigure().
+esp_err_t broadcaster_start(const frame_source_t *source, const broadcaster_config_t *config);
+
+void broadcaster_get_capture_stats(capture_stats_t *out);
+
+// ==== Live reconfiguration ====
+typedef esp_err_t (*reconfig_fn_t)(void *arg);
+typedef bool (*frame_accept_fn_t)(const camera_fb_t *fb, void *arg);
+
+typedef struct {
+    uint32_t stall_us;      // last frame before the change to first frame after it
+    uint32_t discarded;     // driver frames thrown away as taken under the old settings
+} reconfig_result_t;
+
+// Runs `apply` on the capture task between two frames, drops every frame
+// captured before it, and returns once the first frame taken afterwards
+// (and accepted by `accept`, if given) has been published. Blocks the
+// caller for the whole stall; meant for control requests, not hot paths.
+esp_err_t broadcaster_reconfigure(reconfig_fn_t apply, frame_accept_fn_t accept, void *arg,
+                                  reconfig_result_t *out);
+
+// Attach / detach a consumer. Each subscriber has a send slot of depth one:
+// a new frame replaces one the sender has not picked up yet, so a slow
+// viewer always gets the newest frame and never holds back the others.
+subscriber_t *broadcaster_subscribe(void);
+void broadcaster_unsubscribe(subscriber_t *sub);
+
+// Like broadcaster_subscribe(), but the slot starts out holding the
+// retained newest frame, however old, so a new viewer has a picture
+// without waiting for the next capture. That frame skips the stale check.
+subscriber_t *broadcaster_subscribe_primed(void);
+
+// A subscriber that receives frames while someone else keeps capture
+// running, but does not keep it running itself and is not counted by
+// broadcaster_subscriber_count(). For background consumers such as
+// motion detection, which would otherwise keep the sensor awake forever.
+subscriber_t *broadcaster_subscribe_passive(void);
+
+// Has the capture task take one fresh frame for every subscriber's slot
+// even though nobody is watching, resuming a suspended source for it and
+// suspending it again afterwards. Does nothing extra while capture is
+// running anyway. Returns at once; wait on the slot for the frame.
+void broadcaster_request_frame(void);
+
+// Blocks until the subscriber's slot holds a frame and takes it. Returns a
+// reference (release with frame_release()), or NULL on timeout. A frame
+// older than max_age_ms is skipped once for the next capture, so a viewer
+// is never served a stale frame while a fresher one is moments away.
+frame_t *broadcaster_wait_frame(subscriber_t *sub, TickType_t timeout);
+
+void broadcaster_get_stats(subscriber_t *sub, subscriber_stats_t *out);
+
+// The retained newest frame as a new reference, or NULL if nothing has
+// been captured yet. Does not touch the sensor.
+frame_t *broadcaster_latest(void);
+
+frame_t *frame_ref(frame_t *frame);
+void frame_release(frame_t *frame);
+
+// Active subscribers, the ones keeping capture running.
+int broadcaster_subscriber_count(void);
@@ -0,0 +1,80 @@
+#include <stdlib.h>
+#include "frame_pacer.h"
+
+// Below this a one-shot timer costs more than it saves
+#define PACER_MIN_SLEEP_US 200
+
+static void pacer_timer_cb(void *arg) {
+    frame_pacer_t *p = (frame_pacer_t *)arg;
+    xSemaphoreGive(p->wake);
+}
+
+esp_err_t pacer_init(frame_pacer_t *p, int fps) {
+    *p = (frame_pacer_t) {
+        .fps = fps,
+        .period_us = 1000000 / fps,
+    };
+    p->wake = xSemaphoreCreateBinary();
+    if (!p->wake) return ESP_ERR_NO_MEM;
+    const esp_timer_create_args_t args = {
+        .callback = pacer_timer_cb,
+        .arg = p,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "pacer",
+    };
+    esp_err_t err = esp_timer_create(&args, &p->timer);
+    if (err != ESP_OK) {
+        vSemaphoreDelete(p->wake);
+        p->wake = NULL;
+    }
+    return err;
+}
+
+void pacer_deinit(frame_pacer_t *p) {
+    if (p->timer) {
+        esp_timer_stop(p->timer);
+        esp_timer_delete(p->timer);
+        p->timer = NULL;
+    }
+    if (p->wake) {
+        vSemaphoreDelete(p->wake);
+        p->wake = NULL;
+    }
+}
+
+bool pacer_wait(frame_pacer_t *p) {
+    int64_t now = esp_timer_get_time();
+    bool late = p->next_deadline_us != 0 && now - p->next_deadline_us > p->period_us / 2;
+    if (late) p->late++;
+    if (p->next_deadline_us == 0 || now - p->next_deadline_us > p->period_us) {
+        p->next_deadline_us = now;
+    }
+    int64_t delay = p->next_deadline_us - now;
+    if (delay >= PACER_MIN_SLEEP_US && esp_timer_start_once(p->timer, delay) == ESP_OK) {
+        xSemaphoreTake(p->wake, portMAX_DELAY);
+    }
+    p->next_deadline_us += p->period_us;
+    return late;
+}
+
+void pacer_frame_sent(frame_pacer_t *p) {
+    int64_t now = esp_timer_get_time();
+    if (p->frames == 0) {
+        p->first_frame_us = now;
+    } else {
+        int64_t dev = llabs((now - p->last_frame_us) - p->period_us);
+        // Same 1/16 gain as RFC 3550 interarrival jitter
+        p->jitter_us += (dev - p->jitter_us) / 16;
+    }
+    p->last_frame_us = now;
+    p->frames++;
+}
+
+void pacer_get_stats(const frame_pacer_t *p, pacer_stats_t *out) {
+    out->requested_fps = p->fps;
+    out->frames = p->frames;
+    out->jitter_us = (uint32_t)p->jitter_us;
+    out->late = p->late;
+    int64_t span = p->last_frame_us - p->first_frame_us;
+    out->achieved_fps = (p->frames > 1 && span > 0) ? (p->frames - 1) * 1e6f / span : 0.0f;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// ==== Frame pacer ====
+// Schedules frames against absolute deadlines (start + n * period), so time
+// spent waiting for a frame or sending it is not added on top of the period.
+// Sleeps use an esp_timer one-shot, which is not quantized to the 10 ms
+// FreeRTOS tick.
+typedef struct {
+    int fps;                    // requested rate
+    int64_t period_us;
+    int64_t next_deadline_us;   // 0 until the first frame
+    esp_timer_handle_t timer;
+    SemaphoreHandle_t wake;
+
+    // Statistics, updated by pacer_frame_sent()
+    uint32_t frames;
+    int64_t first_frame_us;
+    int64_t last_frame_us;
+    int64_t jitter_us;          // smoothed |interval - period|
+    uint32_t late;              // pacer_wait() calls that found the deadline long gone
+} frame_pacer_t;
+
+typedef struct {
+    int requested_fps;
+    float achieved_fps;         // over the whole session
+    uint32_t jitter_us;
+    uint32_t frames;
+    uint32_t late;
+} pacer_stats_t;
+
+esp_err_t pacer_init(frame_pacer_t *p, int fps);
+void pacer_deinit(frame_pacer_t *p);
+
+// Sleeps until the next frame is due. If the caller fell more than a whole
+// period behind, the schedule restarts from now instead of bursting frames.
+// Returns true if the deadline had passed by more than half a period, i.e.
+// the previous frame took too long to get out.
+bool pacer_wait(frame_pacer_t *p);
+
+// Call once per frame actually sent.
+void pacer_frame_sent(frame_pacer_t *p);
+
+void pacer_get_stats(const frame_pacer_t *p, pacer_stats_t *out);
@@ -0,0 +1,63 @@
+#include <string.h>
+#include "framesize_ctrl.h"
+
+void framesize_ctrl_init(framesize_ctrl_t *fc, int level, int max_level) {
+    memset(fc, 0, sizeof(*fc));
+    fc->max_level = max_level;
+    fc->level = level < max_level ? level : max_level;
+}
+
+void framesize_ctrl_add_frame(framesize_ctrl_t *fc, bool late, int64_t now_us) {
+    if (fc->window_start_us == 0) fc->window_start_us = now_us;
+    fc->frames++;
+    if (late) fc->late++;
+}
+
+bool framesize_ctrl_update(framesize_ctrl_t *fc, const quality_ctrl_stats_t *q,
+                           int worst_quality, int64_t now_us) {
+    if (fc->window_start_us == 0 || now_us - fc->window_start_us < FRAMESIZE_WINDOW_US) {
+        return false;
+    }
+    fc->late_ratio = fc->frames ? (float)fc->late / fc->frames : 0.0f;
+    fc->window_start_us = 0;
+    fc->frames = 0;
+    fc->late = 0;
+
+    if (fc->hold_windows > 0) {
+        fc->hold_windows--;
+        return false;
+    }
+
+    bool saturated = q->link_kbps != 0;
+    bool struggling = fc->late_ratio > FRAMESIZE_LATE_DOWN ||
+                      (saturated && q->quality >= worst_quality);
+    bool roomy = fc->late_ratio < FRAMESIZE_LATE_UP && !saturated &&
+                 q->sent_kbps * FRAMESIZE_UP_GROWTH < q->effective_kbps * FRAMESIZE_UP_HEADROOM;
+    fc->down_windows = struggling ? fc->down_windows + 1 : 0;
+    fc->up_windows = roomy ? fc->up_windows + 1 : 0;
+
+    int old = fc->level;
+    if (fc->down_windows >= FRAMESIZE_DOWN_WINDOWS && fc->level > 0) {
+        fc->level--;
+    } else if (fc->up_windows >= FRAMESIZE_UP_WINDOWS && fc->level < fc->max_level) {
+        fc->level++;
+    }
+    if (fc->level == old) return false;
+    fc->down_windows = 0;
+    fc->up_windows = 0;
+    fc->hold_windows = FRAMESIZE_HOLD_WINDOWS;
+    fc->changes++;
+    return true;
+}
+
+void framesize_ctrl_set_level(framesize_ctrl_t *fc, int level) {
+    if (level < 0) level = 0;
+    if (level > fc->max_level) level = fc->max_level;
+    fc->level = level;
+    fc->window_start_us = 0;
+    fc->frames = 0;
+    fc->late = 0;
+    fc->down_windows = 0;
+    fc->up_windows = 0;
+    fc->hold_windows = FRAMESIZE_HOLD_WINDOWS;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "quality_ctrl.h"
+
+// ==== Frame size manager ====
+// Picks a resolution level (0 = smallest) from what the network carried over
+// the last windows. Plain C with the clock passed in, like quality_ctrl.
+//
+// Steps down when viewers keep missing their frame deadlines, or the uplink
+// is saturated with the quality controller already at its worst setting.
+// Steps up only after a long quiet stretch in which the next size up would
+// still fit the budget. Every change is followed by a hold-off, so the
+// quality controller settles before the next decision.
+
+#define FRAMESIZE_WINDOW_US         (1000 * 1000)
+#define FRAMESIZE_LATE_DOWN         0.20f   // share of late frames that counts as struggling
+#define FRAMESIZE_LATE_UP           0.05f
+#define FRAMESIZE_DOWN_WINDOWS      3
+#define FRAMESIZE_UP_WINDOWS        10
+#define FRAMESIZE_HOLD_WINDOWS      5
+#define FRAMESIZE_UP_GROWTH         3.0f    // JPEG bytes, one level up (4x the pixels)
+#define FRAMESIZE_UP_HEADROOM       0.80f   // share of the budget the grown stream may use
+
+typedef struct {
+    int level;
+    int max_level;
+
+    // Current window
+    int64_t window_start_us;    // 0 until the first frame
+    uint32_t frames;
+    uint32_t late;
+
+    int down_windows;
+    int up_windows;
+    int hold_windows;
+    float late_ratio;           // last closed window
+    uint32_t changes;
+} framesize_ctrl_t;
+
+void framesize_ctrl_init(framesize_ctrl_t *fc, int level, int max_level);
+
+// One frame went out; `late` as returned by pacer_wait() before it.
+void framesize_ctrl_add_frame(framesize_ctrl_t *fc, bool late, int64_t now_us);
+
+// Closes the window if it is over, judging it together with the quality
+// controller's view of the link. Returns true when fc->level changed.
+bool framesize_ctrl_update(framesize_ctrl_t *fc, const quality_ctrl_stats_t *q,
+                           int worst_quality, int64_t now_us);
+
+// Takes a level set from outside (pinned by hand, or the level to resume
+// from): starts a fresh window and the usual hold-off after a change.
+void framesize_ctrl_set_level(framesize_ctrl_t *fc, int level);
@@ -0,0 +1,14 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include "json_util.h"
+
+bool json_append(char *buf, size_t cap, size_t *off, const char *fmt, ...) {
+    if (*off >= cap) return false;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf + *off, cap - *off, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= cap - *off) return false;
+    *off += n;
+    return true;
+}
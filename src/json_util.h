@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// ==== JSON into a fixed buffer ====
+// printf-style append at buf + *off, advancing *off. Returns false and
+// leaves *off alone when the text does not fit, so a handler can send a
+// 500 instead of a truncated body.
+bool __attribute__((format(printf, 4, 5)))
+json_append(char *buf, size_t cap, size_t *off, const char *fmt, ...);
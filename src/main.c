@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <inttypes.h>
 #include "esp_camera.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
@@ -8,9 +9,19 @@
 #include "esp_heap_caps.h"
 #include "esp_http_server.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
+#include "frame_broadcaster.h"
+#include "camera_capture.h"
+#include "stream.h"
+#include "snapshot.h"
+#include "control.h"
+#include "wifi_fast.h"
+#include "boot_timeline.h"
+#include "motion.h"
+#include "thumbnail.h"
 
 // Wi-Fi Provisioning
 #include "wifi_provisioning/manager.h"
@@ -25,104 +36,9 @@ static EventGroupHandle_t s_wifi_event_group;
 #define WIFI_PROVISIONED_BIT BIT1
 #define WIFI_FAIL_BIT      BIT2
 
-// ==== Freenove ESP32-S3 WROOM Camera Pins ====
-#define CAM_PIN_SIOD  4
-#define CAM_PIN_SIOC  5
-#define CAM_PIN_VSYNC 6
-#define CAM_PIN_HREF  7
-#define CAM_PIN_PCLK  13
-#define CAM_PIN_XCLK  15
-#define CAM_PIN_D7    16
-#define CAM_PIN_D6    17
-#define CAM_PIN_D5    18
-#define CAM_PIN_D4    12
-#define CAM_PIN_D3    10
-#define CAM_PIN_D2    8
-#define CAM_PIN_D1    9
-#define CAM_PIN_D0    11
-
-// ==== Camera Config ====
-static camera_config_t camera_config = {
-    .pin_pwdn  = -1,
-    .pin_reset = -1,
-    .pin_xclk = CAM_PIN_XCLK,
-    .pin_sccb_sda = CAM_PIN_SIOD,
-    .pin_sccb_scl = CAM_PIN_SIOC,
-    .pin_d7 = CAM_PIN_D7,
-    .pin_d6 = CAM_PIN_D6,
-    .pin_d5 = CAM_PIN_D5,
-    .pin_d4 = CAM_PIN_D4,
-    .pin_d3 = CAM_PIN_D3,
-    .pin_d2 = CAM_PIN_D2,
-    .pin_d1 = CAM_PIN_D1,
-    .pin_d0 = CAM_PIN_D0,
-    .pin_vsync = CAM_PIN_VSYNC,
-    .pin_href  = CAM_PIN_HREF,
-    .pin_pclk  = CAM_PIN_PCLK,
-    .xclk_freq_hz = 20000000,
-    .ledc_timer   = LEDC_TIMER_0,
-    .ledc_channel = LEDC_CHANNEL_0,
-    .pixel_format = PIXFORMAT_JPEG,
-    .frame_size   = FRAMESIZE_QVGA,
-    .jpeg_quality = 12,
-    .fb_count     = 1
-};
-
-// ==== Camera init helpers ====
-esp_err_t try_camera_init(framesize_t frame_size, int fb_count) {
-    camera_config.frame_size = frame_size;
-    camera_config.fb_count   = fb_count;
-    ESP_LOGI(TAG, "Init camera, frame_size=%d, fb_count=%d", frame_size, fb_count);
-    esp_err_t err = esp_camera_init(&camera_config);
-    if (err == ESP_OK) {
-        sensor_t *s = esp_camera_sensor_get();
-        if (s) {
-            ESP_LOGI(TAG, "Camera detected, PID=0x%04x", s->id.PID);
-            s->set_vflip(s, 1);
-            s->set_hmirror(s, 0);
-        }
-        return ESP_OK;
-    }
-    ESP_LOGE(TAG, "Camera init failed: 0x%x", err);
-    return err;
-}
-
-esp_err_t init_camera_safe() {
-    size_t psram_size = heap_caps_get_total_size(MALLOC_CAP_SPIRAM);
-    int fb_count = (psram_size > 0) ? 2 : 1;
-    if (try_camera_init(FRAMESIZE_QVGA, fb_count) == ESP_OK) return ESP_OK;
-    if (try_camera_init(FRAMESIZE_QVGA, 1) == ESP_OK) return ESP_OK;
-    if (try_camera_init(FRAMESIZE_QQVGA, 1) == ESP_OK) return ESP_OK;
-    ESP_LOGE(TAG, "All camera init attempts failed!");
-    return ESP_FAIL;
-}
-
-// ==== HTTP Stream Handlers ====
+// ==== HTTP Handlers ====
 static httpd_handle_t server = NULL;
 
-esp_err_t stream_handler(httpd_req_t *req) {
-    static const char* _STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=frame";
-    static const char* _STREAM_BOUNDARY = "\r\n--frame\r\n";
-    static const char* _STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n";
-    char part_buf[64];
-    httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
-    while (true) {
-        camera_fb_t *fb = esp_camera_fb_get();
-        if (!fb) {
-            ESP_LOGE(TAG, "Camera capture failed");
-            vTaskDelay(200 / portTICK_PERIOD_MS);
-            continue;
-        }
-        size_t hlen = snprintf(part_buf, 64, _STREAM_PART, fb->len);
-        httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
-        httpd_resp_send_chunk(req, part_buf, hlen);
-        httpd_resp_send_chunk(req, (const char *)fb->buf, fb->len);
-        esp_camera_fb_return(fb);
-        vTaskDelay(50 / portTICK_PERIOD_MS); // ~20 FPS max
-    }
-    return ESP_OK;
-}
-
 esp_err_t index_handler(httpd_req_t *req) {
     const char* resp_str =
         "<html><body>"
@@ -135,16 +51,42 @@ esp_err_t index_handler(httpd_req_t *req) {
 
 void start_webserver(void) {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    // 串流連線不佔用 httpd 任務，保留 socket 給控制端點
+    config.max_open_sockets = STREAM_MAX_SESSIONS + 3;
+    config.lru_purge_enable = true;
+    if (stream_workers_start() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start stream workers");
+        return;
+    }
     if (httpd_start(&server, &config) == ESP_OK) {
         httpd_uri_t index_uri = { .uri="/", .method=HTTP_GET, .handler=index_handler };
         httpd_uri_t stream_uri = { .uri="/stream", .method=HTTP_GET, .handler=stream_handler };
+        httpd_uri_t capture_uri = { .uri="/capture", .method=HTTP_GET, .handler=capture_handler };
+        httpd_uri_t stats_uri = { .uri="/stats", .method=HTTP_GET, .handler=stream_stats_handler };
+        httpd_uri_t control_uri = { .uri="/control", .method=HTTP_GET, .handler=control_handler };
+        httpd_uri_t boot_uri = { .uri="/debug/boot", .method=HTTP_GET, .handler=boot_timeline_handler };
+        httpd_uri_t motion_uri = { .uri="/motion", .method=HTTP_GET, .handler=motion_handler };
         httpd_register_uri_handler(server, &index_uri);
         httpd_register_uri_handler(server, &stream_uri);
+        httpd_register_uri_handler(server, &capture_uri);
+        httpd_register_uri_handler(server, &stats_uri);
+        httpd_register_uri_handler(server, &control_uri);
+        httpd_register_uri_handler(server, &boot_uri);
+        httpd_register_uri_handler(server, &motion_uri);
         ESP_LOGI(TAG, "Web server started");
     }
 }
 
 // ==== Wi-Fi Events ====
+static esp_netif_t *sta_netif = NULL;
+static esp_netif_t *ap_netif  = NULL;
+static esp_timer_handle_t s_retry_timer = NULL;
+static bool s_fast_path = false;
+
+static void retry_timer_cb(void *arg) {
+    esp_wifi_connect();
+}
+
 static void event_handler(void* arg, esp_event_base_t event_base,
                           int32_t event_id, void* event_data) {
     if (event_base == WIFI_EVENT) {
@@ -152,11 +94,22 @@ static void event_handler(void* arg, esp_event_base_t event_base,
             case WIFI_EVENT_STA_START:
                 esp_wifi_connect();
                 break;
+            case WIFI_EVENT_STA_CONNECTED:
+                wifi_fast_on_connected(sta_netif);
+                break;
             case WIFI_EVENT_STA_DISCONNECTED:
+                if (wifi_fast_active()) {
+                    // 快取的 AP 連不上，改回完整掃描 + DHCP
+                    ESP_LOGW(TAG, "Cached AP failed, falling back to a full scan");
+                    wifi_fast_fallback(sta_netif);
+                }
                 if (s_retry_num < MAX_RETRY) {
-                    esp_wifi_connect();
+                    uint32_t delay = wifi_backoff_ms(s_retry_num);
                     s_retry_num++;
-                    ESP_LOGI(TAG, "Retry to connect to the AP (%d/%d)", s_retry_num, MAX_RETRY);
+                    ESP_LOGI(TAG, "Retry to connect to the AP in %" PRIu32 " ms (%d/%d)", delay, s_retry_num, MAX_RETRY);
+                    if (!s_retry_timer || esp_timer_start_once(s_retry_timer, delay * 1000ULL) != ESP_OK) {
+                        esp_wifi_connect();
+                    }
                 } else {
                     ESP_LOGW(TAG, "WiFi connect failed after %d retries", MAX_RETRY);
                     xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
@@ -168,11 +121,14 @@ static void event_handler(void* arg, esp_event_base_t event_base,
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "Got IP:" IPSTR, IP2STR(&event->ip_info.ip));
+        boot_mark(s_fast_path && wifi_fast_active() ? "got_ip_cached_ap" : "got_ip");
+        wifi_fast_save(sta_netif, &event->ip_info);
         s_retry_num = 0;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
     } else if (event_base == WIFI_PROV_EVENT) {
         if (event_id == WIFI_PROV_END) {
             ESP_LOGI(TAG, "Provisioning ended, de-initializing manager.");
+            boot_mark("provisioning_end");
             wifi_prov_mgr_deinit();
             xEventGroupSetBits(s_wifi_event_group, WIFI_PROVISIONED_BIT);
         }
@@ -180,11 +136,13 @@ static void event_handler(void* arg, esp_event_base_t event_base,
 }
 
 // ==== Wi-Fi Connection and Provisioning Logic ====
-static esp_netif_t *sta_netif = NULL;
-static esp_netif_t *ap_netif  = NULL;
-
 void start_web_prov(void) {
     s_wifi_event_group = xEventGroupCreate();
+    const esp_timer_create_args_t retry_args = {
+        .callback = retry_timer_cb,
+        .name = "wifi_retry",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&retry_args, &s_retry_timer));
 
     // 註冊所有必要的事件處理器
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL));
@@ -197,6 +155,7 @@ void start_web_prov(void) {
         .scheme_event_handler = WIFI_PROV_EVENT_HANDLER_NONE,
     };
     ESP_ERROR_CHECK(wifi_prov_mgr_init(prov_cfg));
+    boot_mark("prov_mgr_init");
 
     bool provisioned = false;
     ESP_ERROR_CHECK(wifi_prov_mgr_is_provisioned(&provisioned));
@@ -205,13 +164,17 @@ void start_web_prov(void) {
         ESP_LOGI(TAG, "Device already provisioned, connecting to the network...");
         sta_netif = esp_netif_create_default_wifi_sta();
         ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+        // 先用上次成功的 AP / 頻道直接連線，失敗才完整掃描
+        s_fast_path = wifi_fast_apply(sta_netif);
         ESP_ERROR_CHECK(esp_wifi_start());
+        boot_mark("esp_wifi_start");
 
         EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
                                                WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
                                                pdFALSE, pdFALSE, portMAX_DELAY);
         if (bits & WIFI_FAIL_BIT) {
             ESP_LOGW(TAG, "Failed to connect after %d retries, starting web provisioning", s_retry_num);
+            boot_mark("wifi_connect_failed");
 
             // Destroy STA netif before switching
             if (sta_netif) {
@@ -227,6 +190,7 @@ void start_web_prov(void) {
                 NULL,
                 "PROV_ESP32",
                 NULL);
+            boot_mark("provisioning_start");
 
             xEventGroupWaitBits(s_wifi_event_group, WIFI_PROVISIONED_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
         }
@@ -241,6 +205,7 @@ void start_web_prov(void) {
             NULL,
             "PROV_ESP32",
             NULL);
+        boot_mark("provisioning_start");
 
         xEventGroupWaitBits(s_wifi_event_group, WIFI_PROVISIONED_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
     }
@@ -394,35 +359,99 @@ void start_web_prov(void) {
     }
 }
 */
+// ==== Boot ====
+// Camera and Wi-Fi come up in parallel; both record into the boot timeline
+#define CAMERA_BOOT_TASK_STACK 4096
+#define CAMERA_BOOT_WAIT_MS    3000     // after Wi-Fi is up, at most this much longer
+#define CAMERA_DONE_BIT        BIT0     // set whether init worked or not
+
+static EventGroupHandle_t s_boot_events;
+
+static void camera_boot_task(void *arg) {
+    boot_mark("camera_init_start");
+    if (camera_init_safe() != ESP_OK) {
+        ESP_LOGE(TAG, "Camera failed to start, check PSRAM configuration.");
+        boot_mark("camera_init_failed");
+    } else {
+        boot_mark("camera_init_done");
+        // 讓自動曝光先收斂，再交給擷取任務
+        camera_warm_up(CAMERA_WARMUP_FRAMES);
+        boot_mark("sensor_warm_up_done");
+
+        // 單一擷取任務擁有攝影機，所有 /stream 連線共用同一份影格
+        frame_source_t source;
+        broadcaster_config_t bcfg;
+        camera_frame_source(&source);
+        camera_broadcaster_config(&bcfg);
+        if (broadcaster_start(&source, &bcfg) == ESP_OK) {
+            // One frame in the retained slot, so /capture answers right away
+            subscriber_t *sub = broadcaster_subscribe();
+            if (sub) {
+                frame_release(broadcaster_wait_frame(sub, 1000 / portTICK_PERIOD_MS));
+                broadcaster_unsubscribe(sub);
+            }
+            boot_mark("first_frame_ready");
+#if MOTION_DETECT_ENABLE
+            if (motion_start() != ESP_OK) ESP_LOGE(TAG, "Failed to start motion detection");
+#endif
+        } else {
+            ESP_LOGE(TAG, "Failed to start capture task");
+        }
+    }
+    xEventGroupSetBits(s_boot_events, CAMERA_DONE_BIT);
+    vTaskDelete(NULL);
+}
+
 // ==== Main App ====
 void app_main() {
+    // 之前的時間是啟動程式與 PSRAM 記憶體測試
+    boot_mark("app_main");
+    s_boot_events = xEventGroupCreate();
+    ESP_ERROR_CHECK(thumbnail_init());
+    // 攝影機初始化與 Wi-Fi 同時進行，連上網路時第一張影格已就緒
+    if (xTaskCreatePinnedToCore(camera_boot_task, "camera_boot", CAMERA_BOOT_TASK_STACK, NULL,
+                                5, NULL, CAPTURE_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start camera boot task");
+        xEventGroupSetBits(s_boot_events, CAMERA_DONE_BIT);
+    }
+
     // --- NVS Flash 初始化 ---
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         ESP_ERROR_CHECK(nvs_flash_erase());
         ESP_ERROR_CHECK(nvs_flash_init());
     }
+    boot_mark("nvs_flash_init");
 
     // --- Wi-Fi 堆棧和事件循環初始化 ---
     ESP_ERROR_CHECK(esp_netif_init());
+    boot_mark("esp_netif_init");
     ESP_ERROR_CHECK(esp_event_loop_create_default());
+    boot_mark("event_loop");
 
     // --- Wi-Fi 驅動初始化 ---
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    boot_mark("esp_wifi_init");
 
     // 啟動 Wi-Fi 連線或配網流程
     start_web_prov();
-
-    // --- 攝影機初始化 ---
-    if (init_camera_safe() != ESP_OK) {
-        ESP_LOGE(TAG, "Camera failed to start, check PSRAM configuration.");
-    }
+    boot_mark("wifi_ready");
 
     // 輸出 PSRAM 資訊
     size_t psram_size = heap_caps_get_total_size(MALLOC_CAP_SPIRAM);
     ESP_LOGI(TAG, "PSRAM: %d KB", psram_size / 1024);
 
+    // 通常攝影機早已就緒；否則最多再等一下，之後的串流請求自行回報錯誤
+    if (!(xEventGroupWaitBits(s_boot_events, CAMERA_DONE_BIT, pdFALSE, pdFALSE,
+                              CAMERA_BOOT_WAIT_MS / portTICK_PERIOD_MS) & CAMERA_DONE_BIT)) {
+        ESP_LOGW(TAG, "Camera still starting, web server goes up without it");
+    }
+    boot_mark("camera_wait_done");
+
     // 啟動網頁伺服器
+    // (配網時 SoftAP 的 httpd 佔用 port 80，所以要等 Wi-Fi 流程結束才能啟動)
     start_webserver();
+    boot_mark("httpd_start");
+    boot_timeline_dump();
 }
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "mjpeg_writer.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+
+#define PART_BOUNDARY "frame"
+static const char* _STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=" PART_BOUNDARY;
+static const char* _STREAM_BOUNDARY = "\r\n--" PART_BOUNDARY "\r\n";
+static const char* _STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp: %d.%06d\r\nX-Frame-Seq: %u\r\n\r\n";
+static const char* _STREAM_HEADERS = "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n\r\n";
+// The body is delimited by closing the connection
+static const char* _STREAM_RAW_HEADERS = "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nConnection: close\r\nCache-Control: no-cache\r\n\r\n";
+
+static const char *s_framing_names[] = {
+    [MJPEG_FRAMING_PARTS]   = "parts",
+    [MJPEG_FRAMING_CHUNKED] = "chunked",
+    [MJPEG_FRAMING_RAW]     = "raw",
+};
+
+void mjpeg_writer_init(mjpeg_writer_t *w, httpd_req_t *req, mjpeg_framing_t framing) {
+    *w = (mjpeg_writer_t) {
+        .req = req,
+        .sockfd = httpd_req_to_sockfd(req),
+        .framing = framing,
+    };
+}
+
+const char *mjpeg_framing_name(mjpeg_framing_t framing) {
+    return s_framing_names[framing];
+}
+
+bool mjpeg_framing_from_str(const char *str, mjpeg_framing_t *framing) {
+    for (size_t i = 0; i < sizeof(s_framing_names) / sizeof(s_framing_names[0]); i++) {
+        if (strcmp(str, s_framing_names[i]) == 0) {
+            *framing = (mjpeg_framing_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Part headers; X-Timestamp is the driver's frame-start (VSYNC) time, seconds since boot
+static size_t format_part_header(char *buf, size_t size, const camera_fb_t *fb, uint32_t seq) {
+    return snprintf(buf, size, _STREAM_PART, (unsigned)fb->len,
+                    (int)fb->timestamp.tv_sec, (int)fb->timestamp.tv_usec, (unsigned)seq);
+}
+
+// Bytes httpd_resp_send_chunk() puts on the wire for a chunk of len bytes
+static size_t chunk_wire_size(size_t len) {
+    char len_str[10];
+    return snprintf(len_str, sizeof(len_str), "%x\r\n", (unsigned)len) + len + 2;
+}
+
+// ==== Legacy framing: three httpd chunks per frame ====
+static esp_err_t send_parts(mjpeg_writer_t *w, const camera_fb_t *fb, uint32_t seq) {
+    char part_buf[128];
+    size_t hlen = format_part_header(part_buf, sizeof(part_buf), fb, seq);
+    size_t blen = strlen(_STREAM_BOUNDARY);
+
+    if (!w->headers_sent) {
+        httpd_resp_set_type(w->req, _STREAM_CONTENT_TYPE);
+        // Status line and headers, then the blank line
+        w->wire_bytes += snprintf(NULL, 0, _STREAM_HEADERS, _STREAM_CONTENT_TYPE);
+        w->send_calls += 2;
+        w->headers_sent = true;
+    }
+    esp_err_t res = httpd_resp_send_chunk(w->req, _STREAM_BOUNDARY, blen);
+    if (res == ESP_OK) res = httpd_resp_send_chunk(w->req, part_buf, hlen);
+    if (res == ESP_OK) res = httpd_resp_send_chunk(w->req, (const char *)fb->buf, fb->len);
+    if (res == ESP_OK) {
+        // Each chunk is sent as size line, data and CRLF
+        w->wire_bytes += chunk_wire_size(blen) + chunk_wire_size(hlen) + chunk_wire_size(fb->len);
+        w->send_calls += 9;
+    }
+    return res;
+}
+
+// ==== Coalesced framing: one chunk, one writev per frame ====
+// SO_SNDTIMEO only bounds each call: a viewer whose stack keeps opening a
+// sliver of window makes every call return a little, so the frame as a
+// whole gets a deadline too.
+static esp_err_t writev_all(mjpeg_writer_t *w, struct iovec *iov, int iovcnt) {
+    int64_t start = esp_timer_get_time();
+    while (iovcnt > 0) {
+        ssize_t n = lwip_writev(w->sockfd, iov, iovcnt);
+        w->send_calls++;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return ESP_FAIL;
+        }
+        w->wire_bytes += n;
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+            if (w->send_timeout_us && esp_timer_get_time() - start > w->send_timeout_us) {
+                return ESP_ERR_TIMEOUT;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t send_chunked(mjpeg_writer_t *w, const camera_fb_t *fb, uint32_t seq) {
+    char part_buf[128];
+    char prefix[320];
+    size_t hlen = format_part_header(part_buf, sizeof(part_buf), fb, seq);
+    size_t chunk_len = strlen(_STREAM_BOUNDARY) + hlen + fb->len;
+
+    // [response headers] chunk-size CRLF boundary part-header | JPEG | CRLF
+    size_t off = 0;
+    if (!w->headers_sent) {
+        off += snprintf(prefix, sizeof(prefix), _STREAM_HEADERS, _STREAM_CONTENT_TYPE);
+    }
+    off += snprintf(prefix + off, sizeof(prefix) - off, "%x\r\n%s%s",
+                    (unsigned)chunk_len, _STREAM_BOUNDARY, part_buf);
+
+    struct iovec iov[3] = {
+        { .iov_base = prefix, .iov_len = off },
+        { .iov_base = fb->buf, .iov_len = fb->len },
+        { .iov_base = (void *)"\r\n", .iov_len = 2 },
+    };
+    esp_err_t res = writev_all(w, iov, 3);
+    if (res == ESP_OK) w->headers_sent = true;
+    return res;
+}
+
+// ==== Raw framing: plain multipart body, no chunk headers ====
+// lwIP has no TCP_CORK. Writing the whole part with one writev() has the
+// same effect: lwIP queues every vector but the last with TCP_WRITE_FLAG_MORE,
+// so full segments are built from the frame and PSH is set only at its end.
+// TCP_NODELAY then pushes that final short segment out at once instead of
+// holding it until the previous frame is ACKed.
+static esp_err_t send_raw(mjpeg_writer_t *w, const camera_fb_t *fb, uint32_t seq) {
+    char prefix[320];
+    size_t off = 0;
+    if (!w->headers_sent) {
+        int nodelay = 1;
+        lwip_setsockopt(w->sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        off += snprintf(prefix, sizeof(prefix), _STREAM_RAW_HEADERS, _STREAM_CONTENT_TYPE);
+    }
+    off += snprintf(prefix + off, sizeof(prefix) - off, "%s", _STREAM_BOUNDARY);
+    off += format_part_header(prefix + off, sizeof(prefix) - off, fb, seq);
+
+    struct iovec iov[2] = {
+        { .iov_base = prefix, .iov_len = off },
+        { .iov_base = fb->buf, .iov_len = fb->len },
+    };
+    esp_err_t res = writev_all(w, iov, 2);
+    if (res == ESP_OK) w->headers_sent = true;
+    return res;
+}
+
+esp_err_t mjpeg_writer_send(mjpeg_writer_t *w, const camera_fb_t *fb, uint32_t seq) {
+    esp_err_t res;
+    switch (w->framing) {
+    case MJPEG_FRAMING_CHUNKED:
+        res = send_chunked(w, fb, seq);
+        break;
+    case MJPEG_FRAMING_RAW:
+        res = send_raw(w, fb, seq);
+        break;
+    default:
+        res = send_parts(w, fb, seq);
+        break;
+    }
+    if (res == ESP_OK) w->frames++;
+    return res;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "esp_camera.h"
+
+// ==== MJPEG response writer ====
+// Frames a JPEG as one multipart/x-mixed-replace part and writes it to the
+// viewer, counting what actually goes out on the socket.
+typedef enum {
+    MJPEG_FRAMING_PARTS = 0,    // boundary, part header and JPEG as three httpd chunks
+    MJPEG_FRAMING_CHUNKED,      // one HTTP chunk per frame, written with a single writev()
+    MJPEG_FRAMING_RAW,          // no transfer encoding: parts go straight to the socket until close
+} mjpeg_framing_t;
+
+typedef struct {
+    httpd_req_t *req;
+    int sockfd;
+    mjpeg_framing_t framing;
+    bool headers_sent;
+    // 0 = none. A coalesced or raw frame still not out this long after its
+    // first write fails, however much the viewer keeps taking in trickles.
+    int64_t send_timeout_us;
+
+    uint32_t frames;
+    uint64_t wire_bytes;        // response headers, framing and payload
+    uint32_t send_calls;        // socket writes issued
+} mjpeg_writer_t;
+
+void mjpeg_writer_init(mjpeg_writer_t *w, httpd_req_t *req, mjpeg_framing_t framing);
+
+// Sends one frame as a part carrying X-Timestamp (fb->timestamp) and
+// X-Frame-Seq headers. Any error means the viewer is gone.
+esp_err_t mjpeg_writer_send(mjpeg_writer_t *w, const camera_fb_t *fb, uint32_t seq);
+
+const char *mjpeg_framing_name(mjpeg_framing_t framing);
+bool mjpeg_framing_from_str(const char *str, mjpeg_framing_t *framing);
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "motion.h"
+#include "frame_broadcaster.h"
+#include "thumbnail.h"
+#include "json_util.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "MOTION";
+
+#define MOTION_TASK_STACK   4096
+#define MOTION_TASK_PRIO    3       // below the stream workers
+
+// /motion buffer: every counter at its widest comes to about 350 bytes,
+// then up to ",255" per region
+#define MOTION_JSON_HEAD        384
+#define MOTION_JSON_PER_REGION  4
+
+static uint8_t s_luma[MOTION_THUMB_MAX_W * MOTION_THUMB_MAX_H];
+static motion_model_t s_model;
+
+// s_lock guards s_state and the listener table
+static SemaphoreHandle_t s_lock = NULL;
+static motion_state_t s_state;
+static bool s_have_state = false;
+static uint64_t s_decode_total_us = 0;
+
+static struct {
+    motion_listener_t fn;
+    void *arg;
+} s_listeners[MOTION_MAX_LISTENERS];
+
+static void analyse(const frame_t *frame) {
+    int64_t start = esp_timer_get_time();
+    int w, h;
+    if (thumbnail_luma(frame, s_luma, sizeof(s_luma), &w, &h) != ESP_OK) return;
+    motion_result_t result;
+    motion_model_update(&s_model, s_luma, w, h, &result);
+    uint32_t cost = (uint32_t)(esp_timer_get_time() - start);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool was_active = s_state.result.motion;
+    s_state.result = result;
+    s_state.frame_seq = frame->seq;
+    s_state.captured_us = frame->captured_us;
+    s_state.thumb_width = w;
+    s_state.thumb_height = h;
+    s_state.frames++;
+    s_decode_total_us += cost;
+    s_state.decode_avg_us = (uint32_t)(s_decode_total_us / s_state.frames);
+    if (cost > s_state.decode_max_us) s_state.decode_max_us = cost;
+    if (result.motion) {
+        s_state.last_motion_us = frame->captured_us;
+        if (!was_active) s_state.events++;
+    }
+    s_have_state = true;
+    motion_state_t snapshot = s_state;
+    xSemaphoreGive(s_lock);
+
+    if (result.motion != was_active) {
+        ESP_LOGI(TAG, "Motion %s (max region %u%%, event %" PRIu32 ")",
+                 result.motion ? "started" : "stopped", result.max_score, snapshot.events);
+    }
+    for (int i = 0; i < MOTION_MAX_LISTENERS; i++) {
+        // Registered once at startup and never removed, so no lock needed to call
+        if (s_listeners[i].fn) s_listeners[i].fn(&snapshot, s_listeners[i].arg);
+    }
+}
+
+// Passive, so motion detection alone never keeps capture running. While
+// viewers are attached it sees their frames at up to MOTION_FPS. With
+// MOTION_IDLE_PERIOD_MS set, a period without frames makes it ask for a
+// single one, which wakes a suspended sensor just for that frame.
+static void motion_task(void *arg) {
+    subscriber_t *sub = broadcaster_subscribe_passive();
+    if (!sub) {
+        ESP_LOGE(TAG, "No subscriber slot, motion detection off");
+        vTaskDelete(NULL);
+        return;
+    }
+    const TickType_t period = pdMS_TO_TICKS(1000 / MOTION_FPS);
+    TickType_t last_wake = xTaskGetTickCount();
+    for (;;) {
+        frame_t *frame = broadcaster_wait_frame(sub, MOTION_IDLE_PERIOD_MS ?
+                                                pdMS_TO_TICKS(MOTION_IDLE_PERIOD_MS) : portMAX_DELAY);
+        if (!frame) {
+            broadcaster_request_frame();
+            continue;
+        }
+        analyse(frame);
+        frame_release(frame);
+        xTaskDelayUntil(&last_wake, period);
+    }
+}
+
+esp_err_t motion_start(void) {
+#if MOTION_DETECT_ENABLE
+    if (s_lock) return ESP_ERR_INVALID_STATE;
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+    motion_model_reset(&s_model);
+    if (xTaskCreate(motion_task, "motion", MOTION_TASK_STACK, NULL, MOTION_TASK_PRIO, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Motion detection at up to %d fps, %dx%d regions, idle checks every %d ms (0 = off)",
+             MOTION_FPS, MOTION_REGIONS_X, MOTION_REGIONS_Y, MOTION_IDLE_PERIOD_MS);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+bool motion_get_state(motion_state_t *out) {
+    if (!s_lock) return false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool ok = s_have_state;
+    if (ok) *out = s_state;
+    xSemaphoreGive(s_lock);
+    return ok;
+}
+
+esp_err_t motion_add_listener(motion_listener_t fn, void *arg) {
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    esp_err_t err = ESP_ERR_NO_MEM;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < MOTION_MAX_LISTENERS; i++) {
+        if (!s_listeners[i].fn) {
+            s_listeners[i].arg = arg;
+            s_listeners[i].fn = fn;
+            err = ESP_OK;
+            break;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+esp_err_t motion_handler(httpd_req_t *req) {
+    motion_state_t st;
+    if (!motion_get_state(&st)) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "Motion detection not running");
+    }
+
+    char json[MOTION_JSON_HEAD + MOTION_REGIONS * MOTION_JSON_PER_REGION];
+    int64_t now = esp_timer_get_time();
+    size_t off = 0;
+    bool ok = json_append(json, sizeof(json), &off,
+        "{\"motion\":%s,\"warming_up\":%s,\"max_score\":%u,\"mean_diff\":%" PRIu32 ","
+        "\"frame_seq\":%" PRIu32 ",\"frame_age_us\":%lld,\"thumb\":\"%dx%d\","
+        "\"frames\":%" PRIu32 ",\"events\":%" PRIu32 ",\"last_motion_age_us\":%lld,"
+        "\"decode_avg_us\":%" PRIu32 ",\"decode_max_us\":%" PRIu32 ",\"grid\":\"%dx%d\",\"regions\":[",
+        st.result.motion ? "true" : "false", st.result.warming_up ? "true" : "false",
+        st.result.max_score, st.result.mean_diff,
+        st.frame_seq, (long long)(now - st.captured_us), st.thumb_width, st.thumb_height,
+        st.frames, st.events, st.last_motion_us ? (long long)(now - st.last_motion_us) : -1LL,
+        st.decode_avg_us, st.decode_max_us, MOTION_REGIONS_X, MOTION_REGIONS_Y);
+    for (int r = 0; r < MOTION_REGIONS && ok; r++) {
+        ok = json_append(json, sizeof(json), &off, "%s%u", r ? "," : "", st.result.score[r]);
+    }
+    ok = ok && json_append(json, sizeof(json), &off, "]}");
+    if (!ok) {
+        ESP_LOGE(TAG, "/motion does not fit in %u bytes", (unsigned)sizeof(json));
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return httpd_resp_sendstr(req, json);
+}
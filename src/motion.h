@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "motion_detect.h"
+
+// ==== Motion detection ====
+// A background task takes frames from the broadcaster, decodes them at 1/8
+// scale (DC coefficients only, no IDCT) and scores them with motion_detect.
+// Its subscription is passive: it does not keep capture running, so idle
+// suspend still works. The price is coverage: by default motion is only
+// analysed while someone is watching, and nothing is detected while the
+// camera sits idle. MOTION_IDLE_PERIOD_MS opts in to checks without
+// viewers, at the cost of waking the sensor for each one. Set
+// -DMOTION_DETECT_ENABLE=0 to leave it out entirely.
+#ifndef MOTION_DETECT_ENABLE
+#define MOTION_DETECT_ENABLE 1
+#endif
+
+// Frames analysed per second at most while viewers keep capture running;
+// the subscriber slot always hands over the newest frame, so a lower rate
+// just skips frames in between.
+#ifndef MOTION_FPS
+#define MOTION_FPS 5
+#endif
+
+// With nobody watching, request one frame after this long without one;
+// 0 = never, and the sensor stays suspended. Each request costs a standby
+// exit plus about a frame time of sensor activity, and anything shorter
+// than the period can be missed. Keep it in the tens of seconds unless
+// the board is on mains power.
+#ifndef MOTION_IDLE_PERIOD_MS
+#define MOTION_IDLE_PERIOD_MS 0
+#endif
+
+typedef struct {
+    motion_result_t result;     // last analysed frame
+    uint32_t frame_seq;         // its broadcaster sequence number
+    int64_t captured_us;
+    int thumb_width, thumb_height;
+    uint32_t frames;            // frames analysed
+    uint32_t events;            // quiet -> motion transitions
+    int64_t last_motion_us;     // 0 if never
+    uint32_t decode_avg_us;     // 1/8 decode plus scoring, per frame
+    uint32_t decode_max_us;
+} motion_state_t;
+
+// Called on the motion task after every analysed frame. Keep it short.
+typedef void (*motion_listener_t)(const motion_state_t *state, void *arg);
+
+#define MOTION_MAX_LISTENERS 4
+
+esp_err_t motion_start(void);
+
+// Copy of the latest state; false before the first analysed frame.
+bool motion_get_state(motion_state_t *out);
+
+// ESP_ERR_NO_MEM when MOTION_MAX_LISTENERS are already registered.
+esp_err_t motion_add_listener(motion_listener_t fn, void *arg);
+
+// GET /motion: the latest state with per-region scores, as JSON.
+esp_err_t motion_handler(httpd_req_t *req);
@@ -0,0 +1,78 @@
+#include <stdlib.h>
+#include <string.h>
+#include "motion_detect.h"
+
+void motion_model_reset(motion_model_t *m) {
+    m->width = 0;
+    m->height = 0;
+    m->frames = 0;
+}
+
+void motion_model_update(motion_model_t *m, const uint8_t *luma, int width, int height,
+                         motion_result_t *out) {
+    memset(out, 0, sizeof(*out));
+    if (width > MOTION_THUMB_MAX_W) width = MOTION_THUMB_MAX_W;
+    if (height > MOTION_THUMB_MAX_H) height = MOTION_THUMB_MAX_H;
+
+    if (m->width != width || m->height != height || m->frames == 0) {
+        m->width = width;
+        m->height = height;
+        m->frames = 0;
+        for (int i = 0; i < width * height; i++) m->bg[i] = luma[i] << 8;
+    }
+
+    uint32_t changed[MOTION_REGIONS] = { 0 };
+    uint32_t total[MOTION_REGIONS] = { 0 };
+    uint32_t diff_sum = 0;
+    for (int y = 0; y < height; y++) {
+        int ry = y * MOTION_REGIONS_Y / height;
+        const uint8_t *row = luma + y * width;
+        uint16_t *bg = m->bg + y * width;
+        for (int x = 0; x < width; x++) {
+            int r = ry * MOTION_REGIONS_X + x * MOTION_REGIONS_X / width;
+            int cur = row[x] << 8;
+            int d = abs(cur - bg[x]) >> 8;
+            diff_sum += d;
+            total[r]++;
+            if (d > MOTION_PIXEL_THRESHOLD) changed[r]++;
+            bg[x] += (cur - bg[x]) >> MOTION_BG_SHIFT;
+        }
+    }
+
+    m->frames++;
+    out->warming_up = m->frames <= MOTION_WARMUP_FRAMES;
+    int pixels = width * height;
+    out->mean_diff = pixels > 0 ? diff_sum / pixels : 0;
+    for (int r = 0; r < MOTION_REGIONS; r++) {
+        out->score[r] = total[r] ? (uint8_t)(changed[r] * 100 / total[r]) : 0;
+        if (out->score[r] > out->max_score) out->max_score = out->score[r];
+    }
+    out->motion = !out->warming_up && out->max_score >= MOTION_REGION_TRIGGER;
+}
+
+void scene_sig_compute(const uint8_t *luma, int width, int height, scene_sig_t *out) {
+    out->width = width;
+    out->height = height;
+    for (int cy = 0; cy < SCENE_SIG_H; cy++) {
+        int y0 = cy * height / SCENE_SIG_H, y1 = (cy + 1) * height / SCENE_SIG_H;
+        for (int cx = 0; cx < SCENE_SIG_W; cx++) {
+            int x0 = cx * width / SCENE_SIG_W, x1 = (cx + 1) * width / SCENE_SIG_W;
+            uint32_t sum = 0, n = 0;
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) sum += luma[y * width + x];
+                n += x1 - x0;
+            }
+            out->cell[cy * SCENE_SIG_W + cx] = n ? (uint8_t)(sum / n) : 0;
+        }
+    }
+}
+
+int scene_sig_distance(const scene_sig_t *a, const scene_sig_t *b) {
+    if (a->width != b->width || a->height != b->height) return 255;
+    int max = 0;
+    for (int i = 0; i < SCENE_SIG_W * SCENE_SIG_H; i++) {
+        int d = abs(a->cell[i] - b->cell[i]);
+        if (d > max) max = d;
+    }
+    return max;
+}
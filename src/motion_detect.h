@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// ==== Motion detection core ====
+// Works on 1/8-scale luma thumbnails, one pixel per 8x8 JPEG block. At 1/8
+// scale tjpgd fills each block from its DC coefficient alone and skips the
+// IDCT, so a thumbnail costs the entropy decode and little else. Plain C,
+// so the host benchmark (tools/motion_bench.c) runs the same code.
+//
+// The background is a running average per thumbnail pixel. A pixel counts
+// as changed when it differs from the background by more than
+// MOTION_PIXEL_THRESHOLD; each region's score is its share of changed
+// pixels, in percent.
+
+#define MOTION_THUMB_MAX_W      80      // VGA / 8
+#define MOTION_THUMB_MAX_H      60
+#define MOTION_REGIONS_X        4
+#define MOTION_REGIONS_Y        3
+#define MOTION_REGIONS          (MOTION_REGIONS_X * MOTION_REGIONS_Y)
+#define MOTION_PIXEL_THRESHOLD  20      // luma steps
+#define MOTION_REGION_TRIGGER   8       // percent of a region's pixels
+#define MOTION_BG_SHIFT         4       // background learns 1/16 per frame
+#define MOTION_WARMUP_FRAMES    8       // frames before scores are trusted
+
+typedef struct {
+    int width, height;              // thumbnail size the model was built for
+    uint32_t frames;
+    uint16_t bg[MOTION_THUMB_MAX_W * MOTION_THUMB_MAX_H];  // luma << 8
+} motion_model_t;
+
+typedef struct {
+    uint8_t score[MOTION_REGIONS];  // percent of changed pixels, row-major
+    uint8_t max_score;
+    uint32_t mean_diff;             // average |luma - background| over the frame
+    bool motion;                    // some region at or above MOTION_REGION_TRIGGER
+    bool warming_up;
+} motion_result_t;
+
+void motion_model_reset(motion_model_t *m);
+
+// Scores one thumbnail against the background, then folds it in. A size
+// change (the frame size manager switched resolution) restarts the model.
+void motion_model_update(motion_model_t *m, const uint8_t *luma, int width, int height,
+                         motion_result_t *out);
+
+// ==== Scene signature ====
+// A coarser grid of mean luma over the thumbnail, for telling whether two
+// frames show the same scene. Unlike the motion model it keeps no history:
+// the caller decides which earlier signature to compare against.
+#define SCENE_SIG_W 16
+#define SCENE_SIG_H 12
+
+typedef struct {
+    uint16_t width, height;     // thumbnail it was taken from
+    uint8_t cell[SCENE_SIG_W * SCENE_SIG_H];
+} scene_sig_t;
+
+void scene_sig_compute(const uint8_t *luma, int width, int height, scene_sig_t *out);
+
+// Largest per-cell luma difference; 255 when the thumbnail sizes differ.
+int scene_sig_distance(const scene_sig_t *a, const scene_sig_t *b);
@@ -0,0 +1,97 @@
+#include <string.h>
+#include "quality_ctrl.h"
+
+// A frame larger than the send buffer blocks briefly even on a fast link;
+// saturation means the writers spend most of the window waiting
+#define QUALITY_BLOCKED_SHARE 0.5f
+#define QUALITY_LINK_PROBE_DIV 16
+
+void quality_ctrl_init(quality_ctrl_t *qc, const quality_ctrl_config_t *cfg) {
+    memset(qc, 0, sizeof(*qc));
+    qc->cfg = *cfg;
+    qc->quality = cfg->initial_quality;
+    if (qc->quality < cfg->min_quality) qc->quality = cfg->min_quality;
+    if (qc->quality > cfg->max_quality) qc->quality = cfg->max_quality;
+}
+
+void quality_ctrl_add_frame(quality_ctrl_t *qc, size_t bytes, int64_t send_us, int64_t now_us) {
+    if (qc->window_start_us == 0) qc->window_start_us = now_us;
+    qc->bytes += bytes;
+    qc->send_us += send_us > 0 ? send_us : 0;
+    qc->frames++;
+}
+
+static uint32_t effective_target(const quality_ctrl_t *qc) {
+    uint32_t target = qc->cfg.target_kbps;
+    if (qc->link_kbps) {
+        uint32_t cap = (uint32_t)(qc->link_kbps * QUALITY_LINK_HEADROOM);
+        if (cap < target) target = cap;
+    }
+    return target;
+}
+
+bool quality_ctrl_update(quality_ctrl_t *qc, int64_t now_us) {
+    if (qc->window_start_us == 0) return false;
+    int64_t window = now_us - qc->window_start_us;
+    if (window < QUALITY_WINDOW_US) return false;
+
+    qc->sent_kbps = (uint32_t)(qc->bytes * 8000 / window);
+    qc->avg_frame_bytes = qc->frames ? (uint32_t)(qc->bytes / qc->frames) : 0;
+    bool saturated = qc->send_us > window * QUALITY_BLOCKED_SHARE;
+    if (saturated) {
+        // Several viewers blocking at once overlap; never count more than the window
+        uint64_t blocked = qc->send_us < (uint64_t)window ? qc->send_us : (uint64_t)window;
+        qc->link_kbps = (uint32_t)(qc->bytes * 8000 / blocked);
+    } else if (qc->link_kbps) {
+        // Probe back up slowly so one quiet window does not undo the back-off
+        qc->link_kbps += qc->link_kbps / QUALITY_LINK_PROBE_DIV;
+        if (qc->link_kbps >= qc->cfg.target_kbps) qc->link_kbps = 0;
+    }
+    // The next window starts empty; one with no viewers leaves it unset
+    qc->window_start_us = 0;
+    qc->bytes = 0;
+    qc->send_us = 0;
+    qc->frames = 0;
+
+    float ratio = (float)qc->sent_kbps / (float)effective_target(qc);
+    int old = qc->quality;
+    if (ratio > QUALITY_OVER_RATIO || saturated) {
+        // Frame size falls roughly 8% per quality step around the useful range
+        int step = (int)((ratio - 1.0f) / 0.08f);
+        if (step < 1) step = 1;
+        if (step > QUALITY_MAX_STEP) step = QUALITY_MAX_STEP;
+        qc->quality += step;
+        qc->under_windows = 0;
+    } else if (ratio < QUALITY_UNDER_RATIO) {
+        if (++qc->under_windows >= QUALITY_RECOVER_WINDOWS) {
+            qc->quality--;
+            qc->under_windows = 0;
+        }
+    } else {
+        qc->under_windows = 0;
+    }
+    if (qc->quality < qc->cfg.min_quality) qc->quality = qc->cfg.min_quality;
+    if (qc->quality > qc->cfg.max_quality) qc->quality = qc->cfg.max_quality;
+    if (qc->quality == old) return false;
+    qc->changes++;
+    return true;
+}
+
+void quality_ctrl_set_quality(quality_ctrl_t *qc, int quality) {
+    qc->quality = quality;
+    qc->window_start_us = 0;
+    qc->bytes = 0;
+    qc->send_us = 0;
+    qc->frames = 0;
+    qc->under_windows = 0;
+}
+
+void quality_ctrl_get_stats(const quality_ctrl_t *qc, quality_ctrl_stats_t *out) {
+    out->quality = qc->quality;
+    out->target_kbps = qc->cfg.target_kbps;
+    out->effective_kbps = effective_target(qc);
+    out->sent_kbps = qc->sent_kbps;
+    out->link_kbps = qc->link_kbps;
+    out->avg_frame_bytes = qc->avg_frame_bytes;
+    out->changes = qc->changes;
+}
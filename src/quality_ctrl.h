@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// ==== Adaptive JPEG quality ====
+// Holds the streamed bitrate near a budget by moving the sensor's JPEG
+// quality (lower number = better picture = bigger frames). Plain C with the
+// clock passed in, so recorded frame-size traces can be replayed on a host.
+//
+// Once per window the controller compares the bitrate actually sent with
+// the target. Over budget it backs off quickly, in proportion to the
+// overshoot; under budget it recovers one step at a time, and only after
+// QUALITY_RECOVER_WINDOWS quiet windows in a row. The band in between is a
+// dead zone, so a steady scene settles on one value instead of hunting.
+//
+// Send throughput is watched as well: a socket write only blocks once the
+// lwIP send buffer is full, so bytes / time-inside-send is a fair estimate
+// of the uplink when it saturates. While writes block the controller keeps
+// backing off, and the target stays capped below that estimate; the cap is
+// lifted gradually once the link keeps up again.
+
+#define QUALITY_WINDOW_US       (1000 * 1000)
+#define QUALITY_OVER_RATIO      1.10f   // back off above target * this
+#define QUALITY_UNDER_RATIO     0.75f   // recover below target * this
+#define QUALITY_RECOVER_WINDOWS 2
+#define QUALITY_MAX_STEP        4       // per window, backing off
+#define QUALITY_LINK_HEADROOM   0.85f   // share of a saturated link we aim for
+
+typedef struct {
+    uint32_t target_kbps;
+    int min_quality;            // best picture allowed
+    int max_quality;            // worst picture allowed
+    int initial_quality;
+} quality_ctrl_config_t;
+
+typedef struct {
+    quality_ctrl_config_t cfg;
+    int quality;
+
+    // Current window
+    int64_t window_start_us;    // 0 until the first frame
+    uint64_t bytes;
+    uint64_t send_us;
+    uint32_t frames;
+
+    int under_windows;          // consecutive windows below the recover line
+    uint32_t link_kbps;         // saturated uplink estimate, 0 once it keeps up
+
+    // Last closed window, for stats
+    uint32_t sent_kbps;
+    uint32_t avg_frame_bytes;
+    uint32_t changes;
+} quality_ctrl_t;
+
+typedef struct {
+    int quality;
+    uint32_t target_kbps;
+    uint32_t effective_kbps;    // target, capped by a saturated link
+    uint32_t sent_kbps;
+    uint32_t link_kbps;
+    uint32_t avg_frame_bytes;
+    uint32_t changes;
+} quality_ctrl_stats_t;
+
+void quality_ctrl_init(quality_ctrl_t *qc, const quality_ctrl_config_t *cfg);
+
+// One frame went out: its JPEG size and how long the write blocked.
+void quality_ctrl_add_frame(quality_ctrl_t *qc, size_t bytes, int64_t send_us, int64_t now_us);
+
+// Closes the window if it is over. Returns true when the quality changed;
+// the new value is in qc->quality.
+bool quality_ctrl_update(quality_ctrl_t *qc, int64_t now_us);
+
+// Takes a quality set from outside (pinned by hand, or the value to resume
+// from) and starts a fresh window, so the next decision only sees frames
+// sent at it. The link estimate is kept.
+void quality_ctrl_set_quality(quality_ctrl_t *qc, int quality);
+
+void quality_ctrl_get_stats(const quality_ctrl_t *qc, quality_ctrl_stats_t *out);
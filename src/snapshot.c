@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <string.h>
+#include "snapshot.h"
+#include "frame_broadcaster.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+
+static const char *TAG = "SNAPSHOT";
+
+// Sequence numbers restart at every boot; the boot id keeps old ETags from matching
+static uint32_t s_boot_id = 0;
+
+// The retained frame, or one fresh capture if it is missing or stale and no
+// stream is keeping it up to date.
+static frame_t *snapshot_frame(void) {
+    frame_t *frame = broadcaster_latest();
+    if (frame && (broadcaster_subscriber_count() > 0 ||
+                  esp_timer_get_time() - frame->captured_us <= SNAPSHOT_MAX_AGE_MS * 1000LL)) {
+        return frame;
+    }
+
+    // Subscribing wakes the capture task for one frame; the slot gets it
+    subscriber_t *sub = broadcaster_subscribe();
+    if (!sub) return frame;
+    frame_t *fresh = broadcaster_wait_frame(sub, 1000 / portTICK_PERIOD_MS);
+    broadcaster_unsubscribe(sub);
+    if (!fresh) {
+        ESP_LOGW(TAG, "No fresh frame, serving the retained one");
+        return frame;
+    }
+    frame_release(frame);
+    return fresh;
+}
+
+esp_err_t capture_handler(httpd_req_t *req) {
+    if (!s_boot_id) s_boot_id = esp_random() | 1;
+
+    frame_t *frame = snapshot_frame();
+    if (!frame) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No frame available");
+        return ESP_FAIL;
+    }
+
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"%08lx-%lu\"", (unsigned long)s_boot_id, (unsigned long)frame->seq);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    // Let caches keep the image but make them ask before reusing it
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    char inm[64];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", inm, sizeof(inm)) == ESP_OK &&
+        strstr(inm, etag) != NULL) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        esp_err_t res = httpd_resp_send(req, NULL, 0);
+        frame_release(frame);
+        return res;
+    }
+
+    char ts[32];
+    char seq[12];
+    snprintf(ts, sizeof(ts), "%d.%06d", (int)frame->fb.timestamp.tv_sec, (int)frame->fb.timestamp.tv_usec);
+    snprintf(seq, sizeof(seq), "%lu", (unsigned long)frame->seq);
+    httpd_resp_set_type(req, "image/jpeg");
+    httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
+    httpd_resp_set_hdr(req, "X-Timestamp", ts);
+    httpd_resp_set_hdr(req, "X-Frame-Seq", seq);
+    // Sent straight from the shared frame; the reference keeps it alive meanwhile
+    esp_err_t res = httpd_resp_send(req, (const char *)frame->fb.buf, frame->fb.len);
+    frame_release(frame);
+    return res;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+// A retained frame younger than this is served as is while nobody streams.
+// Older ones trigger a single fresh capture, so pollers cost at most one
+// sensor frame per period no matter how often they ask.
+#define SNAPSHOT_MAX_AGE_MS 1000
+
+// GET /capture: the newest frame as image/jpeg, with an ETag keyed on its
+// sequence number. If-None-Match on the same frame gets a 304.
+esp_err_t capture_handler(httpd_req_t *req);
@@ -0,0 +1,442 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+#include "stream.h"
+#include "frame_broadcaster.h"
+#include "frame_pacer.h"
+#include "mjpeg_writer.h"
+#include "camera_capture.h"
+#include "boot_timeline.h"
+#include "thumbnail.h"
+#include "json_util.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "STREAM";
+
+#define STREAM_WORKER_STACK 4096
+#define STREAM_WORKER_PRIO  5
+#define STREAM_STATS_PERIOD_US (10 * 1000 * 1000)
+#define STREAM_SEND_TIMEOUT_MS 3000     // a frame not out after this long drops the viewer
+#ifndef STREAM_IDLE_TIMEOUT_MS
+#define STREAM_IDLE_TIMEOUT_MS 10000    // tear down after this long without a frame sent
+#endif
+#define STREAM_KEEPALIVE_MAX_S (STREAM_IDLE_TIMEOUT_MS / 1000 - 1)
+// /stats buffer: worst cases with every counter at its widest are about
+// 820 bytes before the session list and 560 per session
+#define STATS_JSON_HEAD         896
+#define STATS_JSON_PER_SESSION  640
+
+// A viewer waiting for a worker
+typedef struct {
+    httpd_req_t *req;   // async copy, completed by the worker
+    int fps;
+    mjpeg_framing_t framing;
+    bool suppress;      // skip frames that show the same scene
+    int keepalive_s;
+    int64_t accepted_us;    // stream_handler() entry, for time to first frame
+} stream_job_t;
+
+static QueueHandle_t s_session_queue;       // stream_job_t waiting for a worker
+static SemaphoreHandle_t s_free_workers;    // counts idle workers
+
+// ==== Session registry ====
+// One slot per worker. s_sessions_lock guards `active` and `sub`, so /stats
+// never looks at a session while it is being torn down.
+typedef struct {
+    bool active;
+    int sockfd;
+    int64_t started_us;
+    int64_t last_sent_us;       // last frame that went out completely
+    int64_t accepted_us;
+    uint32_t first_frame_us;    // request to first frame written, 0 until then
+    bool first_retained;        // that frame was the retained one
+    subscriber_t *sub;
+    frame_pacer_t pacer;
+    mjpeg_writer_t writer;
+
+    // Static-scene suppression
+    bool suppress;
+    int64_t keepalive_us;
+    bool have_sig;
+    scene_sig_t last_sig;       // of the last frame sent
+    uint32_t suppressed;
+    uint64_t suppressed_bytes;
+} stream_session_t;
+
+static stream_session_t s_sessions[STREAM_MAX_SESSIONS];
+static SemaphoreHandle_t s_sessions_lock;
+
+// Time to first frame over all sessions so far, guarded by s_sessions_lock
+typedef struct {
+    uint32_t sessions;
+    uint32_t retained;          // first frame came from the retained slot
+    uint64_t total_us;
+    uint32_t last_us;
+    uint32_t max_us;
+} first_frame_stats_t;
+
+static first_frame_stats_t s_ttff;
+static bool s_first_frame_sent = false;     // since boot, for the boot timeline; same lock
+
+int stream_active_sessions(void) {
+    int count = 0;
+    xSemaphoreTake(s_sessions_lock, portMAX_DELAY);
+    for (int i = 0; i < STREAM_MAX_SESSIONS; i++) {
+        if (s_sessions[i].active) count++;
+    }
+    xSemaphoreGive(s_sessions_lock);
+    return count;
+}
+
+static void log_session_stats(stream_session_t *s) {
+    pacer_stats_t st;
+    subscriber_stats_t sst;
+    pacer_get_stats(&s->pacer, &st);
+    broadcaster_get_stats(s->sub, &sst);
+    uint32_t frames = s->writer.frames ? s->writer.frames : 1;
+    ESP_LOGI(TAG, "Socket %d: %" PRIu32 " frames, %.1f/%d fps, jitter %" PRIu32 " us, %s: %" PRIu64 " B/frame, %.1f sends/frame",
+             s->sockfd, st.frames, st.achieved_fps, st.requested_fps, st.jitter_us,
+             mjpeg_framing_name(s->writer.framing), s->writer.wire_bytes / frames,
+             (float)s->writer.send_calls / frames);
+    ESP_LOGI(TAG, "Socket %d: %" PRIu32 " dropped, slot residency avg %" PRIu32 " us, max %" PRIu32 " us",
+             s->sockfd, sst.dropped, sst.residency_avg_us, sst.residency_max_us);
+    ESP_LOGI(TAG, "Socket %d: frame age avg %" PRIu32 " us, max %" PRIu32 " us, %" PRIu32 " stale skipped",
+             s->sockfd, sst.age_avg_us, sst.age_max_us, sst.stale);
+    if (s->suppress) {
+        ESP_LOGI(TAG, "Socket %d: %" PRIu32 " static frames suppressed, %" PRIu64 " KB saved",
+                 s->sockfd, s->suppressed, s->suppressed_bytes / 1024);
+    }
+}
+
+// True if `frame` shows the same scene as the last frame sent and the
+// keepalive is not due. Otherwise remembers its signature as the new
+// reference, since it is about to be sent. A frame that does not decode
+// is always sent.
+static bool static_frame(stream_session_t *s, const frame_t *frame, int64_t now) {
+    scene_sig_t sig;
+    if (thumbnail_signature(frame, &sig) != ESP_OK) return false;
+    if (s->have_sig && now - s->last_sent_us < s->keepalive_us &&
+        scene_sig_distance(&sig, &s->last_sig) <= STREAM_STATIC_THRESHOLD) {
+        return true;
+    }
+    s->last_sig = sig;
+    s->have_sig = true;
+    return false;
+}
+
+// A viewer that closes its tab sends a FIN, and our sends keep succeeding
+// until its RST comes back. Peek for the EOF so we stop right away.
+static bool peer_closed(int sockfd) {
+    char c;
+    int n = lwip_recv(sockfd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n == 0) return true;
+    return n < 0 && errno != EAGAIN && errno != EWOULDBLOCK;
+}
+
+static esp_err_t session_open(stream_session_t *s, httpd_req_t *req, const stream_job_t *job) {
+    if (pacer_init(&s->pacer, job->fps) != ESP_OK) return ESP_ERR_NO_MEM;
+    subscriber_t *sub = STREAM_PRIME_FIRST_FRAME ? broadcaster_subscribe_primed() : broadcaster_subscribe();
+    if (!sub) {
+        pacer_deinit(&s->pacer);
+        return ESP_ERR_NO_MEM;
+    }
+    mjpeg_writer_init(&s->writer, req, job->framing);
+    s->writer.send_timeout_us = STREAM_SEND_TIMEOUT_MS * 1000LL;
+    s->sockfd = s->writer.sockfd;
+    s->started_us = esp_timer_get_time();
+    s->last_sent_us = s->started_us;
+    s->accepted_us = job->accepted_us;
+    s->first_frame_us = 0;
+    s->first_retained = false;
+    s->suppress = job->suppress;
+    s->keepalive_us = job->keepalive_s * 1000000LL;
+    s->have_sig = false;
+    s->suppressed = 0;
+    s->suppressed_bytes = 0;
+
+    // Bound how long a viewer that stopped reading can block a send; the
+    // writer bounds the frame as a whole
+    struct timeval tv = { .tv_sec = STREAM_SEND_TIMEOUT_MS / 1000,
+                          .tv_usec = (STREAM_SEND_TIMEOUT_MS % 1000) * 1000 };
+    lwip_setsockopt(s->sockfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    xSemaphoreTake(s_sessions_lock, portMAX_DELAY);
+    s->sub = sub;
+    s->active = true;
+    xSemaphoreGive(s_sessions_lock);
+    return ESP_OK;
+}
+
+// Drops the subscription, and with it any frame still waiting in its slot.
+static void session_close(stream_session_t *s) {
+    log_session_stats(s);
+    xSemaphoreTake(s_sessions_lock, portMAX_DELAY);
+    s->active = false;
+    subscriber_t *sub = s->sub;
+    s->sub = NULL;
+    xSemaphoreGive(s_sessions_lock);
+    broadcaster_unsubscribe(sub);
+    pacer_deinit(&s->pacer);
+}
+
+static void record_first_frame(stream_session_t *s) {
+    // The primed frame, if still there, is always the first one delivered
+    subscriber_stats_t sst;
+    broadcaster_get_stats(s->sub, &sst);
+    bool retained = sst.primed > 0;
+    uint32_t took = (uint32_t)(s->last_sent_us - s->accepted_us);
+    xSemaphoreTake(s_sessions_lock, portMAX_DELAY);
+    s->first_frame_us = took ? took : 1;
+    s->first_retained = retained;
+    s_ttff.sessions++;
+    if (retained) s_ttff.retained++;
+    s_ttff.total_us += took;
+    s_ttff.last_us = took;
+    if (took > s_ttff.max_us) s_ttff.max_us = took;
+    bool first_since_boot = !s_first_frame_sent;
+    s_first_frame_sent = true;
+    xSemaphoreGive(s_sessions_lock);
+    if (first_since_boot) boot_mark("first_frame_sent");
+    ESP_LOGI(TAG, "Socket %d: first frame out %" PRIu32 " us after the request (%s)",
+             s->sockfd, took, retained ? "retained" : "live");
+}
+
+// Runs on a worker task until the viewer goes away or stalls.
+static esp_err_t stream_session_run(stream_session_t *s, httpd_req_t *req, const stream_job_t *job) {
+    esp_err_t res = session_open(s, req, job);
+    if (res != ESP_OK) {
+        httpd_resp_send_500(req);
+        return res;
+    }
+    int64_t next_report = s->started_us + STREAM_STATS_PERIOD_US;
+    while (true) {
+        int64_t now = esp_timer_get_time();
+        if (now - s->last_sent_us > STREAM_IDLE_TIMEOUT_MS * 1000LL) {
+            ESP_LOGW(TAG, "Socket %d: no frame sent for %d ms", s->sockfd, STREAM_IDLE_TIMEOUT_MS);
+            res = ESP_ERR_TIMEOUT;
+            break;
+        }
+        if (peer_closed(s->sockfd)) {
+            res = ESP_ERR_INVALID_STATE;
+            break;
+        }
+
+        bool late = pacer_wait(&s->pacer);
+        frame_t *frame = broadcaster_wait_frame(s->sub, 1000 / portTICK_PERIOD_MS);
+        if (!frame) {
+            ESP_LOGW(TAG, "No frame from capture task");
+            continue;
+        }
+        if (s->suppress && static_frame(s, frame, esp_timer_get_time())) {
+            s->suppressed++;
+            s->suppressed_bytes += frame->fb.len;
+            frame_release(frame);
+            continue;
+        }
+        int64_t send_start = esp_timer_get_time();
+        res = mjpeg_writer_send(&s->writer, &frame->fb, frame->seq);
+        size_t jpeg_bytes = frame->fb.len;
+        frame_release(frame);
+        if (res != ESP_OK) break;
+        camera_report_frame(jpeg_bytes, esp_timer_get_time() - send_start, late);
+
+        pacer_frame_sent(&s->pacer);
+        s->last_sent_us = esp_timer_get_time();
+        if (!s->first_frame_us) record_first_frame(s);
+        if (s->last_sent_us >= next_report) {
+            log_session_stats(s);
+            next_report += STREAM_STATS_PERIOD_US;
+        }
+    }
+    session_close(s);
+    return res;
+}
+
+static void stream_worker_task(void *arg) {
+    stream_session_t *session = (stream_session_t *)arg;
+    while (true) {
+        stream_job_t job;
+        xQueueReceive(s_session_queue, &job, portMAX_DELAY);
+        httpd_req_t *req = job.req;
+
+        int sockfd = httpd_req_to_sockfd(req);
+        ESP_LOGI(TAG, "Stream started on socket %d at %d fps, %s framing%s",
+                 sockfd, job.fps, mjpeg_framing_name(job.framing),
+                 job.suppress ? ", static frames suppressed" : "");
+        esp_err_t res = stream_session_run(session, req, &job);
+        ESP_LOGI(TAG, "Stream on socket %d ended: %s, %d active",
+                 sockfd, esp_err_to_name(res), stream_active_sessions());
+        if (res != ESP_OK || job.framing == MJPEG_FRAMING_RAW) {
+            // The viewer is gone, or the body was delimited by connection close
+            httpd_sess_trigger_close(req->handle, sockfd);
+        }
+        httpd_req_async_handler_complete(req);
+        xSemaphoreGive(s_free_workers);
+    }
+}
+
+esp_err_t stream_workers_start(void) {
+    s_session_queue = xQueueCreate(STREAM_MAX_SESSIONS, sizeof(stream_job_t));
+    s_free_workers = xSemaphoreCreateCounting(STREAM_MAX_SESSIONS, STREAM_MAX_SESSIONS);
+    s_sessions_lock = xSemaphoreCreateMutex();
+    if (!s_session_queue || !s_free_workers || !s_sessions_lock) return ESP_ERR_NO_MEM;
+
+    for (int i = 0; i < STREAM_MAX_SESSIONS; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "stream_%d", i);
+        if (xTaskCreate(stream_worker_task, name, STREAM_WORKER_STACK, &s_sessions[i],
+                        STREAM_WORKER_PRIO, NULL) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to start stream worker %d", i);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+// ==== HTTP handler ====
+// ?fps=N, clamped to [1, STREAM_MAX_FPS]
+// ?framing=parts|chunked|raw
+// ?suppress=0|1, ?keepalive=N seconds, clamped to [1, STREAM_KEEPALIVE_MAX_S]
+static void parse_stream_query(httpd_req_t *req, stream_job_t *job) {
+    char query[96];
+    char val[16];
+    job->fps = STREAM_DEFAULT_FPS;
+    job->framing = MJPEG_FRAMING_CHUNKED;
+    job->suppress = STREAM_SUPPRESS_DEFAULT;
+    job->keepalive_s = STREAM_KEEPALIVE_S < STREAM_KEEPALIVE_MAX_S ? STREAM_KEEPALIVE_S : STREAM_KEEPALIVE_MAX_S;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) return;
+
+    if (httpd_query_key_value(query, "fps", val, sizeof(val)) == ESP_OK) {
+        job->fps = atoi(val);
+        if (job->fps < 1) job->fps = 1;
+        if (job->fps > STREAM_MAX_FPS) job->fps = STREAM_MAX_FPS;
+    }
+    if (httpd_query_key_value(query, "framing", val, sizeof(val)) == ESP_OK &&
+        !mjpeg_framing_from_str(val, &job->framing)) {
+        ESP_LOGW(TAG, "Unknown framing '%s'", val);
+    }
+    if (httpd_query_key_value(query, "suppress", val, sizeof(val)) == ESP_OK) {
+        job->suppress = atoi(val) != 0;
+    }
+    if (httpd_query_key_value(query, "keepalive", val, sizeof(val)) == ESP_OK) {
+        job->keepalive_s = atoi(val);
+        if (job->keepalive_s < 1) job->keepalive_s = 1;
+        if (job->keepalive_s > STREAM_KEEPALIVE_MAX_S) job->keepalive_s = STREAM_KEEPALIVE_MAX_S;
+    }
+}
+
+esp_err_t stream_handler(httpd_req_t *req) {
+    stream_job_t job;
+    job.accepted_us = esp_timer_get_time();
+    parse_stream_query(req, &job);
+    if (xSemaphoreTake(s_free_workers, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "All %d stream workers busy", STREAM_MAX_SESSIONS);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_sendstr(req, "Too many viewers");
+        return ESP_OK;
+    }
+
+    httpd_req_t *copy = NULL;
+    esp_err_t err = httpd_req_async_handler_begin(req, &copy);
+    if (err != ESP_OK) {
+        xSemaphoreGive(s_free_workers);
+        return err;
+    }
+    // Cannot fail: a free worker slot means there is room in the queue
+    job.req = copy;
+    xQueueSend(s_session_queue, &job, 0);
+    return ESP_OK;
+}
+
+// GET /stats: capture and per-viewer counters as JSON
+esp_err_t stream_stats_handler(httpd_req_t *req) {
+    const size_t cap = STATS_JSON_HEAD + STREAM_MAX_SESSIONS * STATS_JSON_PER_SESSION;
+    char *json = malloc(cap);
+    if (!json) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    // uptime_us is on the same clock as X-Timestamp, for host-side latency tools
+    capture_stats_t cst;
+    quality_ctrl_stats_t qst;
+    camera_framesize_stats_t fst;
+    thumbnail_stats_t tst;
+    broadcaster_get_capture_stats(&cst);
+    camera_quality_get_stats(&qst);
+    camera_framesize_get_stats(&fst);
+    thumbnail_get_stats(&tst);
+    xSemaphoreTake(s_sessions_lock, portMAX_DELAY);
+    first_frame_stats_t ttff = s_ttff;
+    xSemaphoreGive(s_sessions_lock);
+    size_t off = 0;
+    bool ok = json_append(json, cap, &off, "{\"uptime_us\":%" PRId64 ",\"subscribers\":%d,\"active_sessions\":%d,"
+                          "\"capture\":{\"frames\":%" PRIu32 ",\"driver_age_avg_us\":%" PRIu32 ",\"driver_age_max_us\":%" PRIu32 ","
+                          "\"suspended\":%s,\"suspends\":%" PRIu32 ",\"resume_last_us\":%" PRIu32 ",\"resume_max_us\":%" PRIu32 ",\"samples\":%" PRIu32 "},"
+                          "\"quality\":{\"value\":%d,\"target_kbps\":%" PRIu32 ",\"effective_kbps\":%" PRIu32 ","
+                          "\"sent_kbps\":%" PRIu32 ",\"link_kbps\":%" PRIu32 ",\"avg_frame_bytes\":%" PRIu32 ",\"changes\":%" PRIu32 "},"
+                          "\"framesize\":{\"current\":\"%s\",\"max\":\"%s\",\"late_ratio\":%.2f,\"changes\":%" PRIu32 "},"
+                          "\"thumbnail\":{\"decodes\":%" PRIu32 ",\"hits\":%" PRIu32 ",\"decode_avg_us\":%" PRIu32 ","
+                          "\"decode_max_us\":%" PRIu32 "},"
+                          "\"first_frame\":{\"sessions\":%" PRIu32 ",\"retained\":%" PRIu32 ",\"last_us\":%" PRIu32 ","
+                          "\"avg_us\":%" PRIu32 ",\"max_us\":%" PRIu32 "},"
+                          "\"sessions\":[",
+                          esp_timer_get_time(), broadcaster_subscriber_count(), stream_active_sessions(),
+                          cst.frames, cst.driver_age_avg_us, cst.driver_age_max_us,
+                          cst.suspended ? "true" : "false", cst.suspends, cst.resume_last_us, cst.resume_max_us, cst.samples,
+                          qst.quality, qst.target_kbps, qst.effective_kbps, qst.sent_kbps, qst.link_kbps,
+                          qst.avg_frame_bytes, qst.changes,
+                          fst.name, fst.max_name ? fst.max_name : "", fst.late_ratio, fst.changes,
+                          tst.decodes, tst.hits, tst.decode_avg_us, tst.decode_max_us,
+                          ttff.sessions, ttff.retained, ttff.last_us,
+                          ttff.sessions ? (uint32_t)(ttff.total_us / ttff.sessions) : 0, ttff.max_us);
+
+    // Snapshot under the lock so s->sub stays valid; send after releasing it
+    int64_t now = esp_timer_get_time();
+    bool first = true;
+    xSemaphoreTake(s_sessions_lock, portMAX_DELAY);
+    for (int i = 0; i < STREAM_MAX_SESSIONS && ok; i++) {
+        stream_session_t *s = &s_sessions[i];
+        if (!s->active) continue;
+        pacer_stats_t st;
+        subscriber_stats_t sst;
+        pacer_get_stats(&s->pacer, &st);
+        broadcaster_get_stats(s->sub, &sst);
+        uint32_t frames = s->writer.frames ? s->writer.frames : 1;
+        ok = json_append(json, cap, &off,
+                         "%s{\"socket\":%d,\"framing\":\"%s\",\"age_ms\":%" PRId64 ","
+                         "\"fps\":%d,\"achieved_fps\":%.2f,\"jitter_us\":%" PRIu32 ",\"frames\":%" PRIu32 ",\"late\":%" PRIu32 ","
+                         "\"dropped\":%" PRIu32 ",\"residency_avg_us\":%" PRIu32 ",\"residency_max_us\":%" PRIu32 ","
+                         "\"stale\":%" PRIu32 ",\"frame_age_avg_us\":%" PRIu32 ",\"frame_age_max_us\":%" PRIu32 ","
+                         "\"wire_bytes_per_frame\":%" PRIu64 ",\"sends_per_frame\":%.2f,"
+                         "\"suppress\":%s,\"suppressed\":%" PRIu32 ",\"suppressed_bytes\":%" PRIu64 ","
+                         "\"first_frame_us\":%" PRIu32 ",\"first_retained\":%s}",
+                         first ? "" : ",", s->sockfd, mjpeg_framing_name(s->writer.framing),
+                         (now - s->started_us) / 1000, st.requested_fps, st.achieved_fps, st.jitter_us,
+                         st.frames, st.late, sst.dropped, sst.residency_avg_us, sst.residency_max_us,
+                         sst.stale, sst.age_avg_us, sst.age_max_us,
+                         s->writer.wire_bytes / frames, (float)s->writer.send_calls / frames,
+                         s->suppress ? "true" : "false", s->suppressed, s->suppressed_bytes,
+                         s->first_frame_us, s->first_retained ? "true" : "false");
+        first = false;
+    }
+    xSemaphoreGive(s_sessions_lock);
+    ok = ok && json_append(json, cap, &off, "]}");
+    if (!ok) {
+        ESP_LOGE(TAG, "/stats does not fit in %u bytes", (unsigned)cap);
+        free(json);
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t res = httpd_resp_sendstr(req, json);
+    free(json);
+    return res;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+// Number of /stream viewers served at the same time. Each one runs on its
+// own worker task so the httpd task stays free for control endpoints.
+#define STREAM_MAX_SESSIONS 4
+
+// Per-viewer frame rate, selected with /stream?fps=N
+#define STREAM_DEFAULT_FPS 20
+#define STREAM_MAX_FPS     30
+
+// Static-scene suppression, per viewer with /stream?suppress=1: frames whose
+// scene signature (see thumbnail.h) is within STREAM_STATIC_THRESHOLD luma
+// steps of the last frame sent are not sent. A keepalive frame still goes
+// out every STREAM_KEEPALIVE_S seconds (?keepalive=N), so players do not
+// time out. Build with -DSTREAM_SUPPRESS_DEFAULT=1 to make it the default.
+#ifndef STREAM_SUPPRESS_DEFAULT
+#define STREAM_SUPPRESS_DEFAULT 0
+#endif
+#ifndef STREAM_STATIC_THRESHOLD
+#define STREAM_STATIC_THRESHOLD 6
+#endif
+#ifndef STREAM_KEEPALIVE_S
+#define STREAM_KEEPALIVE_S 5
+#endif
+
+// A new viewer gets the retained newest frame the moment its stream opens,
+// then live frames. Build with -DSTREAM_PRIME_FIRST_FRAME=0 to make viewers
+// wait for the next capture instead.
+#ifndef STREAM_PRIME_FIRST_FRAME
+#define STREAM_PRIME_FIRST_FRAME 1
+#endif
+
+// Creates the stream worker pool. Call before registering stream_handler.
+esp_err_t stream_workers_start(void);
+
+// GET /stream: hands the request to a free worker and returns immediately.
+esp_err_t stream_handler(httpd_req_t *req);
+
+// Viewers currently being served
+int stream_active_sessions(void);
+
+// GET /stats: per-viewer pacing, drop and framing counters, time to first
+// frame and shared thumbnail decode counters, as JSON
+esp_err_t stream_stats_handler(httpd_req_t *req);
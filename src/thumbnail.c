@@ -0,0 +1,110 @@
+#include <string.h>
+#include <inttypes.h>
+#include "thumbnail.h"
+#include "jpeg_decoder.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "THUMB";
+
+#define THUMB_WORKBUF_SIZE 3100     // tjpgd scratch, independent of the image size
+
+// s_lock guards everything below, including the decode buffers
+static SemaphoreHandle_t s_lock = NULL;
+
+static uint8_t s_workbuf[THUMB_WORKBUF_SIZE] __attribute__((aligned(4)));
+
+// Cache: the last frame decoded
+static uint32_t s_seq = 0;      // 0 = empty
+static bool s_ok = false;
+static uint8_t s_luma[MOTION_THUMB_MAX_W * MOTION_THUMB_MAX_H];
+static int s_width, s_height;
+static scene_sig_t s_sig;
+
+static thumbnail_stats_t s_stats;
+static uint64_t s_decode_total_us = 0;
+
+esp_err_t thumbnail_init(void) {
+    if (!s_lock) s_lock = xSemaphoreCreateMutex();
+    return s_lock ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static bool lock(void) {
+    if (!s_lock) return false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    return true;
+}
+
+// Fills the cache for `frame` unless it already holds it. Called locked.
+static void refresh(const frame_t *frame) {
+    if (s_seq == frame->seq) {
+        s_stats.hits++;
+        return;
+    }
+    int64_t start = esp_timer_get_time();
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = frame->fb.buf,
+        .indata_size = frame->fb.len,
+        .outbuf = s_luma,
+        .outbuf_size = sizeof(s_luma),
+        .out_format = JPEG_IMAGE_FORMAT_GRAY8,      // luma straight from tjpgd, chroma never reaches the IDCT
+        .out_scale = JPEG_IMAGE_SCALE_1_8,
+        .advanced = {
+            .working_buffer = s_workbuf,
+            .working_buffer_size = sizeof(s_workbuf),
+        },
+    };
+    esp_jpeg_image_output_t img;
+    s_seq = frame->seq;
+    s_ok = esp_jpeg_decode(&cfg, &img) == ESP_OK;
+    if (!s_ok) {
+        ESP_LOGW(TAG, "Frame %" PRIu32 ": 1/8 decode failed", frame->seq);
+        return;
+    }
+    s_width = img.width;
+    s_height = img.height;
+    scene_sig_compute(s_luma, s_width, s_height, &s_sig);
+
+    uint32_t cost = (uint32_t)(esp_timer_get_time() - start);
+    s_stats.decodes++;
+    s_decode_total_us += cost;
+    s_stats.decode_avg_us = (uint32_t)(s_decode_total_us / s_stats.decodes);
+    if (cost > s_stats.decode_max_us) s_stats.decode_max_us = cost;
+}
+
+esp_err_t thumbnail_luma(const frame_t *frame, uint8_t *luma, size_t cap, int *width, int *height) {
+    if (!lock()) return ESP_ERR_INVALID_STATE;
+    refresh(frame);
+    esp_err_t err = ESP_FAIL;
+    if (s_ok) {
+        err = ESP_ERR_INVALID_SIZE;
+        if ((size_t)(s_width * s_height) <= cap) {
+            memcpy(luma, s_luma, s_width * s_height);
+            *width = s_width;
+            *height = s_height;
+            err = ESP_OK;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+esp_err_t thumbnail_signature(const frame_t *frame, scene_sig_t *out) {
+    if (!lock()) return ESP_ERR_INVALID_STATE;
+    refresh(frame);
+    esp_err_t err = s_ok ? ESP_OK : ESP_FAIL;
+    if (s_ok) *out = s_sig;
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+void thumbnail_get_stats(thumbnail_stats_t *out) {
+    if (!lock()) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    *out = s_stats;
+    xSemaphoreGive(s_lock);
+}
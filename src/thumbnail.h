@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "frame_broadcaster.h"
+#include "motion_detect.h"
+
+// ==== Shared thumbnail ====
+// 1/8-scale luma of a frame (tjpgd's DC-only path), decoded at most once per
+// frame: the result for the newest sequence number is cached, so the motion
+// detector and every viewer suppressing static scenes share one decode.
+
+// Creates the cache lock. Call once at boot, before any frame is captured.
+esp_err_t thumbnail_init(void);
+
+// Copies the thumbnail into `luma` (cap bytes, MOTION_THUMB_MAX_W *
+// MOTION_THUMB_MAX_H is always enough). ESP_ERR_INVALID_SIZE if it does not
+// fit, ESP_FAIL if the JPEG does not decode, ESP_ERR_INVALID_STATE before
+// thumbnail_init().
+esp_err_t thumbnail_luma(const frame_t *frame, uint8_t *luma, size_t cap, int *width, int *height);
+
+// The frame's scene signature, see scene_sig_compute().
+esp_err_t thumbnail_signature(const frame_t *frame, scene_sig_t *out);
+
+// Decode and cache-hit counters, reported in /stats
+typedef struct {
+    uint32_t decodes;
+    uint32_t hits;              // served from the cache
+    uint32_t decode_avg_us;
+    uint32_t decode_max_us;
+} thumbnail_stats_t;
+
+void thumbnail_get_stats(thumbnail_stats_t *out);
@@ -0,0 +1,130 @@
+#include <string.h>
+#include "wifi_fast.h"
+#include "esp_log.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+
+static const char *TAG = "WIFI_FAST";
+
+#define WIFI_CACHE_NS  "wifi_cache"
+#define WIFI_CACHE_KEY "last_ap"
+
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+    esp_netif_ip_info_t ip;
+    esp_ip4_addr_t dns;
+} wifi_cache_t;
+
+static wifi_cache_t s_cache;
+static bool s_cache_valid = false;
+static bool s_fast_active = false;
+
+static bool cache_load(wifi_cache_t *out) {
+    nvs_handle_t h;
+    if (nvs_open(WIFI_CACHE_NS, NVS_READONLY, &h) != ESP_OK) return false;
+    size_t len = sizeof(*out);
+    esp_err_t err = nvs_get_blob(h, WIFI_CACHE_KEY, out, &len);
+    nvs_close(h);
+    return err == ESP_OK && len == sizeof(*out) && out->channel != 0;
+}
+
+// Field by field: the struct has padding, which a blob round trip need not keep
+static bool cache_equal(const wifi_cache_t *a, const wifi_cache_t *b) {
+    return memcmp(a->bssid, b->bssid, sizeof(a->bssid)) == 0 && a->channel == b->channel &&
+           a->ip.ip.addr == b->ip.ip.addr && a->ip.netmask.addr == b->ip.netmask.addr &&
+           a->ip.gw.addr == b->ip.gw.addr && a->dns.addr == b->dns.addr;
+}
+
+// Writes the STA config to RAM only, so the hints never reach the Wi-Fi
+// driver's own NVS copy and a stale BSSID cannot outlive re-provisioning.
+// Storage goes back to flash for provisioning to persist credentials.
+static esp_err_t set_config_in_ram(wifi_config_t *cfg) {
+    esp_wifi_set_storage(WIFI_STORAGE_RAM);
+    esp_err_t err = esp_wifi_set_config(WIFI_IF_STA, cfg);
+    esp_wifi_set_storage(WIFI_STORAGE_FLASH);
+    return err;
+}
+
+static void cache_store(const wifi_cache_t *c) {
+    nvs_handle_t h;
+    if (nvs_open(WIFI_CACHE_NS, NVS_READWRITE, &h) != ESP_OK) return;
+    if (nvs_set_blob(h, WIFI_CACHE_KEY, c, sizeof(*c)) == ESP_OK) nvs_commit(h);
+    nvs_close(h);
+}
+
+bool wifi_fast_apply(esp_netif_t *sta_netif) {
+    s_cache_valid = cache_load(&s_cache);
+    if (!s_cache_valid) return false;
+
+    wifi_config_t cfg;
+    if (esp_wifi_get_config(WIFI_IF_STA, &cfg) != ESP_OK) return false;
+    cfg.sta.bssid_set = true;
+    memcpy(cfg.sta.bssid, s_cache.bssid, sizeof(cfg.sta.bssid));
+    cfg.sta.channel = s_cache.channel;
+    cfg.sta.scan_method = WIFI_FAST_SCAN;
+    if (set_config_in_ram(&cfg) != ESP_OK) return false;
+    s_fast_active = true;
+    ESP_LOGI(TAG, "Cached AP %02x:%02x:%02x:%02x:%02x:%02x on channel %d%s",
+             s_cache.bssid[0], s_cache.bssid[1], s_cache.bssid[2],
+             s_cache.bssid[3], s_cache.bssid[4], s_cache.bssid[5], s_cache.channel,
+             WIFI_CACHED_STATIC_IP ? ", static lease" : "");
+    return true;
+}
+
+void wifi_fast_on_connected(esp_netif_t *sta_netif) {
+    if (!WIFI_CACHED_STATIC_IP || !s_fast_active || !sta_netif) return;
+    // Setting the address on a connected interface posts IP_EVENT_STA_GOT_IP
+    esp_netif_dhcpc_stop(sta_netif);
+    if (esp_netif_set_ip_info(sta_netif, &s_cache.ip) != ESP_OK) {
+        ESP_LOGW(TAG, "Static lease rejected, using DHCP");
+        esp_netif_dhcpc_start(sta_netif);
+        return;
+    }
+    esp_netif_dns_info_t dns = { 0 };
+    dns.ip.type = ESP_IPADDR_TYPE_V4;
+    dns.ip.u_addr.ip4 = s_cache.dns;
+    esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+}
+
+void wifi_fast_save(esp_netif_t *sta_netif, const esp_netif_ip_info_t *ip) {
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) return;
+    wifi_cache_t c = { 0 };
+    memcpy(c.bssid, ap.bssid, sizeof(c.bssid));
+    c.channel = ap.primary;
+    c.ip = *ip;
+    esp_netif_dns_info_t dns;
+    if (sta_netif && esp_netif_get_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK) {
+        c.dns = dns.ip.u_addr.ip4;
+    }
+    // Flash writes only when something moved, not on every boot
+    if (s_cache_valid && cache_equal(&c, &s_cache)) return;
+    s_cache = c;
+    s_cache_valid = true;
+    cache_store(&c);
+    ESP_LOGI(TAG, "Cached AP and lease updated");
+}
+
+bool wifi_fast_active(void) {
+    return s_fast_active;
+}
+
+void wifi_fast_fallback(esp_netif_t *sta_netif) {
+    s_fast_active = false;
+    wifi_config_t cfg;
+    if (esp_wifi_get_config(WIFI_IF_STA, &cfg) == ESP_OK) {
+        cfg.sta.bssid_set = false;
+        cfg.sta.channel = 0;
+        cfg.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        // To flash: also clears hints an older firmware may have persisted
+        esp_wifi_set_config(WIFI_IF_STA, &cfg);
+    }
+    if (WIFI_CACHED_STATIC_IP && sta_netif) esp_netif_dhcpc_start(sta_netif);
+}
+
+uint32_t wifi_backoff_ms(int attempt) {
+    uint32_t delay = WIFI_BACKOFF_BASE_MS;
+    for (int i = 0; i < attempt && delay < WIFI_BACKOFF_MAX_MS; i++) delay *= 2;
+    return delay < WIFI_BACKOFF_MAX_MS ? delay : WIFI_BACKOFF_MAX_MS;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_netif.h"
+
+// ==== Fast reconnect ====
+// The AP (BSSID + channel) and the IP lease of the last good connection are
+// kept in NVS. The next boot connects straight to that AP on that channel
+// instead of scanning every channel, and can optionally take the old lease
+// as a static address to skip DHCP. The first failure on the fast path
+// drops the hints and falls back to a full scan with DHCP.
+
+// Reuse the cached lease as a static address. Only safe when the router
+// reserves the address for this device, so off unless asked for.
+#ifndef WIFI_CACHED_STATIC_IP
+#define WIFI_CACHED_STATIC_IP 0
+#endif
+
+// Retry delays after a failed connect: 250 ms, doubling up to the cap
+#define WIFI_BACKOFF_BASE_MS 250
+#define WIFI_BACKOFF_MAX_MS  4000
+
+// Before esp_wifi_start(): points the STA config at the cached AP.
+// Returns true if a cache entry was applied.
+bool wifi_fast_apply(esp_netif_t *sta_netif);
+
+// On WIFI_EVENT_STA_CONNECTED: sets the static address, if enabled.
+void wifi_fast_on_connected(esp_netif_t *sta_netif);
+
+// On IP_EVENT_STA_GOT_IP: stores the AP and lease if they changed.
+void wifi_fast_save(esp_netif_t *sta_netif, const esp_netif_ip_info_t *ip);
+
+// True while the fast path is still being tried
+bool wifi_fast_active(void);
+
+// Drops the cached hints from the STA config and restores DHCP, so the next
+// connect does a full scan.
+void wifi_fast_fallback(esp_netif_t *sta_netif);
+
+uint32_t wifi_backoff_ms(int attempt);
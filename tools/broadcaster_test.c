@@ -0,0 +1,449 @@
+// Host test for frame_broadcaster, driven by a mock camera. The firmware's
+// FreeRTOS calls run on pthreads through the stand-ins in tools/host.
+//
+// Covers frame references through subscribe/unsubscribe, slow-subscriber
+// drops, primed and passive subscribers, and idle suspend with the
+// single-frame samples taken for passive subscribers.
+//
+// Build and run from the repository root:
+//     gcc -O2 -Wall -pthread -o broadcaster_test -I tools/host -I src
+//         tools/broadcaster_test.c tools/host/freertos_host.c
+//         src/frame_broadcaster.c && ./broadcaster_test
+//
+// (one command line). Exits non-zero if any check fails. Add
+// -fsanitize=address,undefined to check the frame lifetimes as well.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "frame_broadcaster.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#define IDLE_SUSPEND_MS     100
+#define FRAME_PERIOD_US     2000
+
+static int s_failed = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            s_failed++; \
+        } \
+    } while (0)
+
+// ==== Mock camera ====
+// Hands out a frame every FRAME_PERIOD_US, as many as allowed: -1 runs
+// free, 0 blocks get() until more are allowed. Frame n is 64 + n % 64
+// bytes of n, so a copy can be checked without keeping the original. Like
+// the driver's ring, the first frame after a resume predates the suspend;
+// it is already there, so it comes at once and outside the allowance.
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int allowed;
+    uint32_t n;
+    bool suspended;
+    int64_t suspended_us;
+    int64_t resumed_us;
+    bool stale_pending;
+    uint32_t gets, puts, suspends, resumes;
+    uint32_t get_while_suspended;
+} s_cam = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .allowed = -1,
+};
+
+static camera_fb_t *mock_camera_fb_get(void *ctx) {
+    pthread_mutex_lock(&s_cam.lock);
+    int64_t stamp = 0;
+    if (s_cam.stale_pending) {
+        stamp = s_cam.suspended_us;
+        s_cam.stale_pending = false;
+    } else {
+        while (s_cam.allowed == 0) pthread_cond_wait(&s_cam.cond, &s_cam.lock);
+        if (s_cam.allowed > 0) s_cam.allowed--;
+    }
+    if (s_cam.suspended) s_cam.get_while_suspended++;
+    uint32_t n = ++s_cam.n;
+    s_cam.gets++;
+    pthread_mutex_unlock(&s_cam.lock);
+
+    if (!stamp) usleep(FRAME_PERIOD_US);
+    size_t len = 64 + n % 64;
+    camera_fb_t *fb = malloc(sizeof(camera_fb_t) + len);
+    fb->buf = (uint8_t *)(fb + 1);
+    fb->len = len;
+    fb->width = 320;
+    fb->height = 240;
+    fb->format = PIXFORMAT_JPEG;
+    memset(fb->buf, (uint8_t)n, len);
+    if (!stamp) stamp = esp_timer_get_time();
+    fb->timestamp.tv_sec = stamp / 1000000;
+    fb->timestamp.tv_usec = stamp % 1000000;
+    return fb;
+}
+
+static void mock_camera_fb_return(void *ctx, camera_fb_t *fb) {
+    pthread_mutex_lock(&s_cam.lock);
+    s_cam.puts++;
+    pthread_mutex_unlock(&s_cam.lock);
+    free(fb);
+}
+
+static esp_err_t mock_camera_suspend(void *ctx) {
+    pthread_mutex_lock(&s_cam.lock);
+    s_cam.suspended = true;
+    s_cam.suspended_us = esp_timer_get_time();
+    s_cam.suspends++;
+    pthread_mutex_unlock(&s_cam.lock);
+    return ESP_OK;
+}
+
+static esp_err_t mock_camera_resume(void *ctx) {
+    pthread_mutex_lock(&s_cam.lock);
+    s_cam.suspended = false;
+    s_cam.resumed_us = esp_timer_get_time();
+    s_cam.stale_pending = true;
+    s_cam.resumes++;
+    pthread_mutex_unlock(&s_cam.lock);
+    return ESP_OK;
+}
+
+static void mock_camera_allow(int frames) {
+    pthread_mutex_lock(&s_cam.lock);
+    s_cam.allowed = frames;
+    pthread_cond_broadcast(&s_cam.cond);
+    pthread_mutex_unlock(&s_cam.lock);
+}
+
+static bool mock_camera_suspended(void) {
+    pthread_mutex_lock(&s_cam.lock);
+    bool suspended = s_cam.suspended;
+    pthread_mutex_unlock(&s_cam.lock);
+    return suspended;
+}
+
+// Driver buffers handed out and not yet returned
+static int mock_camera_outstanding(void) {
+    pthread_mutex_lock(&s_cam.lock);
+    int n = (int)(s_cam.gets - s_cam.puts);
+    pthread_mutex_unlock(&s_cam.lock);
+    return n;
+}
+
+// ==== Helpers ====
+static bool frame_intact(const frame_t *frame) {
+    uint8_t n = frame->fb.buf[0];
+    if (frame->fb.len != 64 + n % 64u) return false;
+    for (size_t i = 0; i < frame->fb.len; i++) {
+        if (frame->fb.buf[i] != n) return false;
+    }
+    return true;
+}
+
+// Polls `cond` for up to `ms`; true once it holds
+#define WAIT_FOR(cond, ms) ({ \
+        bool ok_ = false; \
+        for (int t_ = 0; t_ < (ms) && !(ok_ = (cond)); t_++) usleep(1000); \
+        ok_; \
+    })
+
+static uint32_t frames_published(void) {
+    capture_stats_t cst;
+    broadcaster_get_capture_stats(&cst);
+    return cst.frames;
+}
+
+// Camera stopped and nothing in flight: every frame taken is published
+static void hold_camera(void) {
+    mock_camera_allow(0);
+    usleep(4 * FRAME_PERIOD_US);
+}
+
+// ==== Tests ====
+static void test_refcounts(void) {
+    hold_camera();
+    subscriber_t *a = broadcaster_subscribe();
+    subscriber_t *b = broadcaster_subscribe();
+    subscriber_t *p = broadcaster_subscribe_passive();
+    CHECK(a && b && p);
+    CHECK(broadcaster_subscriber_count() == 2);
+
+    // One frame goes to every slot, plus the retained reference
+    mock_camera_allow(1);
+    frame_t *fa = broadcaster_wait_frame(a, 1000);
+    frame_t *fb = broadcaster_wait_frame(b, 1000);
+    frame_t *fp = broadcaster_wait_frame(p, 1000);
+    CHECK(fa && fa == fb && fa == fp);
+    if (!fa || fa != fb || fa != fp) return;
+    CHECK(frame_intact(fa));
+    CHECK(fa->refs == 4);
+    CHECK(frame_ref(fa) == fa);
+    CHECK(fa->refs == 5);
+    frame_release(fa);
+    frame_release(fa);
+    frame_release(fb);
+    frame_release(fp);
+    CHECK(fa->refs == 1);
+    CHECK(host_heap_caps_live() == 1);
+
+    // The next one replaces it as the retained frame, which frees it
+    uint32_t seq = fa->seq;
+    mock_camera_allow(1);
+    frame_t *g = broadcaster_wait_frame(a, 1000);
+    CHECK(g && g->seq == seq + 1);
+    if (!g) return;
+    CHECK(frame_intact(g));
+    CHECK(host_heap_caps_live() == 1);
+    CHECK(g->refs == 4);    // retained, a's, and pending in b's and p's slots
+
+    // Leaving drops what is still in the slot
+    broadcaster_unsubscribe(b);
+    broadcaster_unsubscribe(p);
+    CHECK(broadcaster_subscriber_count() == 1);
+    CHECK(g->refs == 2);
+    frame_release(g);
+    broadcaster_unsubscribe(a);
+    CHECK(broadcaster_subscriber_count() == 0);
+    CHECK(g->refs == 1);
+
+    frame_t *latest = broadcaster_latest();
+    CHECK(latest == g);
+    frame_release(latest);
+
+    // The capture task is blocked in get(); let it finish and go idle
+    mock_camera_allow(-1);
+    CHECK(WAIT_FOR(mock_camera_outstanding() == 0, 500));
+    CHECK(host_heap_caps_live() == 1);
+}
+
+typedef struct {
+    subscriber_t *sub;
+    volatile bool stop;
+    SemaphoreHandle_t done;
+} reader_t;
+
+static void fast_reader(void *arg) {
+    reader_t *r = arg;
+    while (!r->stop) {
+        frame_t *frame = broadcaster_wait_frame(r->sub, 50);
+        if (frame && !frame_intact(frame)) s_failed++;
+        frame_release(frame);
+    }
+    xSemaphoreGive(r->done);
+    vTaskDelete(NULL);
+}
+
+static void test_slow_subscriber(void) {
+    hold_camera();
+    reader_t fast = { .sub = broadcaster_subscribe(), .done = xSemaphoreCreateBinary() };
+    subscriber_t *slow = broadcaster_subscribe();
+    CHECK(fast.sub && slow);
+    if (!fast.sub || !slow) return;
+    uint32_t before = frames_published();
+    CHECK(xTaskCreate(fast_reader, "fast", 4096, &fast, 5, NULL) == pdPASS);
+    mock_camera_allow(-1);
+
+    // The slow one takes a frame every ten capture periods
+    uint32_t last_seq = 0;
+    bool in_order = true;
+    for (int i = 0; i < 30; i++) {
+        frame_t *frame = broadcaster_wait_frame(slow, 1000);
+        CHECK(frame);
+        if (!frame) break;
+        if (frame->seq <= last_seq) in_order = false;
+        last_seq = frame->seq;
+        CHECK(frame_intact(frame));
+        frame_release(frame);
+        usleep(10 * FRAME_PERIOD_US);
+    }
+    CHECK(in_order);
+
+    hold_camera();
+    uint32_t published = frames_published() - before;
+    frame_release(broadcaster_wait_frame(slow, 0));
+    fast.stop = true;
+    xSemaphoreTake(fast.done, portMAX_DELAY);
+    frame_release(broadcaster_wait_frame(fast.sub, 0));
+
+    subscriber_stats_t sst, fst;
+    broadcaster_get_stats(slow, &sst);
+    broadcaster_get_stats(fast.sub, &fst);
+    printf("  %u published; slow: %u delivered, %u dropped; fast: %u delivered, %u dropped\n",
+           (unsigned)published, (unsigned)sst.delivered, (unsigned)sst.dropped,
+           (unsigned)fst.delivered, (unsigned)fst.dropped);
+
+    // Every frame published reached the slot: taken, or replaced unseen
+    CHECK(sst.delivered + sst.dropped == published);
+    CHECK(fst.delivered + fst.dropped == published);
+    CHECK(sst.dropped > sst.delivered);
+    // The slow one never held the fast one back
+    CHECK(fst.delivered > 2 * sst.delivered);
+    CHECK(fst.dropped < published / 4);
+    CHECK(sst.stale == 0 && sst.primed == 0);
+
+    broadcaster_unsubscribe(slow);
+    broadcaster_unsubscribe(fast.sub);
+    vSemaphoreDelete(fast.done);
+    mock_camera_allow(-1);
+    CHECK(WAIT_FOR(mock_camera_outstanding() == 0, 500));
+    CHECK(host_heap_caps_live() == 1);
+}
+
+static void test_primed(void) {
+    hold_camera();
+    frame_t *latest = broadcaster_latest();
+    CHECK(latest);
+    if (!latest) return;
+    uint32_t latest_seq = latest->seq;
+
+    // The retained frame is there at once, with the camera stopped
+    subscriber_t *sub = broadcaster_subscribe_primed();
+    frame_t *frame = broadcaster_wait_frame(sub, 0);
+    CHECK(frame && frame == latest);
+    subscriber_stats_t sst;
+    broadcaster_get_stats(sub, &sst);
+    CHECK(sst.primed == 1 && sst.delivered == 0);
+    frame_release(frame);
+    frame_release(latest);
+
+    // Overtaken before it is taken, it does not count as a drop
+    broadcaster_unsubscribe(sub);
+    sub = broadcaster_subscribe_primed();
+    mock_camera_allow(1);
+    usleep(4 * FRAME_PERIOD_US);
+    frame = broadcaster_wait_frame(sub, 1000);
+    CHECK(frame && frame->seq > latest_seq);
+    broadcaster_get_stats(sub, &sst);
+    CHECK(sst.dropped == 0 && sst.primed == 0 && sst.delivered == 1);
+    frame_release(frame);
+    broadcaster_unsubscribe(sub);
+    mock_camera_allow(-1);
+    CHECK(WAIT_FOR(mock_camera_outstanding() == 0, 500));
+}
+
+static void test_idle_suspend(void) {
+    mock_camera_allow(-1);
+    CHECK(broadcaster_subscriber_count() == 0);
+    CHECK(WAIT_FOR(mock_camera_suspended(), 5 * IDLE_SUSPEND_MS));
+    capture_stats_t cst;
+    broadcaster_get_capture_stats(&cst);
+    CHECK(cst.suspended);
+    CHECK(mock_camera_outstanding() == 0);
+
+    // The next viewer resumes it; the frame left over from before the
+    // suspend is thrown away
+    uint32_t suspends = cst.suspends;
+    subscriber_t *sub = broadcaster_subscribe();
+    frame_t *frame = broadcaster_wait_frame(sub, 1000);
+    CHECK(frame);
+    CHECK(!mock_camera_suspended());
+    if (frame) CHECK(frame->captured_us >= s_cam.resumed_us);
+    frame_release(frame);
+    broadcaster_get_capture_stats(&cst);
+    CHECK(!cst.suspended);
+    // Recorded by the capture task just after it published the frame
+    CHECK(WAIT_FOR((broadcaster_get_capture_stats(&cst), cst.resume_last_us > 0), 100));
+    CHECK(s_cam.get_while_suspended == 0);
+    broadcaster_unsubscribe(sub);
+
+    // And it goes back to sleep once left alone again
+    CHECK(WAIT_FOR(mock_camera_suspended(), 5 * IDLE_SUSPEND_MS));
+    broadcaster_get_capture_stats(&cst);
+    CHECK(cst.suspends == suspends + 1);
+}
+
+static void test_passive_samples(void) {
+    mock_camera_allow(-1);
+    CHECK(WAIT_FOR(mock_camera_suspended(), 5 * IDLE_SUSPEND_MS));
+    capture_stats_t before, after;
+    broadcaster_get_capture_stats(&before);
+    uint32_t resumes = s_cam.resumes;
+
+    // A passive subscriber alone does not wake the camera
+    subscriber_t *p = broadcaster_subscribe_passive();
+    CHECK(broadcaster_subscriber_count() == 0);
+    CHECK(broadcaster_wait_frame(p, 50) == NULL);
+    CHECK(mock_camera_suspended());
+
+    // Asking for a frame does, for that one frame only
+    for (int i = 0; i < 3; i++) {
+        int64_t asked = esp_timer_get_time();
+        broadcaster_request_frame();
+        frame_t *frame = broadcaster_wait_frame(p, 1000);
+        CHECK(frame);
+        if (frame) CHECK(frame->captured_us >= asked);
+        frame_release(frame);
+        CHECK(WAIT_FOR(mock_camera_suspended(), 100));
+    }
+    broadcaster_get_capture_stats(&after);
+    CHECK(after.samples == before.samples + 3);
+    CHECK(after.suspends == before.suspends);
+    CHECK(after.suspended);
+    CHECK(s_cam.resumes == resumes + 3);
+    CHECK(s_cam.get_while_suspended == 0);
+    CHECK(broadcaster_subscriber_count() == 0);
+
+    // With a viewer attached it gets the viewer's frames without asking
+    subscriber_t *sub = broadcaster_subscribe();
+    frame_t *frame = broadcaster_wait_frame(p, 1000);
+    CHECK(frame);
+    frame_release(frame);
+    broadcaster_unsubscribe(sub);
+    broadcaster_unsubscribe(p);
+    CHECK(WAIT_FOR(mock_camera_outstanding() == 0, 500));
+    CHECK(host_heap_caps_live() == 1);
+}
+
+int main(void) {
+    static const frame_source_t source = {
+        .get = mock_camera_fb_get,
+        .put = mock_camera_fb_return,
+        .suspend = mock_camera_suspend,
+        .resume = mock_camera_resume,
+    };
+    static const broadcaster_config_t config = {
+        .core = tskNO_AFFINITY,
+        .max_age_ms = 0,
+        .idle_suspend_ms = IDLE_SUSPEND_MS,
+    };
+    // Before the start (camera init failed): /stats must still get answers
+    capture_stats_t cst;
+    memset(&cst, 0xff, sizeof(cst));
+    broadcaster_get_capture_stats(&cst);
+    CHECK(cst.frames == 0 && !cst.suspended && cst.samples == 0);
+    CHECK(broadcaster_subscriber_count() == 0);
+    CHECK(broadcaster_subscribe() == NULL);
+
+    if (broadcaster_start(&source, &config) != ESP_OK) {
+        printf("broadcaster_start failed\n");
+        return 1;
+    }
+    CHECK(broadcaster_latest() == NULL);
+
+    static const struct {
+        const char *name;
+        void (*fn)(void);
+    } tests[] = {
+        { "idle suspend", test_idle_suspend },
+        { "refcounts", test_refcounts },
+        { "slow subscriber", test_slow_subscriber },
+        { "primed subscriber", test_primed },
+        { "passive samples", test_passive_samples },
+    };
+    int failed_tests = 0;
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        int before = s_failed;
+        tests[i].fn();
+        printf("%-30s %s\n", tests[i].name, s_failed == before ? "ok" : "FAILED");
+        if (s_failed != before) failed_tests++;
+    }
+    printf("%d of %zu failed\n", failed_tests, sizeof(tests) / sizeof(tests[0]));
+    return s_failed ? 1 : 0;
+}
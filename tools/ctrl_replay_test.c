@@ -0,0 +1,493 @@
+// Host replay test for the two stream controllers, quality_ctrl and
+// framesize_ctrl. Both are plain C with the clock passed in, so synthetic
+// windows are fed straight in and every decision is checked: step-down,
+// step-up, the dead zone and counters between them, saturation, and the
+// hold-off after a change. Then a recorded frame trace is replayed through
+// both, and every decision has to match the one recorded.
+//
+// Build and run from the repository root:
+//     gcc -O2 -Wall -o ctrl_replay_test -I src tools/ctrl_replay_test.c
+//         src/quality_ctrl.c src/framesize_ctrl.c
+//         && ./ctrl_replay_test [trace.csv]
+//
+// (one command line). Exits non-zero if any check fails. The default trace
+// is tools/traces/link_drop.csv; see tools/ctrl_trace_record.c for how it
+// was made and CAMERA_TRACE_FRAMES for logging one on the device.
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "quality_ctrl.h"
+#include "framesize_ctrl.h"
+
+#define FRAMES_PER_WINDOW 10
+
+static int s_failed = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            s_failed++; \
+        } \
+    } while (0)
+
+// ==== quality_ctrl ====
+static const quality_ctrl_config_t QC_CFG = {
+    .target_kbps = 1000,
+    .min_quality = 10,
+    .max_quality = 40,
+    .initial_quality = 20,
+};
+
+// One window sent at `kbps`, with the writes blocked for `blocked` of it.
+// Returns what quality_ctrl_update() said when the window closed.
+static bool qc_window(quality_ctrl_t *qc, int64_t *now, uint32_t kbps, float blocked) {
+    int64_t start = *now;
+    size_t bytes = (size_t)kbps * (QUALITY_WINDOW_US / 1000) / 8 / FRAMES_PER_WINDOW;
+    int64_t send_us = (int64_t)(QUALITY_WINDOW_US * blocked) / FRAMES_PER_WINDOW;
+    for (int i = 0; i < FRAMES_PER_WINDOW; i++) {
+        quality_ctrl_add_frame(qc, bytes, send_us, start + i * (QUALITY_WINDOW_US / FRAMES_PER_WINDOW));
+        CHECK(!quality_ctrl_update(qc, start + i * (QUALITY_WINDOW_US / FRAMES_PER_WINDOW)));
+    }
+    *now = start + QUALITY_WINDOW_US;
+    return quality_ctrl_update(qc, *now);
+}
+
+static void test_quality_step_down(void) {
+    quality_ctrl_t qc;
+    int64_t now = 1;
+    quality_ctrl_init(&qc, &QC_CFG);
+
+    // 20% over: two steps of about 8% each
+    CHECK(qc_window(&qc, &now, 1200, 0.1f));
+    CHECK(qc.quality == 22);
+    CHECK(qc.sent_kbps == 1200);
+
+    // Far over: capped at QUALITY_MAX_STEP per window
+    CHECK(qc_window(&qc, &now, 3000, 0.1f));
+    CHECK(qc.quality == 22 + QUALITY_MAX_STEP);
+
+    // And never past the worst quality allowed
+    for (int i = 0; i < 10; i++) qc_window(&qc, &now, 3000, 0.1f);
+    CHECK(qc.quality == QC_CFG.max_quality);
+    CHECK(!qc_window(&qc, &now, 3000, 0.1f));
+    CHECK(qc.changes == 6);
+}
+
+static void test_quality_step_up(void) {
+    quality_ctrl_t qc;
+    int64_t now = 1;
+    quality_ctrl_init(&qc, &QC_CFG);
+
+    // One step per QUALITY_RECOVER_WINDOWS quiet windows in a row
+    for (int step = 1; step <= 3; step++) {
+        for (int i = 1; i < QUALITY_RECOVER_WINDOWS; i++) {
+            CHECK(!qc_window(&qc, &now, 500, 0.1f));
+        }
+        CHECK(qc_window(&qc, &now, 500, 0.1f));
+        CHECK(qc.quality == 20 - step);
+    }
+
+    // Down to the best quality allowed, then no further
+    for (int i = 0; i < 40; i++) qc_window(&qc, &now, 500, 0.1f);
+    CHECK(qc.quality == QC_CFG.min_quality);
+}
+
+static void test_quality_dead_zone(void) {
+    quality_ctrl_t qc;
+    int64_t now = 1;
+    quality_ctrl_init(&qc, &QC_CFG);
+
+    // Between the recover and back-off lines nothing moves
+    static const uint32_t steady[] = { 760, 900, 1000, 1090, 800, 1050 };
+    for (size_t i = 0; i < sizeof(steady) / sizeof(steady[0]); i++) {
+        CHECK(!qc_window(&qc, &now, steady[i], 0.1f));
+    }
+    CHECK(qc.quality == 20);
+
+    // A dead-zone window in between restarts the quiet count
+    for (int i = 0; i < 5; i++) {
+        CHECK(!qc_window(&qc, &now, 500, 0.1f));
+        CHECK(!qc_window(&qc, &now, 900, 0.1f));
+    }
+    CHECK(qc.quality == 20);
+    CHECK(qc.changes == 0);
+
+    // So does an over-budget one, which backs off at once
+    CHECK(!qc_window(&qc, &now, 500, 0.1f));
+    CHECK(qc_window(&qc, &now, 1200, 0.1f));
+    CHECK(qc.quality == 22);
+    CHECK(!qc_window(&qc, &now, 500, 0.1f));
+    CHECK(qc.quality == 22);
+}
+
+static void test_quality_saturation(void) {
+    quality_ctrl_t qc;
+    quality_ctrl_stats_t st;
+    int64_t now = 1;
+    quality_ctrl_init(&qc, &QC_CFG);
+
+    // Well inside the budget, but the writes blocked for 80% of the window:
+    // back off anyway and cap the target below the measured link
+    CHECK(qc_window(&qc, &now, 600, 0.8f));
+    CHECK(qc.quality == 21);
+    CHECK(qc.link_kbps == 750);
+    quality_ctrl_get_stats(&qc, &st);
+    CHECK(st.effective_kbps == (uint32_t)(750 * QUALITY_LINK_HEADROOM));
+
+    // 800 kbps fits the target but not the capped one, so that backs off too
+    CHECK(qc_window(&qc, &now, 800, 0.1f));
+    CHECK(qc.quality == 23);
+
+    // Once the link keeps up, the cap is probed back up to nothing
+    int windows = 0;
+    while (qc.link_kbps && windows < 20) {
+        uint32_t before = qc.link_kbps;
+        qc_window(&qc, &now, 400, 0.1f);
+        CHECK(qc.link_kbps == 0 || qc.link_kbps > before);
+        windows++;
+    }
+    CHECK(qc.link_kbps == 0);
+    CHECK(windows > 1);
+    quality_ctrl_get_stats(&qc, &st);
+    CHECK(st.effective_kbps == QC_CFG.target_kbps);
+}
+
+static void test_quality_set(void) {
+    quality_ctrl_t qc;
+    int64_t now = 1;
+    quality_ctrl_init(&qc, &QC_CFG);
+
+    // No frames, no window, no decision
+    CHECK(!quality_ctrl_update(&qc, 10 * QUALITY_WINDOW_US));
+
+    // A quiet window, then a value from outside: the count starts over
+    CHECK(!qc_window(&qc, &now, 500, 0.1f));
+    quality_ctrl_set_quality(&qc, 30);
+    CHECK(qc.quality == 30);
+    CHECK(!qc_window(&qc, &now, 500, 0.1f));
+    CHECK(qc_window(&qc, &now, 500, 0.1f));
+    CHECK(qc.quality == 29);
+
+    // Frames from before the change do not count toward the next window
+    quality_ctrl_add_frame(&qc, 1000000, 0, now);
+    quality_ctrl_set_quality(&qc, 25);
+    now += QUALITY_WINDOW_US;
+    CHECK(!qc_window(&qc, &now, 800, 0.1f));
+    CHECK(qc.sent_kbps == 800);
+}
+
+// ==== framesize_ctrl ====
+#define FS_MAX_LEVEL    4
+#define FS_WORST        QC_CFG.max_quality
+
+// One window with `late` frames out of FRAMES_PER_WINDOW, judged against `q`.
+static bool fs_window(framesize_ctrl_t *fc, int64_t *now, int late, const quality_ctrl_stats_t *q) {
+    int64_t start = *now;
+    for (int i = 0; i < FRAMES_PER_WINDOW; i++) {
+        framesize_ctrl_add_frame(fc, i < late, start + i * (FRAMESIZE_WINDOW_US / FRAMES_PER_WINDOW));
+    }
+    *now = start + FRAMESIZE_WINDOW_US;
+    return framesize_ctrl_update(fc, q, FS_WORST, *now);
+}
+
+// Well inside the budget: the next size up would still fit
+static const quality_ctrl_stats_t Q_ROOMY = {
+    .quality = 20, .target_kbps = 1000, .effective_kbps = 1000, .sent_kbps = 200,
+};
+// Inside the budget, but one size up would not be
+static const quality_ctrl_stats_t Q_FULL = {
+    .quality = 20, .target_kbps = 1000, .effective_kbps = 1000, .sent_kbps = 300,
+};
+
+static void test_framesize_step_down(void) {
+    framesize_ctrl_t fc;
+    int64_t now = 1;
+    framesize_ctrl_init(&fc, 3, FS_MAX_LEVEL);
+
+    // Down after FRAMESIZE_DOWN_WINDOWS late windows in a row
+    for (int i = 1; i < FRAMESIZE_DOWN_WINDOWS; i++) CHECK(!fs_window(&fc, &now, 3, &Q_FULL));
+    CHECK(fs_window(&fc, &now, 3, &Q_FULL));
+    CHECK(fc.level == 2);
+    CHECK(fc.late_ratio > FRAMESIZE_LATE_DOWN);
+
+    // Then held, however bad it gets
+    for (int i = 0; i < FRAMESIZE_HOLD_WINDOWS; i++) CHECK(!fs_window(&fc, &now, 10, &Q_FULL));
+    CHECK(fc.level == 2);
+
+    // A good window breaks the run
+    for (int i = 1; i < FRAMESIZE_DOWN_WINDOWS; i++) CHECK(!fs_window(&fc, &now, 3, &Q_FULL));
+    CHECK(!fs_window(&fc, &now, 0, &Q_FULL));
+    for (int i = 1; i < FRAMESIZE_DOWN_WINDOWS; i++) CHECK(!fs_window(&fc, &now, 3, &Q_FULL));
+    CHECK(fs_window(&fc, &now, 3, &Q_FULL));
+    CHECK(fc.level == 1);
+    CHECK(fc.changes == 2);
+
+    // A late share at the threshold is not struggling
+    framesize_ctrl_init(&fc, 3, FS_MAX_LEVEL);
+    for (int i = 0; i < 2 * FRAMESIZE_DOWN_WINDOWS; i++) CHECK(!fs_window(&fc, &now, 2, &Q_FULL));
+    CHECK(fc.level == 3);
+
+    // Never below the smallest size
+    framesize_ctrl_init(&fc, 0, FS_MAX_LEVEL);
+    for (int i = 0; i < 2 * FRAMESIZE_DOWN_WINDOWS; i++) CHECK(!fs_window(&fc, &now, 10, &Q_FULL));
+    CHECK(fc.level == 0);
+}
+
+static void test_framesize_saturated(void) {
+    framesize_ctrl_t fc;
+    int64_t now = 1;
+    quality_ctrl_stats_t q = Q_FULL;
+    q.link_kbps = 800;
+    framesize_ctrl_init(&fc, 3, FS_MAX_LEVEL);
+
+    // A saturated link alone is the quality controller's to handle
+    for (int i = 0; i < 2 * FRAMESIZE_DOWN_WINDOWS; i++) CHECK(!fs_window(&fc, &now, 0, &q));
+    CHECK(fc.level == 3);
+
+    // Once it has run out of quality steps, the size goes
+    q.quality = FS_WORST;
+    for (int i = 1; i < FRAMESIZE_DOWN_WINDOWS; i++) CHECK(!fs_window(&fc, &now, 0, &q));
+    CHECK(fs_window(&fc, &now, 0, &q));
+    CHECK(fc.level == 2);
+
+    // And it never steps up while saturated, however small the stream
+    q = Q_ROOMY;
+    q.link_kbps = 2000;
+    framesize_ctrl_init(&fc, 1, FS_MAX_LEVEL);
+    for (int i = 0; i < 2 * FRAMESIZE_UP_WINDOWS; i++) CHECK(!fs_window(&fc, &now, 0, &q));
+    CHECK(fc.level == 1);
+}
+
+static void test_framesize_step_up(void) {
+    framesize_ctrl_t fc;
+    int64_t now = 1;
+    framesize_ctrl_init(&fc, 1, FS_MAX_LEVEL);
+
+    // Up only after FRAMESIZE_UP_WINDOWS roomy windows in a row
+    for (int i = 1; i < FRAMESIZE_UP_WINDOWS; i++) CHECK(!fs_window(&fc, &now, 0, &Q_ROOMY));
+    CHECK(fs_window(&fc, &now, 0, &Q_ROOMY));
+    CHECK(fc.level == 2);
+
+    // The hold-off counts toward nothing
+    for (int i = 0; i < FRAMESIZE_HOLD_WINDOWS; i++) CHECK(!fs_window(&fc, &now, 0, &Q_ROOMY));
+    for (int i = 1; i < FRAMESIZE_UP_WINDOWS; i++) CHECK(!fs_window(&fc, &now, 0, &Q_ROOMY));
+    CHECK(fs_window(&fc, &now, 0, &Q_ROOMY));
+    CHECK(fc.level == 3);
+
+    // One window without room starts the count over
+    for (int i = 0; i < FRAMESIZE_HOLD_WINDOWS; i++) fs_window(&fc, &now, 0, &Q_ROOMY);
+    for (int i = 1; i < FRAMESIZE_UP_WINDOWS; i++) CHECK(!fs_window(&fc, &now, 0, &Q_ROOMY));
+    CHECK(!fs_window(&fc, &now, 0, &Q_FULL));
+    for (int i = 1; i < FRAMESIZE_UP_WINDOWS; i++) CHECK(!fs_window(&fc, &now, 0, &Q_ROOMY));
+    CHECK(fs_window(&fc, &now, 0, &Q_ROOMY));
+    CHECK(fc.level == FS_MAX_LEVEL);
+
+    // Nowhere to go from the top
+    for (int i = 0; i < FRAMESIZE_HOLD_WINDOWS + 2 * FRAMESIZE_UP_WINDOWS; i++) {
+        CHECK(!fs_window(&fc, &now, 0, &Q_ROOMY));
+    }
+    CHECK(fc.level == FS_MAX_LEVEL);
+
+    // Between the up and down lines it stays put
+    framesize_ctrl_init(&fc, 2, FS_MAX_LEVEL);
+    for (int i = 0; i < 3 * FRAMESIZE_UP_WINDOWS; i++) {
+        CHECK(!fs_window(&fc, &now, 1, &Q_ROOMY));
+        CHECK(!fs_window(&fc, &now, 0, &Q_FULL));
+    }
+    CHECK(fc.level == 2);
+    CHECK(fc.changes == 0);
+}
+
+static void test_framesize_set(void) {
+    framesize_ctrl_t fc;
+    int64_t now = 1;
+    framesize_ctrl_init(&fc, 9, FS_MAX_LEVEL);
+    CHECK(fc.level == FS_MAX_LEVEL);
+
+    framesize_ctrl_set_level(&fc, -1);
+    CHECK(fc.level == 0);
+    framesize_ctrl_set_level(&fc, 99);
+    CHECK(fc.level == FS_MAX_LEVEL);
+
+    // Two late windows, then a level from outside: held, and the run is gone
+    framesize_ctrl_set_level(&fc, 2);
+    for (int i = 0; i < FRAMESIZE_HOLD_WINDOWS; i++) fs_window(&fc, &now, 0, &Q_FULL);
+    for (int i = 1; i < FRAMESIZE_DOWN_WINDOWS; i++) CHECK(!fs_window(&fc, &now, 5, &Q_FULL));
+    framesize_ctrl_set_level(&fc, 3);
+    for (int i = 0; i < FRAMESIZE_HOLD_WINDOWS; i++) CHECK(!fs_window(&fc, &now, 5, &Q_FULL));
+    CHECK(fc.level == 3);
+    for (int i = 1; i < FRAMESIZE_DOWN_WINDOWS; i++) CHECK(!fs_window(&fc, &now, 5, &Q_FULL));
+    CHECK(fs_window(&fc, &now, 5, &Q_FULL));
+    CHECK(fc.level == 2);
+}
+
+// ==== Recorded trace ====
+// One "t_us,bytes,send_us,late,quality,level" row per frame, the frame as
+// stream.c reported it and what the controllers decided on it. A
+// "# initial quality=Q level=L max_level=M target_kbps=K" line gives the
+// starting state; without one, camera_capture.c's with the PSRAM ring is
+// assumed. Lines starting with '#' and the column header are skipped.
+#define TRACE_PATH          "tools/traces/link_drop.csv"
+#define TRACE_MAX_ROWS      8192
+#define TRACE_MAX_RUNS      64
+
+typedef struct {
+    int64_t t_us;
+    uint32_t bytes;
+    int64_t send_us;
+    bool late;
+    int quality;
+    int level;
+} trace_row_t;
+
+typedef struct {
+    quality_ctrl_config_t qcfg;
+    int level;
+    int max_level;
+    trace_row_t rows[TRACE_MAX_ROWS];
+    size_t count;
+} trace_t;
+
+static const char *s_trace_path = TRACE_PATH;
+static trace_t s_trace;
+
+static bool trace_load(const char *path, trace_t *tr) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    tr->qcfg = (quality_ctrl_config_t) {
+        .target_kbps = 4000,
+        .min_quality = 10,
+        .max_quality = 40,
+        .initial_quality = 12,
+    };
+    tr->level = 1;
+    tr->max_level = 2;
+    tr->count = 0;
+    char line[256];
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') {
+            int quality, level, max_level;
+            unsigned kbps;
+            if (sscanf(line, "# initial quality=%d level=%d max_level=%d target_kbps=%u",
+                       &quality, &level, &max_level, &kbps) == 4) {
+                tr->qcfg.initial_quality = quality;
+                tr->qcfg.target_kbps = kbps;
+                tr->level = level;
+                tr->max_level = max_level;
+            }
+            continue;
+        }
+        if (strncmp(line, "t_us,", 5) == 0 || line[0] == '\n') continue;
+        trace_row_t *row = &tr->rows[tr->count];
+        long long t_us, send_us;
+        unsigned bytes;
+        int late;
+        ok = tr->count < TRACE_MAX_ROWS &&
+             sscanf(line, "%lld,%u,%lld,%d,%d,%d", &t_us, &bytes, &send_us, &late,
+                    &row->quality, &row->level) == 6;
+        if (!ok) {
+            printf("  %s: bad row %zu: %s", path, tr->count + 1, line);
+            break;
+        }
+        row->t_us = t_us;
+        row->bytes = bytes;
+        row->send_us = send_us;
+        row->late = late;
+        tr->count++;
+    }
+    fclose(f);
+    return ok;
+}
+
+// One frame through both controllers, as camera_report_frame() feeds them
+static void trace_step(quality_ctrl_t *qc, framesize_ctrl_t *fc, const trace_row_t *row) {
+    quality_ctrl_add_frame(qc, row->bytes, row->send_us, row->t_us);
+    quality_ctrl_update(qc, row->t_us);
+    quality_ctrl_stats_t st;
+    quality_ctrl_get_stats(qc, &st);
+    framesize_ctrl_add_frame(fc, row->late, row->t_us);
+    framesize_ctrl_update(fc, &st, qc->cfg.max_quality, row->t_us);
+}
+
+static void test_trace_replay(void) {
+    trace_t *tr = &s_trace;
+    if (!trace_load(s_trace_path, tr)) {
+        printf("  %s: cannot read the trace\n", s_trace_path);
+        s_failed++;
+        return;
+    }
+    CHECK(tr->count > 0);
+
+    quality_ctrl_t qc;
+    framesize_ctrl_t fc;
+    quality_ctrl_init(&qc, &tr->qcfg);
+    framesize_ctrl_init(&fc, tr->level, tr->max_level);
+    // The level at each change, and quality where it turned around
+    int levels[TRACE_MAX_RUNS], turns[TRACE_MAX_RUNS];
+    int level_runs = 1, quality_turns = 1, direction = 0;
+    levels[0] = fc.level;
+    turns[0] = qc.quality;
+    for (size_t i = 0; i < tr->count; i++) {
+        const trace_row_t *row = &tr->rows[i];
+        int quality = qc.quality;
+        trace_step(&qc, &fc, row);
+        if (qc.quality != row->quality || fc.level != row->level) {
+            printf("  row %zu (t_us %lld): quality %d, level %d; recorded %d, %d\n", i + 1,
+                   (long long)row->t_us, qc.quality, fc.level, row->quality, row->level);
+            s_failed++;
+            return;
+        }
+        if (fc.level != levels[level_runs - 1] && level_runs < TRACE_MAX_RUNS) {
+            levels[level_runs++] = fc.level;
+        }
+        if (qc.quality != quality) {
+            int step = qc.quality > quality ? 1 : -1;
+            if (step != direction && direction != 0 && quality_turns < TRACE_MAX_RUNS) quality_turns++;
+            direction = step;
+            turns[quality_turns] = qc.quality;
+        }
+    }
+    if (direction != 0) quality_turns++;
+    if (strcmp(s_trace_path, TRACE_PATH) != 0) return;
+
+    // The checked-in trace, 8 fps of QVGA at about 900 kbit/s: room to step
+    // up to VGA at first; then the link drops to 600 kbit/s, quality backs
+    // off all the way and the size goes down to QQVGA; once the link is back
+    // both climb again.
+    static const int LEVELS[] = { 1, 2, 1, 0, 1, 2 };
+    static const int TURNS[] = { 12, 10, 40, 13 };
+    CHECK(level_runs == sizeof(LEVELS) / sizeof(LEVELS[0]));
+    CHECK(memcmp(levels, LEVELS, sizeof(LEVELS)) == 0);
+    CHECK(quality_turns == sizeof(TURNS) / sizeof(TURNS[0]));
+    CHECK(memcmp(turns, TURNS, sizeof(TURNS)) == 0);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) s_trace_path = argv[1];
+    static const struct {
+        const char *name;
+        void (*fn)(void);
+    } tests[] = {
+        { "quality: step down", test_quality_step_down },
+        { "quality: step up", test_quality_step_up },
+        { "quality: dead zone", test_quality_dead_zone },
+        { "quality: saturated link", test_quality_saturation },
+        { "quality: set from outside", test_quality_set },
+        { "framesize: step down", test_framesize_step_down },
+        { "framesize: saturated link", test_framesize_saturated },
+        { "framesize: step up", test_framesize_step_up },
+        { "framesize: set from outside", test_framesize_set },
+        { "trace: replay", test_trace_replay },
+    };
+    int failed_tests = 0;
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        int before = s_failed;
+        tests[i].fn();
+        printf("%-30s %s\n", tests[i].name, s_failed == before ? "ok" : "FAILED");
+        if (s_failed != before) failed_tests++;
+    }
+    printf("%d of %zu failed\n", failed_tests, sizeof(tests) / sizeof(tests[0]));
+    return failed_tests ? 1 : 0;
+}
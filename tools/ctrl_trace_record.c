@@ -0,0 +1,270 @@
+// Records a frame trace for tools/ctrl_replay_test.c on the host: one
+// /stream viewer, served by stream.c, mjpeg_writer.c, frame_pacer.c and
+// frame_broadcaster.c as the firmware builds them, from a replay of the
+// JPEG files in tools/frames, read over loopback at a rate that follows a
+// link schedule. Every frame stream.c reports goes through quality_ctrl and
+// framesize_ctrl the way camera_capture.c feeds them, and is written out
+// with what they decided, in the format CAMERA_TRACE_FRAMES logs on the
+// device:
+//     t_us,bytes,send_us,late,quality,level
+//
+// The loop is open: a decision does not change the replayed JPEGs as it
+// would the sensor's, so quality and size only ever react to the link.
+//
+// Build and run from the repository root:
+//     gcc -O2 -Wall -pthread -o ctrl_trace_record -I tools/host -I src
+//         tools/ctrl_trace_record.c tools/host/freertos_host.c
+//         tools/host/httpd_host.c tools/host/replay_source.c src/stream.c
+//         src/mjpeg_writer.c src/frame_pacer.c src/frame_broadcaster.c
+//         src/json_util.c src/motion_detect.c src/quality_ctrl.c
+//         src/framesize_ctrl.c && ./ctrl_trace_record [options] out.csv
+//
+// (one command line). Options:
+//     --fps N         viewer frame rate (default 8)
+//     --seconds N     length of the trace (120)
+//     --link LIST     reader rate over time, "s:kbps,..." with 0 = no cap
+//                     (default "0:0,20:600,50:0": a link that drops to
+//                     600 kbit/s for 30 s and recovers)
+//     --frames DIR    JPEG files to replay (tools/frames)
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include "stream.h"
+#include "camera_capture.h"
+#include "thumbnail.h"
+#include "boot_timeline.h"
+#include "replay_source.h"
+#include "esp_timer.h"
+#include "esp_http_server.h"
+
+#define FRAME_PERIOD_US 20000           // 50 fps source, ahead of the viewer
+#define READER_RCVBUF   8192            // small, so a slow reader stalls the sender soon
+#define LINK_MAX_STEPS  16
+
+// As camera_capture.c sets them up with the PSRAM ring: VGA buffers,
+// streaming from QVGA at its default JPEG quality
+#define TRACE_INITIAL_QUALITY   12
+#define TRACE_INITIAL_LEVEL     1
+#define TRACE_MAX_LEVEL         2
+
+static const char *const LEVEL_NAMES[] = { "QQVGA", "QVGA", "VGA" };
+
+typedef struct {
+    int64_t at_us;
+    uint32_t kbps;
+} link_step_t;
+
+static link_step_t s_link[LINK_MAX_STEPS];
+static int s_link_steps;
+
+// ==== camera_capture, thumbnail and boot_timeline stand-ins ====
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static quality_ctrl_t s_quality;
+static framesize_ctrl_t s_framesize;
+static FILE *s_out;
+static int64_t s_start_us;
+static uint32_t s_rows;
+
+void camera_report_frame(size_t jpeg_bytes, int64_t send_us, bool late) {
+    pthread_mutex_lock(&s_lock);
+    int64_t now = esp_timer_get_time() - s_start_us;
+    quality_ctrl_add_frame(&s_quality, jpeg_bytes, send_us, now);
+    quality_ctrl_update(&s_quality, now);
+    quality_ctrl_stats_t st;
+    quality_ctrl_get_stats(&s_quality, &st);
+    framesize_ctrl_add_frame(&s_framesize, late, now);
+    framesize_ctrl_update(&s_framesize, &st, CAMERA_QUALITY_MAX, now);
+    if (s_out) {
+        fprintf(s_out, "%lld,%u,%lld,%d,%d,%d\n", (long long)now, (unsigned)jpeg_bytes,
+                (long long)send_us, late, st.quality, s_framesize.level);
+        s_rows++;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+void camera_quality_get_stats(quality_ctrl_stats_t *out) {
+    pthread_mutex_lock(&s_lock);
+    quality_ctrl_get_stats(&s_quality, out);
+    pthread_mutex_unlock(&s_lock);
+}
+
+void camera_framesize_get_stats(camera_framesize_stats_t *out) {
+    pthread_mutex_lock(&s_lock);
+    *out = (camera_framesize_stats_t) {
+        .name = LEVEL_NAMES[s_framesize.level],
+        .max_name = LEVEL_NAMES[s_framesize.max_level],
+        .late_ratio = s_framesize.late_ratio,
+        .changes = s_framesize.changes,
+    };
+    pthread_mutex_unlock(&s_lock);
+}
+
+esp_err_t thumbnail_signature(const frame_t *frame, scene_sig_t *out) {
+    return ESP_FAIL;    // never suppressed
+}
+
+void thumbnail_get_stats(thumbnail_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+}
+
+void boot_mark(const char *stage) {
+}
+
+// ==== Viewer ====
+static uint32_t link_kbps(int64_t since_start_us) {
+    uint32_t kbps = 0;
+    for (int i = 0; i < s_link_steps && s_link[i].at_us <= since_start_us; i++) kbps = s_link[i].kbps;
+    return kbps;
+}
+
+static bool parse_link(const char *list) {
+    s_link_steps = 0;
+    while (*list && s_link_steps < LINK_MAX_STEPS) {
+        unsigned secs, kbps;
+        int used;
+        if (sscanf(list, "%u:%u%n", &secs, &kbps, &used) != 2) return false;
+        s_link[s_link_steps++] = (link_step_t) { .at_us = secs * 1000000LL, .kbps = kbps };
+        list += used;
+        if (*list == ',') list++;
+    }
+    return s_link_steps > 0 && *list == '\0';
+}
+
+// Reads /stream for `seconds`, no faster than the link allows at the time
+static bool view(uint16_t port, int fps, int seconds) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int rcvbuf = READER_RCVBUF;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct timeval tv = { .tv_sec = 5 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return false;
+    }
+    char buf[1460];
+    int n = snprintf(buf, sizeof(buf), "GET /stream?fps=%d HTTP/1.1\r\nHost: localhost\r\n\r\n", fps);
+    bool ok = send(fd, buf, n, 0) == n;
+    int64_t end = s_start_us + seconds * 1000000LL;
+    // Paced per link step: bytes read since the step began, at its rate
+    int64_t step_start = s_start_us;
+    uint32_t step_kbps = link_kbps(0);
+    uint64_t step_bytes = 0;
+    while (ok && esp_timer_get_time() < end) {
+        ssize_t r = recv(fd, buf, sizeof(buf), 0);
+        if (r == 0) {
+            ok = false;
+            break;
+        }
+        if (r < 0) {
+            ok = errno == EINTR;
+            continue;
+        }
+        int64_t now = esp_timer_get_time();
+        uint32_t kbps = link_kbps(now - s_start_us);
+        if (kbps != step_kbps) {
+            step_start = now;
+            step_kbps = kbps;
+            step_bytes = 0;
+        }
+        step_bytes += r;
+        if (kbps) {
+            int64_t due = step_start + (int64_t)(step_bytes * 8 * 1000 / kbps);
+            if (due > now) usleep(due - now);
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    int fps = 8, seconds = 120;
+    const char *link = "0:0,20:600,50:0";
+    const char *dir = "tools/frames";
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            fps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--link") == 0 && i + 1 < argc) {
+            link = argv[++i];
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+    if (!path || fps <= 0 || seconds <= 0 || !parse_link(link)) {
+        printf("usage: %s [--fps N] [--seconds N] [--link s:kbps,...] [--frames DIR] out.csv\n", argv[0]);
+        return 1;
+    }
+    size_t files = replay_load(dir, FRAME_PERIOD_US);
+    if (files == 0) {
+        printf("%s: no .jpg files\n", dir);
+        return 1;
+    }
+    s_out = fopen(path, "w");
+    if (!s_out) {
+        printf("%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    quality_ctrl_config_t qcfg = {
+        .target_kbps = QUALITY_TARGET_KBPS,
+        .min_quality = CAMERA_QUALITY_MIN,
+        .max_quality = CAMERA_QUALITY_MAX,
+        .initial_quality = TRACE_INITIAL_QUALITY,
+    };
+    quality_ctrl_init(&s_quality, &qcfg);
+    framesize_ctrl_init(&s_framesize, TRACE_INITIAL_LEVEL, TRACE_MAX_LEVEL);
+
+    static const broadcaster_config_t config = {
+        .core = tskNO_AFFINITY,
+        .max_age_ms = 0,
+        .idle_suspend_ms = 0,
+    };
+    httpd_handle_t server;
+    httpd_config_t httpd_config = HTTPD_DEFAULT_CONFIG();
+    httpd_config.server_port = 0;
+    if (broadcaster_start(replay_source(), &config) != ESP_OK ||
+        stream_workers_start() != ESP_OK ||
+        httpd_start(&server, &httpd_config) != ESP_OK) {
+        printf("start failed\n");
+        return 1;
+    }
+    static const httpd_uri_t stream_uri = { .uri = "/stream", .method = HTTP_GET, .handler = stream_handler };
+    httpd_register_uri_handler(server, &stream_uri);
+
+    fprintf(s_out, "# host recording: tools/ctrl_trace_record.c, %zu files from %s\n", files, dir);
+    fprintf(s_out, "# viewer fps=%d, link %s (s:kbps, 0 = no cap), %d s\n", fps, link, seconds);
+    fprintf(s_out, "# initial quality=%d level=%d max_level=%d target_kbps=%d\n",
+            TRACE_INITIAL_QUALITY, TRACE_INITIAL_LEVEL, TRACE_MAX_LEVEL, QUALITY_TARGET_KBPS);
+    fprintf(s_out, "t_us,bytes,send_us,late,quality,level\n");
+    s_start_us = esp_timer_get_time();
+    bool ok = view(host_httpd_port(server), fps, seconds);
+
+    pthread_mutex_lock(&s_lock);
+    fclose(s_out);
+    s_out = NULL;
+    printf("%u frames to %s; quality %d, level %d, %u quality and %u size changes\n",
+           (unsigned)s_rows, path, s_quality.quality, s_framesize.level,
+           (unsigned)s_quality.changes, (unsigned)s_framesize.changes);
+    pthread_mutex_unlock(&s_lock);
+    if (!ok) printf("the stream ended early\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+// Host stand-in for esp_heap_caps.h. Every capability maps to malloc();
+// the live allocation count lets host tests check that buffers are freed.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_DEFAULT  (1 << 12)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+void *heap_caps_malloc(size_t size, uint32_t caps);
+void heap_caps_free(void *ptr);
+
+// Host only: heap_caps_malloc() blocks not yet freed.
+int host_heap_caps_live(void);
@@ -0,0 +1,14 @@
+// Host stand-in for esp_log.h. Errors and warnings go to stderr, the rest
+// is compiled (so the format strings are still checked) but not printed.
+#pragma once
+
+#include <stdio.h>
+
+#define HOST_LOG(show, letter, tag, fmt, ...) do { \
+        if (show) fprintf(stderr, letter " (%s) " fmt "\n", tag, ##__VA_ARGS__); \
+    } while (0)
+
+#define ESP_LOGE(tag, fmt, ...) HOST_LOG(1, "E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) HOST_LOG(1, "W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) HOST_LOG(0, "I", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) HOST_LOG(0, "D", tag, fmt, ##__VA_ARGS__)
@@ -0,0 +1,12 @@
+// Host stand-in for FreeRTOS queues: items are copied in and out of a
+// fixed ring under a pthread mutex, see freertos_host.c.
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_queue *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t timeout);
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t timeout);
+void vQueueDelete(QueueHandle_t q);
@@ -0,0 +1,416 @@
+// Host implementation of the FreeRTOS, esp_timer, esp_heap_caps and
+// esp_err stand-ins in this directory, on pthreads. Enough to run the
+// firmware's task-level modules (frame_broadcaster, frame_pacer, stream)
+// in a host test; not a scheduler: priorities and core affinity are ignored.
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+// ==== Clock ====
+static int64_t mono_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static pthread_once_t s_clock_once = PTHREAD_ONCE_INIT;
+static int64_t s_clock_start_us;
+
+static void clock_init(void) {
+    // Start at 1 ms rather than 0: callers use 0 for "never"
+    s_clock_start_us = mono_us() - 1000;
+}
+
+int64_t esp_timer_get_time(void) {
+    pthread_once(&s_clock_once, clock_init);
+    return mono_us() - s_clock_start_us;
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    usleep((useconds_t)ticks * 1000);
+}
+
+// Condition variables run on the monotonic clock, so a deadline is
+// `timeout` ticks from now on it.
+static void cond_init(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static struct timespec deadline_us(int64_t us) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += us / 1000000;
+    ts.tv_nsec += (long)(us % 1000000) * 1000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return ts;
+}
+
+static struct timespec deadline(TickType_t timeout) {
+    return deadline_us((int64_t)timeout * 1000);
+}
+
+// Waits on `cond` until `ready` says so or the timeout passes; `lock` held.
+static bool wait_until(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t timeout,
+                       bool (*ready)(void *), void *arg) {
+    struct timespec until = deadline(timeout == portMAX_DELAY ? 0 : timeout);
+    while (!ready(arg)) {
+        if (timeout == portMAX_DELAY) {
+            pthread_cond_wait(cond, lock);
+        } else if (pthread_cond_timedwait(cond, lock, &until) == ETIMEDOUT) {
+            return ready(arg);
+        }
+    }
+    return true;
+}
+
+// ==== Semaphores ====
+struct host_sem {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int count;
+    int max;
+};
+
+static SemaphoreHandle_t sem_create(int max, int count) {
+    SemaphoreHandle_t sem = calloc(1, sizeof(*sem));
+    if (!sem) return NULL;
+    pthread_mutex_init(&sem->lock, NULL);
+    cond_init(&sem->cond);
+    sem->count = count;
+    sem->max = max;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return sem_create(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return sem_create(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial) {
+    return sem_create((int)max, (int)initial);
+}
+
+static bool sem_ready(void *arg) {
+    return ((SemaphoreHandle_t)arg)->count > 0;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t timeout) {
+    pthread_mutex_lock(&sem->lock);
+    bool ok = wait_until(&sem->cond, &sem->lock, timeout, sem_ready, sem);
+    if (ok) sem->count--;
+    pthread_mutex_unlock(&sem->lock);
+    return ok ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    pthread_mutex_lock(&sem->lock);
+    bool ok = sem->count < sem->max;    // binary: giving twice does not stack
+    if (ok) sem->count++;
+    pthread_cond_signal(&sem->cond);
+    pthread_mutex_unlock(&sem->lock);
+    return ok ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    if (!sem) return;
+    pthread_mutex_destroy(&sem->lock);
+    pthread_cond_destroy(&sem->cond);
+    free(sem);
+}
+
+// ==== Queues ====
+// Fixed-size items copied in and out of a ring, as in FreeRTOS
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        // signalled on every send and receive
+    size_t item_size;
+    UBaseType_t length;
+    UBaseType_t head, count;
+    uint8_t *items;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    QueueHandle_t q = calloc(1, sizeof(*q));
+    if (!q) return NULL;
+    q->items = calloc(length, item_size);
+    if (!q->items) {
+        free(q);
+        return NULL;
+    }
+    pthread_mutex_init(&q->lock, NULL);
+    cond_init(&q->cond);
+    q->item_size = item_size;
+    q->length = length;
+    return q;
+}
+
+static bool queue_has_room(void *arg) {
+    QueueHandle_t q = arg;
+    return q->count < q->length;
+}
+
+static bool queue_has_item(void *arg) {
+    return ((QueueHandle_t)arg)->count > 0;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t timeout) {
+    pthread_mutex_lock(&q->lock);
+    bool ok = wait_until(&q->cond, &q->lock, timeout, queue_has_room, q);
+    if (ok) {
+        memcpy(q->items + ((q->head + q->count) % q->length) * q->item_size, item, q->item_size);
+        q->count++;
+        pthread_cond_broadcast(&q->cond);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ok ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t timeout) {
+    pthread_mutex_lock(&q->lock);
+    bool ok = wait_until(&q->cond, &q->lock, timeout, queue_has_item, q);
+    if (ok) {
+        memcpy(item, q->items + q->head * q->item_size, q->item_size);
+        q->head = (q->head + 1) % q->length;
+        q->count--;
+        pthread_cond_broadcast(&q->cond);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ok ? pdTRUE : pdFALSE;
+}
+
+void vQueueDelete(QueueHandle_t q) {
+    if (!q) return;
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->cond);
+    free(q->items);
+    free(q);
+}
+
+// ==== Tasks ====
+struct host_task {
+    TaskFunction_t fn;
+    void *arg;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;
+    bool handle_out;            // the creator kept the handle
+};
+
+static _Thread_local TaskHandle_t s_current;
+
+static TaskHandle_t task_alloc(void) {
+    TaskHandle_t task = calloc(1, sizeof(*task));
+    if (!task) return NULL;
+    pthread_mutex_init(&task->lock, NULL);
+    cond_init(&task->cond);
+    return task;
+}
+
+// The calling thread as a task; threads not started by us get one lazily
+static TaskHandle_t current_task(void) {
+    if (!s_current) s_current = task_alloc();
+    return s_current;
+}
+
+static void *task_main(void *arg) {
+    s_current = arg;
+    s_current->fn(s_current->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *out, BaseType_t core) {
+    TaskHandle_t task = task_alloc();
+    if (!task) return pdFAIL;
+    task->fn = fn;
+    task->arg = arg;
+    task->handle_out = out != NULL;
+    if (out) *out = task;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, task_main, task) != 0) return pdFAIL;
+    pthread_detach(thread);
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task && task != s_current) return;
+    // A handle given out stays allocated: others may still notify it
+    TaskHandle_t self = current_task();
+    if (!self->handle_out) {
+        pthread_mutex_destroy(&self->lock);
+        pthread_cond_destroy(&self->cond);
+        free(self);
+        s_current = NULL;
+    }
+    pthread_exit(NULL);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+static bool notify_ready(void *arg) {
+    return ((TaskHandle_t)arg)->notify > 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout) {
+    TaskHandle_t task = current_task();
+    pthread_mutex_lock(&task->lock);
+    wait_until(&task->cond, &task->lock, timeout, notify_ready, task);
+    uint32_t value = task->notify;
+    if (value) task->notify = clear ? 0 : value - 1;
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+// ==== One-shot timers ====
+// Each timer has its own thread, which runs the callback when it is due.
+// Callbacks of one timer never overlap, as with ESP_TIMER_TASK dispatch;
+// those of different timers may.
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int64_t due_us;             // 0 = not armed
+    bool quit;
+};
+
+static void *timer_main(void *arg) {
+    esp_timer_handle_t t = arg;
+    pthread_mutex_lock(&t->lock);
+    while (!t->quit) {
+        if (!t->due_us) {
+            pthread_cond_wait(&t->cond, &t->lock);
+            continue;
+        }
+        int64_t left = t->due_us - esp_timer_get_time();
+        if (left > 0) {
+            struct timespec until = deadline_us(left);
+            pthread_cond_timedwait(&t->cond, &t->lock, &until);
+            continue;
+        }
+        t->due_us = 0;
+        pthread_mutex_unlock(&t->lock);
+        t->callback(t->arg);
+        pthread_mutex_lock(&t->lock);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out) {
+    if (!args || !args->callback || !out) return ESP_ERR_INVALID_ARG;
+    esp_timer_handle_t t = calloc(1, sizeof(*t));
+    if (!t) return ESP_ERR_NO_MEM;
+    t->callback = args->callback;
+    t->arg = args->arg;
+    pthread_mutex_init(&t->lock, NULL);
+    cond_init(&t->cond);
+    if (pthread_create(&t->thread, NULL, timer_main, t) != 0) {
+        pthread_mutex_destroy(&t->lock);
+        pthread_cond_destroy(&t->cond);
+        free(t);
+        return ESP_ERR_NO_MEM;
+    }
+    *out = t;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t t, uint64_t timeout_us) {
+    pthread_mutex_lock(&t->lock);
+    bool armed = t->due_us != 0;
+    if (!armed) {
+        t->due_us = esp_timer_get_time() + (int64_t)timeout_us;
+        pthread_cond_signal(&t->cond);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return armed ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t t) {
+    pthread_mutex_lock(&t->lock);
+    bool armed = t->due_us != 0;
+    t->due_us = 0;
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    return armed ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t t) {
+    if (!t) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&t->lock);
+    t->quit = true;
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->thread, NULL);
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->cond);
+    free(t);
+    return ESP_OK;
+}
+
+// ==== Heap ====
+static atomic_int s_heap_live;
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+    void *ptr = malloc(size);
+    if (ptr) atomic_fetch_add(&s_heap_live, 1);
+    return ptr;
+}
+
+void heap_caps_free(void *ptr) {
+    if (!ptr) return;
+    atomic_fetch_sub(&s_heap_live, 1);
+    free(ptr);
+}
+
+int host_heap_caps_live(void) {
+    return atomic_load(&s_heap_live);
+}
+
+// ==== Errors ====
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    default: return "ESP_ERR_UNKNOWN";
+    }
+}
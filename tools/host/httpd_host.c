@@ -0,0 +1,341 @@
+// Host implementation of the esp_http_server stand-in: a loopback server
+// that hands each GET to the registered handler, so the firmware's handlers
+// (stream.c, mjpeg_writer.c) run unchanged against real TCP clients.
+//
+// Differences from esp_http_server that tests may notice: every connection
+// gets its own thread and carries one request, after which it is closed,
+// and accepted sockets get a small send buffer like lwIP's, so a viewer
+// that stops reading blocks the sender after kilobytes, not megabytes.
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include "esp_http_server.h"
+
+// About CONFIG_LWIP_TCP_SND_BUF_DEFAULT; Linux doubles it
+#ifndef HOST_HTTPD_SNDBUF
+#define HOST_HTTPD_SNDBUF 5760
+#endif
+#define HOST_HTTPD_HEAD_MAX 1024
+
+typedef struct host_httpd {
+    int listen_fd;
+    uint16_t port;
+    pthread_t thread;
+    pthread_mutex_t lock;       // guards the handler table
+    int max_handlers;
+    int handler_count;
+    httpd_uri_t *handlers;
+} host_httpd_t;
+
+// One accepted connection and the response in progress on it
+typedef struct {
+    host_httpd_t *server;
+    int fd;
+    const char *status;
+    const char *type;
+    bool chunked;               // headers of a chunked response are out
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool async;                 // a copy of the request is still out
+} conn_t;
+
+static conn_t *req_conn(httpd_req_t *req) {
+    return (conn_t *)req->aux;
+}
+
+static esp_err_t send_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return ESP_ERR_HTTPD_RESP_SEND;
+        }
+        p += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+// ==== Requests ====
+int httpd_req_to_sockfd(httpd_req_t *req) {
+    return req_conn(req)->fd;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *req, char *buf, size_t buf_len) {
+    if (!buf || buf_len == 0) return ESP_ERR_INVALID_ARG;
+    const char *q = strchr(req->uri, '?');
+    if (!q) return ESP_ERR_NOT_FOUND;
+    q++;
+    size_t len = strlen(q);
+    esp_err_t res = ESP_OK;
+    if (len >= buf_len) {
+        len = buf_len - 1;
+        res = ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+    memcpy(buf, q, len);
+    buf[len] = '\0';
+    return res;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size) {
+    if (!qry || !key || !val || val_size == 0) return ESP_ERR_INVALID_ARG;
+    size_t key_len = strlen(key);
+    const char *p = qry;
+    while (*p) {
+        const char *end = strchr(p, '&');
+        if (!end) end = p + strlen(p);
+        const char *eq = memchr(p, '=', end - p);
+        const char *key_end = eq ? eq : end;
+        if ((size_t)(key_end - p) == key_len && strncmp(p, key, key_len) == 0) {
+            const char *v = eq ? eq + 1 : end;
+            size_t len = end - v;
+            esp_err_t res = ESP_OK;
+            if (len >= val_size) {
+                len = val_size - 1;
+                res = ESP_ERR_HTTPD_RESULT_TRUNC;
+            }
+            memcpy(val, v, len);
+            val[len] = '\0';
+            return res;
+        }
+        p = *end ? end + 1 : end;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+// ==== Responses ====
+esp_err_t httpd_resp_set_status(httpd_req_t *req, const char *status) {
+    req_conn(req)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *req, const char *type) {
+    req_conn(req)->type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *req, const char *buf, ssize_t buf_len) {
+    conn_t *c = req_conn(req);
+    if (buf_len == HTTPD_RESP_USE_STRLEN) buf_len = buf ? strlen(buf) : 0;
+    char head[256];
+    int n = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %d\r\n\r\n",
+                     c->status, c->type, (int)buf_len);
+    esp_err_t res = send_all(c->fd, head, n);
+    if (res == ESP_OK && buf_len > 0) res = send_all(c->fd, buf, buf_len);
+    return res;
+}
+
+esp_err_t httpd_resp_sendstr(httpd_req_t *req, const char *str) {
+    return httpd_resp_send(req, str, HTTPD_RESP_USE_STRLEN);
+}
+
+// Size line, data and CRLF as three sends, as esp_http_server does
+esp_err_t httpd_resp_send_chunk(httpd_req_t *req, const char *buf, ssize_t buf_len) {
+    conn_t *c = req_conn(req);
+    if (buf_len == HTTPD_RESP_USE_STRLEN) buf_len = buf ? strlen(buf) : 0;
+    esp_err_t res = ESP_OK;
+    if (!c->chunked) {
+        char head[256];
+        int n = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n\r\n",
+                         c->status, c->type);
+        res = send_all(c->fd, head, n);
+        if (res != ESP_OK) return res;
+        c->chunked = true;
+    }
+    char len_str[12];
+    int n = snprintf(len_str, sizeof(len_str), "%x\r\n", (unsigned)buf_len);
+    res = send_all(c->fd, len_str, n);
+    if (res == ESP_OK && buf_len > 0) res = send_all(c->fd, buf, buf_len);
+    if (res == ESP_OK) res = send_all(c->fd, "\r\n", 2);
+    return res;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg) {
+    static const struct {
+        const char *status;
+        const char *msg;
+    } errors[] = {
+        [HTTPD_400_BAD_REQUEST] = { "400 Bad Request", "Bad request syntax" },
+        [HTTPD_404_NOT_FOUND] = { "404 Not Found", "This URI does not exist" },
+        [HTTPD_405_METHOD_NOT_ALLOWED] = { "405 Method Not Allowed", "Request method for this URI is not handled by server" },
+        [HTTPD_500_INTERNAL_SERVER_ERROR] = { "500 Internal Server Error", "Server has encountered an unexpected error" },
+    };
+    httpd_resp_set_status(req, errors[error].status);
+    httpd_resp_set_type(req, "text/html");
+    return httpd_resp_sendstr(req, msg ? msg : errors[error].msg);
+}
+
+// ==== Async requests ====
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *req, httpd_req_t **out) {
+    httpd_req_t *copy = malloc(sizeof(*copy));
+    if (!copy) return ESP_ERR_NO_MEM;
+    *copy = *req;
+    conn_t *c = req_conn(req);
+    pthread_mutex_lock(&c->lock);
+    c->async = true;
+    pthread_mutex_unlock(&c->lock);
+    *out = copy;
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *req) {
+    conn_t *c = req_conn(req);
+    free(req);
+    pthread_mutex_lock(&c->lock);
+    c->async = false;
+    pthread_cond_signal(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+    return ESP_OK;
+}
+
+// The connection closes after its one request anyway; this only makes the
+// viewer see the end at once, as the real call does.
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+    shutdown(sockfd, SHUT_RDWR);
+    return ESP_OK;
+}
+
+// ==== Server ====
+static const httpd_uri_t *find_handler(host_httpd_t *s, const char *uri) {
+    size_t path_len = strcspn(uri, "?");
+    const httpd_uri_t *found = NULL;
+    pthread_mutex_lock(&s->lock);
+    for (int i = 0; i < s->handler_count && !found; i++) {
+        if (strlen(s->handlers[i].uri) == path_len && strncmp(s->handlers[i].uri, uri, path_len) == 0) {
+            found = &s->handlers[i];
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+    return found;
+}
+
+// Reads up to the blank line after the request headers; the body, if any,
+// is left unread.
+static bool read_head(int fd, char *buf, size_t cap) {
+    size_t len = 0;
+    while (len + 1 < cap) {
+        ssize_t n = recv(fd, buf + len, 1, 0);
+        if (n <= 0) return false;
+        len++;
+        buf[len] = '\0';
+        if (len >= 4 && strcmp(buf + len - 4, "\r\n\r\n") == 0) return true;
+    }
+    return false;
+}
+
+static void *conn_main(void *arg) {
+    conn_t *c = arg;
+    char head[HOST_HTTPD_HEAD_MAX];
+    char method[8];
+    httpd_req_t req = { .handle = c->server, .method = HTTP_GET, .aux = c };
+    if (read_head(c->fd, head, sizeof(head)) &&
+        sscanf(head, "%7s %512s", method, req.uri) == 2) {
+        const httpd_uri_t *h = find_handler(c->server, req.uri);
+        if (strcmp(method, "GET") != 0) {
+            httpd_resp_send_err(&req, HTTPD_405_METHOD_NOT_ALLOWED, NULL);
+        } else if (!h) {
+            httpd_resp_send_404(&req);
+        } else {
+            req.user_ctx = h->user_ctx;
+            h->handler(&req);
+        }
+    }
+
+    // Wait for the worker that took the request over
+    pthread_mutex_lock(&c->lock);
+    while (c->async) pthread_cond_wait(&c->cond, &c->lock);
+    pthread_mutex_unlock(&c->lock);
+    close(c->fd);
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->cond);
+    free(c);
+    return NULL;
+}
+
+static void *accept_main(void *arg) {
+    host_httpd_t *s = arg;
+    while (true) {
+        int fd = accept(s->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return NULL;
+        }
+        int sndbuf = HOST_HTTPD_SNDBUF;
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+        conn_t *c = calloc(1, sizeof(*c));
+        pthread_t thread;
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        c->server = s;
+        c->fd = fd;
+        c->status = "200 OK";
+        c->type = "text/html";
+        pthread_mutex_init(&c->lock, NULL);
+        pthread_cond_init(&c->cond, NULL);
+        if (pthread_create(&thread, NULL, conn_main, c) != 0) {
+            close(fd);
+            free(c);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+    signal(SIGPIPE, SIG_IGN);
+    host_httpd_t *s = calloc(1, sizeof(*s));
+    if (!s) return ESP_ERR_NO_MEM;
+    s->max_handlers = config->max_uri_handlers;
+    s->handlers = calloc(s->max_handlers, sizeof(httpd_uri_t));
+    s->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (!s->handlers || s->listen_fd < 0) goto fail;
+    int one = 1;
+    setsockopt(s->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(config->server_port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t addr_len = sizeof(addr);
+    if (bind(s->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(s->listen_fd, 16) != 0 ||
+        getsockname(s->listen_fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        goto fail;
+    }
+    s->port = ntohs(addr.sin_port);
+    pthread_mutex_init(&s->lock, NULL);
+    if (pthread_create(&s->thread, NULL, accept_main, s) != 0) goto fail;
+    *handle = s;
+    return ESP_OK;
+
+fail:
+    if (s->listen_fd >= 0) close(s->listen_fd);
+    free(s->handlers);
+    free(s);
+    return ESP_ERR_HTTPD_TASK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri) {
+    host_httpd_t *s = handle;
+    pthread_mutex_lock(&s->lock);
+    bool full = s->handler_count >= s->max_handlers;
+    if (!full) s->handlers[s->handler_count++] = *uri;
+    pthread_mutex_unlock(&s->lock);
+    return full ? ESP_ERR_HTTPD_HANDLERS_FULL : ESP_OK;
+}
+
+uint16_t host_httpd_port(httpd_handle_t handle) {
+    return ((host_httpd_t *)handle)->port;
+}
@@ -0,0 +1,17 @@
+// Host stand-in for lwip/sockets.h: the lwip_ calls are the host's BSD
+// socket calls. lwIP raises no SIGPIPE; host programs that write to
+// sockets ignore it (httpd_start() in httpd_host.c does) so a write to a
+// closed peer fails with EPIPE instead.
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+#define lwip_recv       recv
+#define lwip_send       send
+#define lwip_writev     writev
+#define lwip_setsockopt setsockopt
+#define lwip_close      close
@@ -0,0 +1,186 @@
+// See replay_source.h
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "replay_source.h"
+#include "esp_timer.h"
+
+#define REPLAY_MAX_FRAMES 256
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    uint16_t width, height;
+} replay_file_t;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    replay_file_t files[REPLAY_MAX_FRAMES];
+    size_t count;
+    size_t next;
+    int64_t period_us;
+    int64_t due_us;             // when the next frame is ready
+    bool hold;
+    bool suspended;
+    int outstanding;
+} s_replay = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+// Width and height from the SOF segment; zero if there is none
+static void jpeg_size(const uint8_t *buf, size_t len, uint16_t *width, uint16_t *height) {
+    *width = *height = 0;
+    size_t i = 2;
+    while (i + 9 < len && buf[i] == 0xff) {
+        uint8_t marker = buf[i + 1];
+        size_t seg = (buf[i + 2] << 8) | buf[i + 3];
+        if (marker >= 0xc0 && marker <= 0xc2) {
+            *height = (buf[i + 5] << 8) | buf[i + 6];
+            *width = (buf[i + 7] << 8) | buf[i + 8];
+            return;
+        }
+        i += 2 + seg;
+    }
+}
+
+static int jpeg_filter(const struct dirent *e) {
+    size_t n = strlen(e->d_name);
+    return n > 4 && strcmp(e->d_name + n - 4, ".jpg") == 0;
+}
+
+static bool load_file(const char *path, replay_file_t *out) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = len > 0 ? malloc(len) : NULL;
+    bool ok = data && fread(data, 1, len, f) == (size_t)len && data[0] == 0xff && data[1] == 0xd8;
+    fclose(f);
+    if (!ok) {
+        free(data);
+        return false;
+    }
+    out->data = data;
+    out->len = len;
+    jpeg_size(data, len, &out->width, &out->height);
+    return true;
+}
+
+size_t replay_load(const char *dir, int64_t period_us) {
+    struct dirent **names;
+    int n = scandir(dir, &names, jpeg_filter, alphasort);
+    if (n < 0) return 0;
+    for (int i = 0; i < n; i++) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]->d_name);
+        if (s_replay.count < REPLAY_MAX_FRAMES) {
+            if (load_file(path, &s_replay.files[s_replay.count])) {
+                s_replay.count++;
+            } else {
+                fprintf(stderr, "%s: not a JPEG, skipped\n", path);
+            }
+        }
+        free(names[i]);
+    }
+    free(names);
+    s_replay.period_us = period_us;
+    return s_replay.count;
+}
+
+static bool may_hand_out(void) {
+    return !s_replay.hold && !s_replay.suspended;
+}
+
+static camera_fb_t *replay_fb_get(void *ctx) {
+    pthread_mutex_lock(&s_replay.lock);
+    while (!may_hand_out()) pthread_cond_wait(&s_replay.cond, &s_replay.lock);
+    const replay_file_t *file = &s_replay.files[s_replay.next];
+    s_replay.next = (s_replay.next + 1) % s_replay.count;
+    s_replay.outstanding++;
+    int64_t now = esp_timer_get_time();
+    // Absolute deadlines, restarted after a hold or when running behind
+    if (now - s_replay.due_us > s_replay.period_us) s_replay.due_us = now;
+    int64_t wait = s_replay.due_us - now;
+    s_replay.due_us += s_replay.period_us;
+    pthread_mutex_unlock(&s_replay.lock);
+
+    if (wait > 0) usleep(wait);
+    camera_fb_t *fb = calloc(1, sizeof(*fb));
+    fb->buf = file->data;       // the broadcaster copies it out
+    fb->len = file->len;
+    fb->width = file->width;
+    fb->height = file->height;
+    fb->format = PIXFORMAT_JPEG;
+    int64_t stamp = esp_timer_get_time();
+    fb->timestamp.tv_sec = stamp / 1000000;
+    fb->timestamp.tv_usec = stamp % 1000000;
+    return fb;
+}
+
+static void replay_fb_return(void *ctx, camera_fb_t *fb) {
+    pthread_mutex_lock(&s_replay.lock);
+    s_replay.outstanding--;
+    pthread_mutex_unlock(&s_replay.lock);
+    free(fb);
+}
+
+static esp_err_t replay_suspend(void *ctx) {
+    pthread_mutex_lock(&s_replay.lock);
+    s_replay.suspended = true;
+    pthread_mutex_unlock(&s_replay.lock);
+    return ESP_OK;
+}
+
+static esp_err_t replay_resume(void *ctx) {
+    pthread_mutex_lock(&s_replay.lock);
+    s_replay.suspended = false;
+    pthread_cond_broadcast(&s_replay.cond);
+    pthread_mutex_unlock(&s_replay.lock);
+    return ESP_OK;
+}
+
+const frame_source_t *replay_source(void) {
+    static const frame_source_t source = {
+        .get = replay_fb_get,
+        .put = replay_fb_return,
+        .suspend = replay_suspend,
+        .resume = replay_resume,
+    };
+    return &source;
+}
+
+void replay_hold(bool hold) {
+    pthread_mutex_lock(&s_replay.lock);
+    s_replay.hold = hold;
+    pthread_cond_broadcast(&s_replay.cond);
+    pthread_mutex_unlock(&s_replay.lock);
+}
+
+size_t replay_count(void) {
+    return s_replay.count;
+}
+
+const uint8_t *replay_frame(size_t i, size_t *len) {
+    *len = s_replay.files[i].len;
+    return s_replay.files[i].data;
+}
+
+int replay_find(const uint8_t *buf, size_t len) {
+    for (size_t i = 0; i < s_replay.count; i++) {
+        if (s_replay.files[i].len == len && memcmp(s_replay.files[i].data, buf, len) == 0) return (int)i;
+    }
+    return -1;
+}
+
+int replay_outstanding(void) {
+    pthread_mutex_lock(&s_replay.lock);
+    int n = s_replay.outstanding;
+    pthread_mutex_unlock(&s_replay.lock);
+    return n;
+}
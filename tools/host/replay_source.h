@@ -0,0 +1,29 @@
+// Host frame source for frame_broadcaster that replays JPEG files in place
+// of the camera: every *.jpg in a directory, in name order and round and
+// round, one every period like a sensor at a fixed frame rate. Each frame
+// is stamped with the time it was handed out.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "frame_broadcaster.h"
+
+// Loads the files; returns how many, 0 if the directory has none or
+// cannot be read. Call once, before broadcaster_start().
+size_t replay_load(const char *dir, int64_t period_us);
+
+// The source to pass to broadcaster_start(). It can suspend.
+const frame_source_t *replay_source(void);
+
+// Stops handing out frames until released, like a sensor that stalled.
+void replay_hold(bool hold);
+
+size_t replay_count(void);
+// File `i` as loaded
+const uint8_t *replay_frame(size_t i, size_t *len);
+// The loaded file with exactly these bytes, or -1
+int replay_find(const uint8_t *buf, size_t len);
+
+// Frames handed out and not yet given back
+int replay_outstanding(void);
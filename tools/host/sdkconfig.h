@@ -0,0 +1,10 @@
+// Host stand-in for the generated sdkconfig.h, so host tools can build the
+// tjpgd in components/esp_jpeg/tjpgd with gcc.
+// Values are the esp_jpeg Kconfig defaults for the non-ROM decoder.
+#pragma once
+
+#define CONFIG_JD_SZBUF         512
+#define CONFIG_JD_FORMAT        0       // RGB888
+#define CONFIG_JD_USE_SCALE     1
+#define CONFIG_JD_TBLCLIP       1
+#define CONFIG_JD_FASTDECODE    1       // 32-bit barrel shifter
@@ -0,0 +1,435 @@
+#!/usr/bin/env python3
+"""Host-side probe for the ESP32-S3 camera web server.
+
+Usage:
+    python3 tools/mjpeg_probe.py streams <host> [--clients N] [--duration S]
+    python3 tools/mjpeg_probe.py latency <host> [--streams N] [--requests R]
+    python3 tools/mjpeg_probe.py bench <host> [--framing parts chunked raw] [--frames N]
+    python3 tools/mjpeg_probe.py frames <host> [--duration S] [--query Q] [--csv FILE]
+    python3 tools/mjpeg_probe.py resume <host> [--rounds N] [--wait S] [--max-ms MS]
+    python3 tools/mjpeg_probe.py first <host> [--rounds N] [--query Q]
+
+`streams` opens N concurrent /stream viewers and reports the frame rate each
+one receives, so you can check that adding a viewer does not slow the others.
+
+`latency` keeps N viewers streaming in the background and times R requests
+to `/` meanwhile. It fails if `/` stops answering while streams are running.
+
+`bench` streams N frames with each framing mode in turn and reads the
+client socket's TCP_INFO (Linux only) to report bytes on the wire and TCP
+segments per frame, next to the JPEG payload per frame, and the frame rate
+and throughput received. The sender's CPU time per frame cannot be read from
+here; tools/stream_bench.c measures it on the host for the same framings.
+
+`frames` reads the X-Timestamp / X-Frame-Seq part headers and reports
+capture-to-receive latency, sequence gaps and interarrival jitter.
+Capture time is the frame start (VSYNC), so latencies include the
+sensor readout of the frame. The device clock (seconds since boot) is
+mapped to host time from the /stats `uptime_us` sample with the smallest
+round trip, so latencies are accurate to about half that round trip.
+
+`resume` waits until /stats reports capture suspended for lack of viewers,
+then opens /stream and times the first frame. It repeats N times and fails
+if any first frame took longer than --max-ms.
+
+`first` measures time to first pixel: from sending the /stream request to
+having the first JPEG, next to a plain /stats round trip on a fresh
+connection. With the retained frame sent on connect the two should be
+within a frame's transfer time of each other.
+"""
+import argparse
+import csv
+import http.client
+import json
+import socket
+import statistics
+import struct
+import sys
+import threading
+import time
+
+
+class MjpegReader:
+    """Reads multipart/x-mixed-replace parts from an open /stream response."""
+
+    def __init__(self, host, path="/stream", timeout=10):
+        self.conn = http.client.HTTPConnection(host, timeout=timeout)
+        self.conn.request("GET", path)
+        self.sock = self.conn.sock
+        self.resp = self.conn.getresponse()
+        if self.resp.status != 200:
+            raise RuntimeError("%s%s: HTTP %d" % (host, path, self.resp.status))
+
+    def next_part(self):
+        """Returns (headers, jpeg bytes) of the next part, or None at EOF."""
+        line = b""
+        while not line.startswith(b"--"):
+            line = self.resp.readline()
+            if not line:
+                return None
+            line = line.strip()
+        headers = {}
+        while True:
+            line = self.resp.readline()
+            if not line:
+                return None
+            line = line.strip()
+            if not line:
+                break
+            key, _, value = line.decode("latin-1").partition(":")
+            headers[key.strip().lower()] = value.strip()
+        length = int(headers.get("content-length", "0"))
+        body = self.resp.read(length)
+        if len(body) != length:
+            return None
+        return headers, body
+
+    def close(self):
+        self.conn.close()
+
+
+def _stream_worker(host, deadline, result):
+    try:
+        reader = MjpegReader(host)
+    except (OSError, RuntimeError) as e:
+        result["error"] = str(e)
+        return
+    first = None
+    try:
+        while time.monotonic() < deadline:
+            part = reader.next_part()
+            if part is None:
+                result["error"] = "stream closed"
+                break
+            now = time.monotonic()
+            if first is None:
+                first = now
+            result["frames"] += 1
+            result["bytes"] += len(part[1])
+            result["last"] = now
+    except OSError as e:
+        result["error"] = str(e)
+    finally:
+        reader.close()
+    result["first"] = first
+
+
+def cmd_streams(args):
+    deadline = time.monotonic() + args.duration
+    results = [{"frames": 0, "bytes": 0, "first": None, "last": None} for _ in range(args.clients)]
+    threads = [threading.Thread(target=_stream_worker, args=(args.host, deadline, r))
+               for r in results]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    total_fps = 0.0
+    for i, r in enumerate(results):
+        span = (r["last"] - r["first"]) if r["first"] and r["last"] else 0
+        fps = (r["frames"] - 1) / span if span > 0 else 0.0
+        total_fps += fps
+        print("client %d: %4d frames  %6.2f fps  %8.1f KB%s" % (
+            i, r["frames"], fps, r["bytes"] / 1024.0,
+            ("  (" + r["error"] + ")") if "error" in r else ""))
+    print("aggregate: %.2f fps over %d clients" % (total_fps, args.clients))
+    return 0
+
+
+def _get_latency(host, path, timeout):
+    start = time.monotonic()
+    conn = http.client.HTTPConnection(host, timeout=timeout)
+    try:
+        conn.request("GET", path)
+        resp = conn.getresponse()
+        resp.read()
+        if resp.status != 200:
+            raise RuntimeError("HTTP %d" % resp.status)
+    finally:
+        conn.close()
+    return (time.monotonic() - start) * 1000.0
+
+
+def cmd_latency(args):
+    # Streams run until well after the last probe request
+    deadline = time.monotonic() + 3600
+    results = [{"frames": 0, "bytes": 0, "first": None, "last": None} for _ in range(args.streams)]
+    threads = [threading.Thread(target=_stream_worker, args=(args.host, deadline, r), daemon=True)
+               for r in results]
+    for t in threads:
+        t.start()
+    time.sleep(args.warmup)
+
+    samples, failures = [], 0
+    for _ in range(args.requests):
+        try:
+            samples.append(_get_latency(args.host, args.path, args.timeout))
+        except (OSError, RuntimeError) as e:
+            failures += 1
+            print("GET %s failed: %s" % (args.path, e))
+        time.sleep(args.interval)
+
+    streaming = sum(1 for r in results if r["frames"] > 0 and "error" not in r)
+    print("%d/%d streams delivering frames" % (streaming, args.streams))
+    if samples:
+        samples.sort()
+        p95 = samples[min(len(samples) - 1, int(len(samples) * 0.95))]
+        print("GET %s latency over %d requests: min %.1f  median %.1f  p95 %.1f  max %.1f ms" % (
+            args.path, len(samples), samples[0], statistics.median(samples), p95, samples[-1]))
+    if failures or streaming < args.streams:
+        print("FAIL: %d failed requests" % failures)
+        return 1
+    if samples and p95 > args.max_ms:
+        print("FAIL: p95 %.1f ms above %.1f ms" % (p95, args.max_ms))
+        return 1
+    print("PASS")
+    return 0
+
+
+def tcp_info_rx(sock):
+    """Returns (bytes_received, segs_in) from Linux struct tcp_info."""
+    info = sock.getsockopt(socket.IPPROTO_TCP, socket.TCP_INFO, 256)
+    if len(info) < 144:
+        raise RuntimeError("kernel tcp_info too old")
+    bytes_received, = struct.unpack_from("Q", info, 128)
+    segs_in, = struct.unpack_from("I", info, 140)
+    return bytes_received, segs_in
+
+
+def cmd_bench(args):
+    if not hasattr(socket, "TCP_INFO"):
+        print("bench needs TCP_INFO (Linux)")
+        return 1
+    print("%-10s %8s %10s %10s %10s %9s %7s %8s" % (
+        "framing", "frames", "jpeg B/f", "wire B/f", "overhead", "segs/f",
+        "fps", "kbit/s"))
+    for framing in args.framing:
+        query = "?framing=%s" % framing
+        if args.query:
+            query += "&" + args.query
+        reader = MjpegReader(args.host, "/stream" + query)
+        try:
+            # Skip the first frame so response headers are not counted
+            if reader.next_part() is None:
+                raise RuntimeError("stream closed")
+            base_bytes, base_segs = tcp_info_rx(reader.sock)
+            start = time.monotonic()
+            payload = 0
+            for _ in range(args.frames):
+                part = reader.next_part()
+                if part is None:
+                    raise RuntimeError("stream closed")
+                payload += len(part[1])
+            rx_bytes, rx_segs = tcp_info_rx(reader.sock)
+            elapsed = time.monotonic() - start
+        finally:
+            reader.close()
+        # Bytes already buffered by the reader at either end roughly cancel out
+        wire = (rx_bytes - base_bytes) / args.frames
+        segs = (rx_segs - base_segs) / args.frames
+        jpeg = payload / args.frames
+        print("%-10s %8d %10.0f %10.0f %10.0f %9.2f %7.1f %8.0f" % (
+            framing, args.frames, jpeg, wire, wire - jpeg, segs,
+            args.frames / elapsed, wire * args.frames * 8 / elapsed / 1000))
+    return 0
+
+
+def sync_clock(host, probes=8, timeout=5.0):
+    """Returns (offset, rtt): host_time = offset + device_seconds."""
+    best = None
+    for _ in range(probes):
+        conn = http.client.HTTPConnection(host, timeout=timeout)
+        try:
+            t0 = time.time()
+            conn.request("GET", "/stats")
+            body = conn.getresponse().read()
+            t1 = time.time()
+        finally:
+            conn.close()
+        uptime = json.loads(body)["uptime_us"] / 1e6
+        rtt = t1 - t0
+        if best is None or rtt < best[1]:
+            best = ((t0 + t1) / 2 - uptime, rtt)
+    return best
+
+
+def _get_json(host, path, timeout=5.0):
+    conn = http.client.HTTPConnection(host, timeout=timeout)
+    try:
+        conn.request("GET", path)
+        return json.loads(conn.getresponse().read())
+    finally:
+        conn.close()
+
+
+def cmd_resume(args):
+    worst = 0.0
+    for i in range(args.rounds):
+        deadline = time.monotonic() + args.wait
+        while not _get_json(args.host, "/stats")["capture"].get("suspended"):
+            if time.monotonic() > deadline:
+                print("capture not suspended after %.0f s; is idle suspend on, and "
+                      "nothing else (motion detection, other viewers) subscribed?" % args.wait)
+                return 1
+            time.sleep(0.5)
+        start = time.monotonic()
+        reader = MjpegReader(args.host)
+        try:
+            part = reader.next_part()
+        finally:
+            reader.close()
+        if part is None:
+            print("stream closed before the first frame")
+            return 1
+        first_ms = (time.monotonic() - start) * 1000.0
+        device_ms = _get_json(args.host, "/stats")["capture"]["resume_last_us"] / 1000.0
+        worst = max(worst, first_ms)
+        print("round %d: first frame after %.1f ms (device: resume to frame %.1f ms)" % (
+            i + 1, first_ms, device_ms))
+    print("worst %.1f ms, budget %.0f ms: %s" % (worst, args.max_ms,
+                                                 "ok" if worst <= args.max_ms else "FAIL"))
+    return 0 if worst <= args.max_ms else 1
+
+
+def cmd_first(args):
+    rows = []
+    for _ in range(args.rounds):
+        rtt = _get_latency(args.host, "/stats", 5.0)
+        path = "/stream" + ("?" + args.query if args.query else "")
+        start = time.monotonic()
+        reader = MjpegReader(args.host, path)
+        try:
+            part = reader.next_part()
+        finally:
+            reader.close()
+        if part is None:
+            print("stream closed before the first frame")
+            return 1
+        first = (time.monotonic() - start) * 1000.0
+        rows.append((first, rtt, len(part[1])))
+        print("first frame %.1f ms (%d B), request round trip %.1f ms" % (first, len(part[1]), rtt))
+        time.sleep(args.interval)
+    firsts = sorted(r[0] for r in rows)
+    rtts = sorted(r[1] for r in rows)
+    print("median: first frame %.1f ms, round trip %.1f ms" % (
+        statistics.median(firsts), statistics.median(rtts)))
+    try:
+        ff = _get_json(args.host, "/stats")["first_frame"]
+        print("device: %d sessions, %d from the retained frame, avg %.1f ms, max %.1f ms" % (
+            ff["sessions"], ff["retained"], ff["avg_us"] / 1000.0, ff["max_us"] / 1000.0))
+    except (KeyError, ValueError):
+        pass
+    return 0
+
+
+def cmd_frames(args):
+    offset, rtt = sync_clock(args.host)
+    print("clock offset from /stats, rtt %.1f ms" % (rtt * 1000))
+
+    path = "/stream" + ("?" + args.query if args.query else "")
+    reader = MjpegReader(args.host, path)
+    rows = []
+    deadline = time.monotonic() + args.duration
+    try:
+        while time.monotonic() < deadline:
+            part = reader.next_part()
+            if part is None:
+                break
+            recv = time.time()
+            headers = part[0]
+            if "x-timestamp" not in headers or "x-frame-seq" not in headers:
+                print("stream has no X-Timestamp/X-Frame-Seq headers")
+                return 1
+            ts = float(headers["x-timestamp"])
+            rows.append((int(headers["x-frame-seq"]), ts, recv, (recv - offset - ts) * 1000.0))
+    finally:
+        reader.close()
+    if len(rows) < 2:
+        print("not enough frames")
+        return 1
+
+    missing, gaps, max_gap = 0, 0, 0
+    jitter = 0.0
+    for prev, cur in zip(rows, rows[1:]):
+        step = cur[0] - prev[0]
+        if step > 1:
+            missing += step - 1
+            gaps += 1
+            max_gap = max(max_gap, step - 1)
+        # RFC 3550 interarrival jitter, capture clock vs receive clock
+        d = (cur[2] - prev[2]) - (cur[1] - prev[1])
+        jitter += (abs(d) - jitter) / 16.0
+
+    lat = sorted(r[3] for r in rows)
+    span = rows[-1][2] - rows[0][2]
+    print("frames %d (seq %d..%d), %.2f fps received" % (
+        len(rows), rows[0][0], rows[-1][0], (len(rows) - 1) / span if span > 0 else 0))
+    print("latency ms: min %.1f  median %.1f  p95 %.1f  max %.1f" % (
+        lat[0], statistics.median(lat), lat[min(len(lat) - 1, int(len(lat) * 0.95))], lat[-1]))
+    print("gaps: %d missing frames in %d gaps, longest %d" % (missing, gaps, max_gap))
+    print("interarrival jitter: %.2f ms" % (jitter * 1000))
+
+    if args.csv:
+        with open(args.csv, "w", newline="") as f:
+            w = csv.writer(f)
+            w.writerow(["seq", "capture_s", "receive_s", "latency_ms"])
+            w.writerows(rows)
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="cmd", required=True)
+
+    p = sub.add_parser("streams", help="measure per-viewer frame rate")
+    p.add_argument("host", help="device address, e.g. 192.168.1.50")
+    p.add_argument("--clients", type=int, default=2)
+    p.add_argument("--duration", type=float, default=10.0)
+    p.set_defaults(func=cmd_streams)
+
+    p = sub.add_parser("latency", help="time control requests while streams run")
+    p.add_argument("host")
+    p.add_argument("--streams", type=int, default=3)
+    p.add_argument("--requests", type=int, default=50)
+    p.add_argument("--path", default="/")
+    p.add_argument("--interval", type=float, default=0.1)
+    p.add_argument("--warmup", type=float, default=2.0)
+    p.add_argument("--timeout", type=float, default=5.0)
+    p.add_argument("--max-ms", type=float, default=200.0, help="p95 budget")
+    p.set_defaults(func=cmd_latency)
+
+    p = sub.add_parser("bench", help="bytes and segments per frame for each framing")
+    p.add_argument("host")
+    p.add_argument("--framing", nargs="+", default=["parts", "chunked", "raw"])
+    p.add_argument("--frames", type=int, default=200)
+    p.add_argument("--query", default="", help="extra query, e.g. fps=30")
+    p.set_defaults(func=cmd_bench)
+
+    p = sub.add_parser("frames", help="latency, gaps and jitter from part headers")
+    p.add_argument("host")
+    p.add_argument("--duration", type=float, default=10.0)
+    p.add_argument("--query", default="", help="stream query, e.g. fps=10&framing=raw")
+    p.add_argument("--csv", help="write per-frame rows to this file")
+    p.set_defaults(func=cmd_frames)
+
+    p = sub.add_parser("resume", help="time to first frame out of idle suspend")
+    p.add_argument("host")
+    p.add_argument("--rounds", type=int, default=3)
+    p.add_argument("--wait", type=float, default=60.0, help="max seconds to wait for suspend")
+    p.add_argument("--max-ms", type=float, default=300.0)
+    p.set_defaults(func=cmd_resume)
+
+    p = sub.add_parser("first", help="time to first pixel of a new stream")
+    p.add_argument("host")
+    p.add_argument("--rounds", type=int, default=5)
+    p.add_argument("--interval", type=float, default=0.5)
+    p.add_argument("--query", default="", help="stream query, e.g. fps=10")
+    p.set_defaults(func=cmd_first)
+
+    args = parser.parse_args()
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,166 @@
+// Host benchmark for the motion detector: per-frame cost of the 1/8-scale
+// (DC only) luma decode plus scoring, next to a full-size RGB888 decode of
+// the same JPEG. The thumbnail is decoded as the device does it, with tjpgd
+// producing luma only (esp_jpeg's JPEG_IMAGE_FORMAT_GRAY8).
+//
+// Build from the repository root:
+//     gcc -O2 -o motion_bench -I tools/host -I src
+//         -I components/esp_jpeg/tjpgd
+//         tools/motion_bench.c src/motion_detect.c
+//         components/esp_jpeg/tjpgd/tjpgd.c
+//
+// (one command line). Frames must carry their own Huffman tables, as the
+// OV2640's do; tjpgd is built without the default-table fallback here.
+//
+// Usage:
+//     ./motion_bench [-n ITERATIONS] frame.jpg [frame.jpg ...]
+//
+// Grab frames from the device with `curl -o qvga.jpg http://<host>/capture`
+// (switch sizes with /control?var=framesize&val=VGA). With several files the
+// frames are also fed through the motion model in order, as the device
+// would see them, and the per-region scores are printed.
+//
+// Numbers are host CPU time. Absolute values say little about the ESP32-S3;
+// compare the two columns. The gap grows with compression: the 1/8 path
+// still walks every Huffman code, so busy, noisy frames gain the least.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "tjpgd.h"
+#include "motion_detect.h"
+
+#define WORKBUF_SIZE 3100
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+    uint8_t *out;       // decoded image, out_w pixels per row
+    int out_w;
+    int bpp;            // 3 (RGB888) or 1 (luma)
+} bench_io_t;
+
+static size_t in_func(JDEC *jd, uint8_t *buf, size_t n) {
+    bench_io_t *io = jd->device;
+    if (n > io->len - io->pos) n = io->len - io->pos;
+    if (buf) memcpy(buf, io->data + io->pos, n);
+    io->pos += n;
+    return n;
+}
+
+static int out_func(JDEC *jd, void *bitmap, JRECT *rect) {
+    bench_io_t *io = jd->device;
+    const uint8_t *src = bitmap;
+    int w = (rect->right - rect->left + 1) * io->bpp;
+    for (int y = rect->top; y <= rect->bottom; y++) {
+        memcpy(io->out + (y * io->out_w + rect->left) * io->bpp, src, w);
+        src += w;
+    }
+    return 1;
+}
+
+static uint8_t s_work[WORKBUF_SIZE];
+
+// Decodes at 1/2^scale into out, as luma or RGB888; 0 on success
+static int decode(const uint8_t *data, size_t len, int scale, bool gray, uint8_t *out, int *w, int *h) {
+    bench_io_t io = { .data = data, .len = len, .out = out, .bpp = gray ? 1 : 3 };
+    JDEC jd;
+    if (jd_prepare(&jd, in_func, s_work, sizeof(s_work), &io) != JDR_OK) return -1;
+    jd.gray = gray;
+    *w = jd.width >> scale;
+    *h = jd.height >> scale;
+    io.out_w = *w;
+    if (jd_decomp(&jd, out_func, scale) != JDR_OK) return -1;
+    return 0;
+}
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static uint8_t *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(*len);
+    if (buf && fread(buf, 1, *len, f) != *len) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    return buf;
+}
+
+int main(int argc, char **argv) {
+    int iterations = 200;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        iterations = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc || iterations <= 0) {
+        fprintf(stderr, "usage: %s [-n ITERATIONS] frame.jpg [frame.jpg ...]\n", argv[0]);
+        return 2;
+    }
+
+    static uint8_t full[1600 * 1200 * 3];
+    static uint8_t luma[MOTION_THUMB_MAX_W * MOTION_THUMB_MAX_H];
+    static motion_model_t model;
+
+    printf("%-24s %9s %9s %11s %11s %8s\n", "file", "size", "bytes", "full_us", "thumb_us", "speedup");
+    for (int i = first; i < argc; i++) {
+        size_t len;
+        uint8_t *data = read_file(argv[i], &len);
+        int w, h, tw, th;
+        if (!data || decode(data, len, 0, false, full, &w, &h) != 0 || decode(data, len, 3, true, luma, &tw, &th) != 0 ||
+            tw > MOTION_THUMB_MAX_W || th > MOTION_THUMB_MAX_H) {
+            fprintf(stderr, "%s: cannot decode\n", argv[i]);
+            free(data);
+            return 1;
+        }
+
+        double t0 = now_us();
+        for (int k = 0; k < iterations; k++) decode(data, len, 0, false, full, &w, &h);
+        double full_us = (now_us() - t0) / iterations;
+
+        // The device path: 1/8 luma decode, background update and scores
+        motion_result_t r;
+        motion_model_reset(&model);
+        t0 = now_us();
+        for (int k = 0; k < iterations; k++) {
+            decode(data, len, 3, true, luma, &tw, &th);
+            motion_model_update(&model, luma, tw, th, &r);
+        }
+        double thumb_us = (now_us() - t0) / iterations;
+
+        char size[16];
+        snprintf(size, sizeof(size), "%dx%d", w, h);
+        printf("%-24s %9s %9zu %11.1f %11.1f %7.1fx\n", argv[i], size, len, full_us, thumb_us,
+               full_us / thumb_us);
+        free(data);
+    }
+
+    if (argc - first < 2) return 0;
+    printf("\nsequence (%dx%d regions, trigger %d%%):\n", MOTION_REGIONS_X, MOTION_REGIONS_Y,
+           MOTION_REGION_TRIGGER);
+    motion_model_reset(&model);
+    for (int i = first; i < argc; i++) {
+        size_t len;
+        uint8_t *data = read_file(argv[i], &len);
+        int tw, th;
+        motion_result_t r;
+        decode(data, len, 3, true, luma, &tw, &th);
+        motion_model_update(&model, luma, tw, th, &r);
+        printf("%-24s motion=%d max=%3u%% mean_diff=%3u [", argv[i], r.motion, r.max_score, r.mean_diff);
+        for (int k = 0; k < MOTION_REGIONS; k++) printf("%s%u", k ? " " : "", r.score[k]);
+        printf("]\n");
+        free(data);
+    }
+    return 0;
+}
@@ -0,0 +1,210 @@
+// Host bench for the MJPEG framings: sends the same replayed JPEG files
+// with each framing through mjpeg_writer.c, as the firmware builds it, to
+// a loopback client that reads as fast as it can or at a capped rate.
+// Reports frames and megabits per second, wire bytes and socket writes per
+// frame, and the sending thread's CPU time per frame (user and system, so
+// the cost of the socket calls is in it).
+//
+// Build and run from the repository root:
+//     gcc -O2 -Wall -pthread -o stream_bench -I tools/host -I src
+//         tools/stream_bench.c tools/host/freertos_host.c
+//         tools/host/httpd_host.c tools/host/replay_source.c
+//         src/mjpeg_writer.c && ./stream_bench [options] [frames_dir]
+//
+// (one command line). Options:
+//     --frames N    frames per run (default 20000)
+//     --rounds N    runs per framing, interleaved; the median is reported (5)
+//     --kbps N      cap the reader at N kbit/s, like a Wi-Fi viewer (no cap)
+//
+// Loopback is not Wi-Fi and a host core is not an ESP32 one: compare the
+// framings with each other, not with the device. The server's send buffer
+// is about lwIP's, see HOST_HTTPD_SNDBUF in tools/host/httpd_host.c.
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include "mjpeg_writer.h"
+#include "replay_source.h"
+#include "esp_timer.h"
+#include "esp_http_server.h"
+
+#define FRAMINGS 3
+
+typedef struct {
+    uint32_t frames;
+    int64_t wall_us;
+    int64_t cpu_us;             // sending thread
+    uint64_t wire_bytes;
+    uint64_t jpeg_bytes;
+    uint32_t send_calls;
+} run_t;
+
+static uint16_t s_port;
+static run_t s_run;             // written by the handler before it returns
+
+static int64_t thread_cpu_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// GET /bench?framing=X&frames=N: N frames back to back, no pacing
+static esp_err_t bench_handler(httpd_req_t *req) {
+    char query[64], val[16];
+    mjpeg_framing_t framing = MJPEG_FRAMING_CHUNKED;
+    uint32_t frames = 0;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "framing", val, sizeof(val)) == ESP_OK) {
+            mjpeg_framing_from_str(val, &framing);
+        }
+        if (httpd_query_key_value(query, "frames", val, sizeof(val)) == ESP_OK) frames = atoi(val);
+    }
+
+    mjpeg_writer_t w;
+    mjpeg_writer_init(&w, req, framing);
+    run_t run = { 0 };
+    int64_t start = esp_timer_get_time();
+    int64_t cpu_start = thread_cpu_us();
+    for (uint32_t i = 0; i < frames; i++) {
+        camera_fb_t fb = { .format = PIXFORMAT_JPEG };
+        fb.buf = (uint8_t *)replay_frame(i % replay_count(), &fb.len);
+        int64_t now = esp_timer_get_time();
+        fb.timestamp.tv_sec = now / 1000000;
+        fb.timestamp.tv_usec = now % 1000000;
+        if (mjpeg_writer_send(&w, &fb, i + 1) != ESP_OK) break;
+        run.jpeg_bytes += fb.len;
+    }
+    run.cpu_us = thread_cpu_us() - cpu_start;
+    run.wall_us = esp_timer_get_time() - start;
+    run.frames = w.frames;
+    run.wire_bytes = w.wire_bytes;
+    run.send_calls = w.send_calls;
+    s_run = run;
+    if (framing != MJPEG_FRAMING_RAW) httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+// Reads the whole response, at most `kbps` if set; false on error
+static bool drain(const char *path, uint32_t kbps) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(s_port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return false;
+    }
+    char buf[16384];
+    int n = snprintf(buf, sizeof(buf), "GET %s HTTP/1.1\r\nHost: localhost\r\n\r\n", path);
+    bool ok = send(fd, buf, n, 0) == n;
+    uint64_t got = 0;
+    int64_t start = esp_timer_get_time();
+    while (ok) {
+        ssize_t r = recv(fd, buf, kbps ? 1460 : sizeof(buf), 0);
+        if (r == 0) break;
+        if (r < 0) {
+            ok = errno == EINTR;
+            continue;
+        }
+        got += r;
+        if (kbps) {
+            int64_t due = start + (int64_t)(got * 8 * 1000 / kbps);
+            int64_t now = esp_timer_get_time();
+            if (due > now) usleep(due - now);
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+static int cmp_run(const void *a, const void *b) {
+    const run_t *x = a, *y = b;
+    int64_t kx = x->cpu_us * (int64_t)y->frames, ky = y->cpu_us * (int64_t)x->frames;
+    return (kx > ky) - (kx < ky);
+}
+
+int main(int argc, char **argv) {
+    uint32_t frames = 20000, rounds = 5, kbps = 0;
+    const char *dir = "tools/frames";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--kbps") == 0 && i + 1 < argc) {
+            kbps = atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            printf("usage: %s [--frames N] [--rounds N] [--kbps N] [frames_dir]\n", argv[0]);
+            return 1;
+        } else {
+            dir = argv[i];
+        }
+    }
+    if (frames == 0 || rounds == 0 || replay_load(dir, 0) == 0) {
+        printf("%s: no .jpg files\n", dir);
+        return 1;
+    }
+    uint64_t total = 0;
+    for (size_t i = 0; i < replay_count(); i++) {
+        size_t len;
+        replay_frame(i, &len);
+        total += len;
+    }
+
+    httpd_handle_t server;
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = 0;
+    static const httpd_uri_t bench_uri = { .uri = "/bench", .method = HTTP_GET, .handler = bench_handler };
+    if (httpd_start(&server, &config) != ESP_OK) {
+        printf("httpd_start failed\n");
+        return 1;
+    }
+    httpd_register_uri_handler(server, &bench_uri);
+    s_port = host_httpd_port(server);
+    printf("%zu files from %s, %llu B average; %u frames x %u rounds per framing\n",
+           replay_count(), dir, (unsigned long long)(total / replay_count()), (unsigned)frames,
+           (unsigned)rounds);
+    if (kbps) printf("reader capped at %u kbit/s\n", (unsigned)kbps);
+
+    // Interleaved, so drift in the host's load hits every framing alike
+    run_t *runs = calloc((size_t)FRAMINGS * rounds, sizeof(run_t));
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (int f = 0; f < FRAMINGS; f++) {
+            char path[64];
+            snprintf(path, sizeof(path), "/bench?framing=%s&frames=%u",
+                     mjpeg_framing_name((mjpeg_framing_t)f), (unsigned)frames);
+            memset(&s_run, 0, sizeof(s_run));
+            if (!drain(path, kbps) || s_run.frames != frames) {
+                printf("%s: run failed after %u frames\n", mjpeg_framing_name((mjpeg_framing_t)f),
+                       (unsigned)s_run.frames);
+                return 1;
+            }
+            runs[f * rounds + r] = s_run;
+        }
+    }
+
+    printf("%-8s %8s %8s %9s %9s %8s %9s\n",
+           "framing", "fps", "Mbit/s", "wire B/f", "overhead", "sends/f", "cpu us/f");
+    for (int f = 0; f < FRAMINGS; f++) {
+        run_t *fr = &runs[f * rounds];
+        qsort(fr, rounds, sizeof(run_t), cmp_run);
+        const run_t *m = &fr[rounds / 2];       // median by CPU per frame
+        double secs = m->wall_us / 1e6;
+        printf("%-8s %8.0f %8.1f %9.0f %9.0f %8.2f %9.2f\n",
+               mjpeg_framing_name((mjpeg_framing_t)f), m->frames / secs,
+               m->wire_bytes * 8 / secs / 1e6, (double)m->wire_bytes / m->frames,
+               (double)(m->wire_bytes - m->jpeg_bytes) / m->frames,
+               (double)m->send_calls / m->frames, (double)m->cpu_us / m->frames);
+    }
+    free(runs);
+    return 0;
+}
@@ -0,0 +1,473 @@
+// Host test for /stream: stream.c, mjpeg_writer.c, frame_pacer.c and
+// frame_broadcaster.c as the firmware builds them, fed by a replay of the
+// JPEG files in tools/frames (or a directory given on the command line),
+// served by the loopback httpd in tools/host and read by real TCP clients.
+//
+// Covers the three framings byte for byte, peer-close detection, a viewer
+// that stops reading, the idle timeout, the worker limit and /stats.
+// camera_capture, thumbnail and boot_timeline are stubbed: the quality and
+// size controllers have their own test, and static-scene suppression is
+// not covered here.
+//
+// Build and run from the repository root:
+//     gcc -O2 -Wall -pthread -DSTREAM_IDLE_TIMEOUT_MS=2000 -o stream_test
+//         -I tools/host -I src tools/stream_test.c tools/host/freertos_host.c
+//         tools/host/httpd_host.c tools/host/replay_source.c src/stream.c
+//         src/mjpeg_writer.c src/frame_pacer.c src/frame_broadcaster.c
+//         src/json_util.c src/motion_detect.c
+//         && ./stream_test [frames_dir]
+//
+// (one command line). Exits non-zero if any check fails. The files in
+// tools/frames are synthetic QVGA frames, a scene with a moving box.
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include "stream.h"
+#include "camera_capture.h"
+#include "thumbnail.h"
+#include "boot_timeline.h"
+#include "mjpeg_writer.h"
+#include "replay_source.h"
+#include "esp_timer.h"
+#include "esp_http_server.h"
+
+#ifndef STREAM_IDLE_TIMEOUT_MS
+#define STREAM_IDLE_TIMEOUT_MS 10000    // must match stream.c
+#endif
+#define STREAM_SEND_TIMEOUT_MS 3000     // as in stream.c
+#define FRAME_PERIOD_US 20000           // 50 fps source, ahead of any viewer
+#define PARTS_PER_TEST  20
+#define JPEG_MAX        (256 * 1024)
+
+static int s_failed = 0;
+static uint16_t s_port;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            s_failed++; \
+        } \
+    } while (0)
+
+// Polls `cond` for up to `ms`; true once it holds
+#define WAIT_FOR(cond, ms) ({ \
+        bool ok_ = false; \
+        for (int t_ = 0; t_ < (ms) && !(ok_ = (cond)); t_++) usleep(1000); \
+        ok_; \
+    })
+
+// ==== camera_capture, thumbnail and boot_timeline stand-ins ====
+// The real ones retune the sensor and decode thumbnails; here they only
+// count what stream.c reports.
+static atomic_uint s_reported;
+
+void camera_report_frame(size_t jpeg_bytes, int64_t send_us, bool late) {
+    atomic_fetch_add(&s_reported, 1);
+}
+
+void camera_quality_get_stats(quality_ctrl_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+}
+
+void camera_framesize_get_stats(camera_framesize_stats_t *out) {
+    *out = (camera_framesize_stats_t) { .name = "QVGA", .max_name = "QVGA" };
+}
+
+esp_err_t thumbnail_signature(const frame_t *frame, scene_sig_t *out) {
+    return ESP_FAIL;    // never suppressed
+}
+
+void thumbnail_get_stats(thumbnail_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+}
+
+void boot_mark(const char *stage) {
+}
+
+// ==== Client ====
+typedef struct {
+    int fd;
+    int status;
+    char type[256];
+    bool chunked;
+    size_t chunk_left;          // body bytes left in the current chunk
+    uint32_t chunks;
+} client_t;
+
+static int client_socket(int rcvbuf) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (rcvbuf) setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct timeval tv = { .tv_sec = 5 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(s_port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool read_raw(int fd, void *buf, size_t n) {
+    char *p = buf;
+    while (n > 0) {
+        ssize_t got = recv(fd, p, n, 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        n -= got;
+    }
+    return true;
+}
+
+// One CRLF-terminated line, without the CRLF
+static bool raw_line(int fd, char *buf, size_t cap) {
+    size_t len = 0;
+    while (len + 1 < cap) {
+        if (!read_raw(fd, buf + len, 1)) return false;
+        if (buf[len] == '\n') {
+            if (len > 0 && buf[len - 1] == '\r') len--;
+            buf[len] = '\0';
+            return true;
+        }
+        len++;
+    }
+    return false;
+}
+
+// Sends the request and reads the response head; the body is left unread
+static bool client_get(client_t *c, const char *path, int rcvbuf) {
+    *c = (client_t) { .fd = client_socket(rcvbuf) };
+    if (c->fd < 0) return false;
+    char req[256];
+    int n = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: localhost\r\n\r\n", path);
+    if (send(c->fd, req, n, 0) != n) return false;
+    char line[256];
+    if (!raw_line(c->fd, line, sizeof(line)) || sscanf(line, "HTTP/1.1 %d", &c->status) != 1) return false;
+    while (raw_line(c->fd, line, sizeof(line))) {
+        if (!line[0]) return true;
+        if (strncmp(line, "Content-Type: ", 14) == 0) {
+            snprintf(c->type, sizeof(c->type), "%s", line + 14);
+        } else if (strcmp(line, "Transfer-Encoding: chunked") == 0) {
+            c->chunked = true;
+        }
+    }
+    return false;
+}
+
+static void client_close(client_t *c) {
+    if (c->fd >= 0) close(c->fd);
+    c->fd = -1;
+}
+
+// Body bytes, with the chunk framing taken off and checked
+static bool body_read(client_t *c, void *buf, size_t n) {
+    char *p = buf;
+    while (n > 0) {
+        if (c->chunked && c->chunk_left == 0) {
+            char line[32];
+            if (!raw_line(c->fd, line, sizeof(line))) return false;
+            c->chunk_left = strtoul(line, NULL, 16);
+            if (c->chunk_left == 0) return false;   // last chunk
+            c->chunks++;
+        }
+        size_t take = n;
+        if (c->chunked && take > c->chunk_left) take = c->chunk_left;
+        if (!read_raw(c->fd, p, take)) return false;
+        p += take;
+        n -= take;
+        if (c->chunked && (c->chunk_left -= take) == 0) {
+            char crlf[2];
+            if (!read_raw(c->fd, crlf, 2) || crlf[0] != '\r' || crlf[1] != '\n') return false;
+        }
+    }
+    return true;
+}
+
+static bool body_line(client_t *c, char *buf, size_t cap) {
+    size_t len = 0;
+    while (len + 1 < cap) {
+        if (!body_read(c, buf + len, 1)) return false;
+        if (buf[len] == '\n') {
+            if (len > 0 && buf[len - 1] == '\r') len--;
+            buf[len] = '\0';
+            return true;
+        }
+        len++;
+    }
+    return false;
+}
+
+typedef struct {
+    uint32_t seq;
+    int64_t stamp_us;
+    size_t len;
+    int file;                   // which replayed file it is, -1 if none
+} part_t;
+
+static uint8_t s_jpeg[JPEG_MAX];
+
+// The next multipart part; its JPEG is left in s_jpeg
+static bool read_part(client_t *c, part_t *part) {
+    char line[128];
+    do {
+        if (!body_line(c, line, sizeof(line))) return false;
+    } while (!line[0]);
+    if (strcmp(line, "--frame") != 0) return false;
+
+    *part = (part_t) { .file = -1 };
+    bool jpeg = false;
+    while (body_line(c, line, sizeof(line))) {
+        int sec, usec;
+        unsigned val;
+        if (!line[0]) {
+            if (!jpeg || part->len == 0 || part->len > JPEG_MAX) return false;
+            if (!body_read(c, s_jpeg, part->len)) return false;
+            part->file = replay_find(s_jpeg, part->len);
+            return true;
+        }
+        if (strcmp(line, "Content-Type: image/jpeg") == 0) {
+            jpeg = true;
+        } else if (sscanf(line, "Content-Length: %u", &val) == 1) {
+            part->len = val;
+        } else if (sscanf(line, "X-Timestamp: %d.%d", &sec, &usec) == 2) {
+            part->stamp_us = sec * 1000000LL + usec;
+        } else if (sscanf(line, "X-Frame-Seq: %u", &val) == 1) {
+            part->seq = val;
+        }
+    }
+    return false;
+}
+
+// Reads until the server closes; false if it does not within the timeout
+static bool wait_eof(client_t *c) {
+    char buf[4096];
+    while (true) {
+        ssize_t n = recv(c->fd, buf, sizeof(buf), 0);
+        if (n == 0) return true;
+        if (n < 0 && errno != EINTR) return false;
+    }
+}
+
+// ==== Tests ====
+static void test_framing(mjpeg_framing_t framing) {
+    char path[64];
+    snprintf(path, sizeof(path), "/stream?fps=30&framing=%s", mjpeg_framing_name(framing));
+    client_t c;
+    CHECK(client_get(&c, path, 0));
+    CHECK(c.status == 200);
+    CHECK(strcmp(c.type, "multipart/x-mixed-replace;boundary=frame") == 0);
+    CHECK(c.chunked == (framing != MJPEG_FRAMING_RAW));
+    unsigned reported = atomic_load(&s_reported);
+
+    // Every part is one of the files, intact, in capture order
+    part_t prev = { 0 };
+    int parts = 0;
+    bool distinct = false;
+    for (; parts < PARTS_PER_TEST; parts++) {
+        part_t part;
+        if (!read_part(&c, &part)) break;
+        CHECK(part.file >= 0);
+        CHECK(part.seq > prev.seq);
+        CHECK(part.stamp_us >= prev.stamp_us);
+        CHECK(part.stamp_us <= esp_timer_get_time());
+        if (parts > 0 && part.file != prev.file) distinct = true;
+        prev = part;
+    }
+    CHECK(parts == PARTS_PER_TEST);
+    CHECK(distinct);
+    // Reported once the write returned, which may be after we have read it
+    CHECK(WAIT_FOR(atomic_load(&s_reported) - reported >= (unsigned)parts, 100));
+
+    // parts: boundary, part headers and JPEG each in a chunk of their own
+    if (framing == MJPEG_FRAMING_PARTS) CHECK(c.chunks == 3 * (uint32_t)parts);
+    if (framing == MJPEG_FRAMING_CHUNKED) CHECK(c.chunks == (uint32_t)parts);
+    client_close(&c);
+    CHECK(WAIT_FOR(stream_active_sessions() == 0, 1000));
+}
+
+static void test_framing_parts(void) {
+    test_framing(MJPEG_FRAMING_PARTS);
+}
+
+static void test_framing_chunked(void) {
+    test_framing(MJPEG_FRAMING_CHUNKED);
+}
+
+static void test_framing_raw(void) {
+    test_framing(MJPEG_FRAMING_RAW);
+}
+
+static void test_peer_close(void) {
+    client_t c;
+    part_t part;
+    CHECK(client_get(&c, "/stream?fps=30", 0));
+    for (int i = 0; i < 3; i++) CHECK(read_part(&c, &part));
+    CHECK(stream_active_sessions() == 1);
+
+    // Torn down on the FIN, well before the next write could fail
+    int64_t closed = esp_timer_get_time();
+    client_close(&c);
+    CHECK(WAIT_FOR(stream_active_sessions() == 0, 500));
+    printf("  session gone %lld ms after the viewer closed\n",
+           (long long)(esp_timer_get_time() - closed) / 1000);
+}
+
+static void test_stalled_viewer(void) {
+    // A tiny receive window and nothing read. The kernel still lets a few
+    // bytes through now and then, so no single write times out; the frame
+    // deadline drops the viewer anyway.
+    client_t c;
+    CHECK(client_get(&c, "/stream?fps=30", 4096));
+    CHECK(c.status == 200);
+    CHECK(WAIT_FOR(stream_active_sessions() == 1, 500));
+    int64_t start = esp_timer_get_time();
+    CHECK(WAIT_FOR(stream_active_sessions() == 0, STREAM_SEND_TIMEOUT_MS + 1500));
+    printf("  stalled viewer dropped after %lld ms\n", (long long)(esp_timer_get_time() - start) / 1000);
+    CHECK(wait_eof(&c));
+    client_close(&c);
+}
+
+static void test_idle_timeout(void) {
+    // The sensor stops: the retained frame goes out, then nothing
+    replay_hold(true);
+    usleep(3 * FRAME_PERIOD_US);
+    client_t c;
+    part_t part;
+    CHECK(client_get(&c, "/stream?fps=30", 0));
+    CHECK(read_part(&c, &part));
+    int64_t first = esp_timer_get_time();
+    CHECK(wait_eof(&c));
+    int64_t waited_ms = (esp_timer_get_time() - first) / 1000;
+    printf("  closed %lld ms after the last frame\n", (long long)waited_ms);
+    CHECK(waited_ms >= STREAM_IDLE_TIMEOUT_MS - 50);
+    CHECK(waited_ms < STREAM_IDLE_TIMEOUT_MS + 1500);
+    client_close(&c);
+    CHECK(WAIT_FOR(stream_active_sessions() == 0, 500));
+    replay_hold(false);
+}
+
+static void test_busy(void) {
+    client_t viewers[STREAM_MAX_SESSIONS];
+    part_t part;
+    for (int i = 0; i < STREAM_MAX_SESSIONS; i++) {
+        CHECK(client_get(&viewers[i], "/stream?fps=10", 0));
+        CHECK(read_part(&viewers[i], &part));
+    }
+    CHECK(stream_active_sessions() == STREAM_MAX_SESSIONS);
+
+    // One too many: turned away at once, the others keep going
+    client_t extra;
+    char body[32] = "";
+    CHECK(client_get(&extra, "/stream", 0));
+    CHECK(extra.status == 503);
+    CHECK(read_raw(extra.fd, body, strlen("Too many viewers")));
+    CHECK(strcmp(body, "Too many viewers") == 0);
+    client_close(&extra);
+    for (int i = 0; i < STREAM_MAX_SESSIONS; i++) {
+        CHECK(read_part(&viewers[i], &part));
+        client_close(&viewers[i]);
+    }
+
+    // Every worker went back to the pool
+    CHECK(WAIT_FOR(stream_active_sessions() == 0, 1000));
+    for (int i = 0; i < STREAM_MAX_SESSIONS; i++) {
+        CHECK(client_get(&viewers[i], "/stream?fps=10", 0));
+        CHECK(viewers[i].status == 200);
+    }
+    for (int i = 0; i < STREAM_MAX_SESSIONS; i++) {
+        CHECK(read_part(&viewers[i], &part));
+        client_close(&viewers[i]);
+    }
+    CHECK(WAIT_FOR(stream_active_sessions() == 0, 1000));
+}
+
+static void test_stats(void) {
+    client_t a, b, stats;
+    part_t part;
+    CHECK(client_get(&a, "/stream?framing=parts", 0));
+    CHECK(client_get(&b, "/stream?framing=raw&fps=5", 0));
+    CHECK(read_part(&a, &part));
+    CHECK(read_part(&b, &part));
+
+    CHECK(client_get(&stats, "/stats", 0));
+    CHECK(stats.status == 200);
+    CHECK(strcmp(stats.type, "application/json") == 0);
+    static char json[8192];
+    ssize_t len = 0, n;
+    while (len < (ssize_t)sizeof(json) - 1 && (n = recv(stats.fd, json + len, sizeof(json) - 1 - len, 0)) > 0) {
+        len += n;
+    }
+    json[len] = '\0';
+    CHECK(strstr(json, "\"active_sessions\":2,"));
+    CHECK(strstr(json, "\"framing\":\"parts\""));
+    CHECK(strstr(json, "\"framing\":\"raw\""));
+    CHECK(strstr(json, "\"fps\":5,"));
+    CHECK(json[len - 1] == '}');
+    client_close(&stats);
+    client_close(&a);
+    client_close(&b);
+    CHECK(WAIT_FOR(stream_active_sessions() == 0, 1000));
+}
+
+int main(int argc, char **argv) {
+    const char *dir = argc > 1 ? argv[1] : "tools/frames";
+    size_t files = replay_load(dir, FRAME_PERIOD_US);
+    if (files < 2) {
+        printf("%s: need at least two .jpg files\n", dir);
+        return 1;
+    }
+    static const broadcaster_config_t config = {
+        .core = tskNO_AFFINITY,
+        .max_age_ms = 0,
+        .idle_suspend_ms = 0,
+    };
+    httpd_handle_t server;
+    httpd_config_t httpd_config = HTTPD_DEFAULT_CONFIG();
+    httpd_config.server_port = 0;
+    if (broadcaster_start(replay_source(), &config) != ESP_OK ||
+        stream_workers_start() != ESP_OK ||
+        httpd_start(&server, &httpd_config) != ESP_OK) {
+        printf("start failed\n");
+        return 1;
+    }
+    static const httpd_uri_t stream_uri = { .uri = "/stream", .method = HTTP_GET, .handler = stream_handler };
+    static const httpd_uri_t stats_uri = { .uri = "/stats", .method = HTTP_GET, .handler = stream_stats_handler };
+    httpd_register_uri_handler(server, &stream_uri);
+    httpd_register_uri_handler(server, &stats_uri);
+    s_port = host_httpd_port(server);
+    printf("%zu frames from %s, server on port %u\n", files, dir, s_port);
+
+    static const struct {
+        const char *name;
+        void (*fn)(void);
+    } tests[] = {
+        { "framing: parts", test_framing_parts },
+        { "framing: chunked", test_framing_chunked },
+        { "framing: raw", test_framing_raw },
+        { "peer close", test_peer_close },
+        { "stalled viewer", test_stalled_viewer },
+        { "idle timeout", test_idle_timeout },
+        { "all workers busy", test_busy },
+        { "stats", test_stats },
+    };
+    int failed_tests = 0;
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        int before = s_failed;
+        tests[i].fn();
+        printf("%-30s %s\n", tests[i].name, s_failed == before ? "ok" : "FAILED");
+        if (s_failed != before) failed_tests++;
+    }
+    printf("%d of %zu failed\n", failed_tests, sizeof(tests) / sizeof(tests[0]));
+    return s_failed ? 1 : 0;
+}